@@ -0,0 +1,33 @@
+#ifndef _ACTIVITY_H_
+#define _ACTIVITY_H_
+//===================================================================
+// activity.hpp
+// Definitions for the link/ACT LED hardware activity counters (see
+// activity.cpp).
+//===================================================================
+#include "main.hpp"
+#include "pins.hpp"
+
+#define ACT_PORT_CNT              2           // 0 = P1, 1 = P3
+#define ACT_INTERVAL_MS           1000        // counter sample interval
+#define ACT_EVSYS_CH              1           // first of 4 EVSYS channels used (1..4)
+#define ACT_DUTY_CLK_DIV          1024        // TCC0/TCC1 prescaler for asserted-time count
+
+// EIC lines owned by the activity counters; events.cpp polls any pin
+// that shares one of these
+constexpr uint32_t          ACT_EIC_LINES = (1ul << eicLineOf(P1_LED_ACT_N)) | (1ul << eicLineOf(P3_LED_ACT_N));
+
+static_assert(eicLineOf(P1_LED_ACT_N) != eicLineOf(P3_LED_ACT_N), "P1/P3 ACT LEDs must be on different EIC lines");
+
+// results of the last completed interval
+typedef struct {
+    uint32_t        rate10;               // LED assertions per 10 seconds (per second, 1 decimal)
+    uint16_t        duty10;               // 0.1% units of the interval the LED was on
+    uint32_t        total;                // assertions since boot
+} activity_port_t;
+
+void activity_Init(void);
+void activity_Service(void);
+uint32_t activity_Get(uint8_t port, activity_port_t *a);
+
+#endif // _ACTIVITY_H_
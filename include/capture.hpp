@@ -0,0 +1,29 @@
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+//===================================================================
+// capture.hpp
+// Definitions for DMA logic-analyzer capture of the TTF pins (see
+// capture.cpp).
+//===================================================================
+#include <stdint-gcc.h>
+
+#define CAPTURE_SAMPLES           1024        // ring size per PORT group, MUST be a power of 2
+#define CAPTURE_CHUNK             64          // samples per DMA descriptor/interrupt
+#define CAPTURE_WINDOW            (CAPTURE_SAMPLES - CAPTURE_CHUNK)   // max samples shown
+#define CAPTURE_MIN_RATE          1000        // Hz
+#define CAPTURE_MAX_RATE          500000      // Hz
+#define CAPTURE_EVSYS_CH          0           // TC3 overflow -> DMAC channel event inputs
+#define CAPTURE_DUMP_VERSION      1
+
+typedef enum {
+    CAP_IDLE = 0,
+    CAP_ARMED,                              // sampling, waiting for trigger edge
+    CAP_TRIGGERED,                          // filling post-trigger window
+    CAP_DONE,
+} CAPTURE_STATE;
+
+void capture_Init(void);
+CAPTURE_STATE capture_State(void);
+int captureCmd(int arg);
+
+#endif // _CAPTURE_H_
@@ -5,16 +5,26 @@
 // Definitions for project commands (see commands.cpp).
 //===================================================================
 #include <stdint-gcc.h>
+#include "main.hpp"
+
+// one output change for writePins()
+typedef struct {
+    uint8_t         pinNo;
+    uint8_t         value;
+} pin_write_t;
 
 void monitorsInit(void);
 const char *getPinName(int pinNo);
 int8_t getPinIndex(uint8_t pinNo);
+ACTIVE_STATE getPinActiveState(uint8_t pinNo);
 int statusCmd(int arg);
 char *padBuffer(int pos);
 void configureIOPins(void);
 void readAllPins(void);
 bool readPin(uint8_t pinNo);
+uint8_t getPinState(uint8_t pinNo);
 void writePin(uint8_t pinNo, uint8_t value);
+bool writePins(const pin_write_t *writes, uint8_t count);
 bool isCardPresent(void);
 
 #endif // _COMMANDS_H_
\ No newline at end of file
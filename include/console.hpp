@@ -0,0 +1,44 @@
+#ifndef _CONSOLE_H_
+#define _CONSOLE_H_
+//===================================================================
+// console.hpp
+// Definitions for buffered console output (see console.cpp).
+//===================================================================
+#include <stdint-gcc.h>
+
+#define CONSOLE_TX_BFR_SIZE       2048        // MUST be a power of 2
+#define CONSOLE_TX_TIMEOUT_MS     100         // max wait for ring space before output is dropped
+#define CONSOLE_TX_IDLE_FRAMES    2           // USB frames (ms) before a partial packet is sent
+
+// console output counters, see 'xdebug console'
+typedef struct {
+    uint32_t        bytes;                // bytes accepted into ring buffer
+    uint32_t        lines;                // line feeds accepted into ring buffer
+    uint32_t        packets;              // USB packets handed to CDC IN endpoint
+    uint32_t        shortPackets;         // packets < 64 bytes (idle timer or end of response)
+    uint32_t        zlps;                 // zero length packets ending a transfer
+    uint32_t        dropped;              // bytes dropped (host not reading)
+    uint32_t        stalls;               // times a writer had to wait for ring space
+    uint32_t        startTime;            // millis() when counters were last reset
+} console_stats_t;
+
+void console_write(const char *s, uint32_t len);
+void console_puts(const char *s);
+void console_putc(char c);
+char *console_txClaim(uint32_t len);
+void console_txCommit(uint32_t len);
+bool console_flush(uint32_t timeoutMs);
+void console_endResponse(void);
+uint32_t console_txPending(void);
+void console_getStats(console_stats_t *stats);
+void console_resetStats(void);
+
+// called from USB ISR context (see USBCore.cpp)
+uint32_t console_txPop(uint8_t *dest, uint32_t maxLen, bool *zlp);
+void console_txTick(void);
+
+// implemented in USBCore.cpp: start draining the ring buffer now
+// rather than waiting for the next USB start-of-frame interrupt
+void console_txKick(void);
+
+#endif // _CONSOLE_H_
@@ -4,6 +4,8 @@
 void debug_scan(void);
 void debug_reset(void);
 void debug_dump_eeprom(void);
+void debug_console(int arg);
+void debug_scancmp(int arg);
 int debug(int arg);
 
 #endif // _DEBUG_H_
\ No newline at end of file
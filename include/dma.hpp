@@ -0,0 +1,30 @@
+#ifndef _DMA_H_
+#define _DMA_H_
+//===================================================================
+// dma.hpp
+// Definitions for the shared DMAC descriptor tables and channel
+// assignments (see dma.cpp).
+//===================================================================
+#include <Arduino.h>
+
+// channel assignments; channels 0..3 are the only ones with event inputs
+#define DMA_CH_CAPTURE_A          0           // logic capture, PORT A IN
+#define DMA_CH_CAPTURE_B          1           // logic capture, PORT B IN
+#define DMA_CH_SCAN_RX            2           // scan chain SPI, SERCOM DATA -> RAM
+#define DMA_CH_SCAN_TX            3           // scan chain SPI, RAM -> SERCOM DATA
+#define DMA_CH_I2C                4           // I2C queue, RAM <-> SERCOM1 DATA, one phase at a time
+#define DMA_CH_CNT                5           // descriptor table size, highest channel used + 1
+
+// called from DMAC_Handler with CHINTFLAG bits of the channel
+typedef void (*dma_callback_t)(uint8_t ch, uint8_t flags);
+
+extern DmacDescriptor       dmaDescriptors[DMA_CH_CNT];
+extern DmacDescriptor       dmaWriteback[DMA_CH_CNT];
+
+void dma_Init(void);
+void dma_setCallback(uint8_t ch, dma_callback_t func);
+void dma_channelConfig(uint8_t ch, uint32_t chctrlb, uint8_t intenset);
+void dma_channelEnable(uint8_t ch);
+void dma_channelDisable(uint8_t ch);
+
+#endif // _DMA_H_
@@ -8,12 +8,31 @@
 #include <stdint-gcc.h>
 
 #define MAX_EEPROM_ADDR       (8 * 1024 - 1)
+#define EEPROM_SIZE           (MAX_EEPROM_ADDR + 1)
+#define EEPROM_MAX_LEN        256         // FRU EEPROM read buffer, MUST be a multiple of 16
+#define EEPROM_READ_CHUNK     128         // bytes per I2C read, max I2CQ_MAX_LEN
+#define EEPROM_PROBE_LEN      16          // bytes compared when picking the bus speed
+#define EEPROM_PAGE_SIZE      32          // 24C64 write page
+#define EEPROM_WRITE_TIMEOUT_MS   20      // max internal write cycle (tWR is 5 msec typ.)
+#define EEPROM_PROGRAM_TIMEOUT_MS 5000    // max wait for the next byte of an image from the host
+#define EEPROM_PROGRAM_LF_MS    20        // wait for the LF of a CRLF command line before the prompt
+
+// FRU EEPROM bus speeds, fastest first; only the EEPROM's own
+// transactions run at them, the INA219s share the bus at standard mode
+#define EEPROM_I2C_FASTPLUS_HZ  1000000
+#define EEPROM_I2C_FAST_HZ      400000
+#define EEPROM_I2C_STD_HZ       100000
 
 // EEPROM data storage struct
 typedef struct {
     uint32_t        sig;                  // unique EEPROMP signature (see #define)
-    uint16_t        status_delay_secs;    // time in secs to delay updating status display
+    uint16_t        status_delay_msec;    // time in msecs between status display refreshes
     uint16_t        pwr_seq_delay_msec;   // time between MAIN and AUX pwr enables
+    uint32_t        scan_clk_hz;          // scan chain SPI clock rate
+    uint8_t         scan_sample_edge;     // SCAN_EDGE_xxx, SCAN_DATA_IN sample point
+    uint8_t         tcrit_trip;           // 1 = TEMP_CRIT drops MAIN_EN/AUX_EN
+    uint16_t        ocp_main_ma;          // MAIN rail trip current, 0 = off
+    uint16_t        ocp_aux_ma;           // AUX rail trip current, 0 = off
     
     // TODO add more data
 
@@ -47,16 +66,6 @@ typedef struct {
     uint8_t     manuf_type_length;
 } prod_hdr_t;
 
-// internal structure used to keep track of FRU section offsets/lengths
-typedef struct {
-  uint16_t        board_area_offset_actual;
-  uint16_t        board_area_length;
-  uint16_t        product_area_offset_actual;
-  uint16_t        internal_area_offset_actual;
-  uint16_t        chassis_area_offset_actual;
-  uint16_t        multirecord_area_offset_actual;
-} eeprom_desc_t;
-
 // see section 13 TYPE/LENGTH BYTE FORMAT
 #define TYPE_LENGTH_MASK        0x3F
 #define GET_TYPE(x)             (x >> 6)
@@ -67,7 +76,9 @@ void EEPROM_Save(void);
 void EEPROM_Read(void);
 void EEPROM_Defaults(void);
 bool EEPROM_InitLocal(void);
-void readEEPROM(uint8_t i2cAddr, uint32_t eeaddress, uint8_t *dest, uint16_t length);
-void writeEEPROMPage(uint8_t i2cAddr, long eeAddress, uint8_t *buffer);
+bool readEEPROM(uint8_t i2cAddr, uint32_t eeaddress, uint8_t *dest, uint16_t length);
+uint32_t eeprom_BusHz(void);
+uint32_t eeprom_ReadTransactions(void);
+bool writeEEPROM(uint8_t i2cAddr, uint32_t eeaddress, const uint8_t *src, uint16_t length);
 
 #endif // _EEPROM_H_
\ No newline at end of file
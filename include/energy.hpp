@@ -0,0 +1,22 @@
+#ifndef _ENERGY_H_
+#define _ENERGY_H_
+//===================================================================
+// energy.hpp
+// Definitions for the rail energy accumulator (see energy.cpp).
+//===================================================================
+#include <stdint-gcc.h>
+#include "power.hpp"
+
+#define ENERGY_GAP_SAMPLES        5           // interval > this many POWER_SAMPLE_MS is counted as a gap
+
+// per rail accumulator, integer only
+typedef struct {
+    int64_t         nJ;                   // energy so far
+    int32_t         remPj;                // < 1000 pJ not yet in nJ, keeps truncation from adding up
+    int32_t         lastUw;               // power of the previous sample, mV * mA
+} energy_rail_t;
+
+void energy_Sample(const power_sample_t *s, uint32_t usec);
+int powerEnergyCmd(int arg);
+
+#endif // _ENERGY_H_
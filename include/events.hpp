@@ -0,0 +1,37 @@
+#ifndef _EVENTS_H_
+#define _EVENTS_H_
+//===================================================================
+// events.hpp
+// Definitions for EIC edge capture of alarm/presence pins (see
+// events.cpp).
+//===================================================================
+#include <stdint-gcc.h>
+
+#define EVT_QUEUE_SIZE          64          // ISR -> main loop queue, MUST be a power of 2
+#define EVT_HISTORY_SIZE        128         // drained events kept for 'events' command
+#define EVT_FLAG_POLLED         0x01        // pin shares an EIC line, edge seen by polling
+
+// raw event pushed by EIC_Handler()
+typedef struct {
+    uint32_t        usec;                 // micros() at edge
+    uint8_t         pinNo;                // Arduino pin #
+    uint8_t         level;                // pin level after edge
+    uint8_t         flags;
+    uint8_t         pad;
+} pin_event_t;
+
+// drained event with 64-bit timestamp
+typedef struct {
+    uint64_t        usec;                 // usecs since boot
+    uint8_t         pinNo;
+    uint8_t         level;
+    uint8_t         flags;
+} pin_event_log_t;
+
+void events_Init(void);
+void events_Service(void);
+uint32_t events_PresenceChanges(void);
+uint32_t events_PinEdges(uint8_t pinNo, uint32_t *usec);
+int eventsCmd(int arg);
+
+#endif // _EVENTS_H_
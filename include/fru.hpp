@@ -0,0 +1,94 @@
+#ifndef _FRU_H_
+#define _FRU_H_
+//===================================================================
+// fru.hpp
+// Definitions for the FRU EEPROM parser and cache (see fru.cpp).
+// Layouts are from the IPMI Platform Management FRU Information
+// Storage Definition v1.0 rev 1.3.
+//===================================================================
+#include <stdint-gcc.h>
+#include "eeprom.hpp"
+
+#define FRU_IMAGE_MAX             1024        // bytes of FRU image kept in RAM
+#define FRU_MAX_FIELDS            12          // per info area, including custom fields
+#define FRU_MAX_RECORDS           16          // multirecord area records
+#define FRU_FORMAT_VERSION        1           // common header format_vers[3:0]
+#define FRU_END_OF_FIELDS         0xC1        // type/length byte ending an info area
+#define FRU_MR_HDR_SIZE           5           // multirecord header bytes
+#define FRU_MR_END_OF_LIST        0x80        // multirecord header byte 1
+#define FRU_OCP_IANA              42623       // OCP enterprise # in OEM (0xC0) records
+#define FRU_OCP_RECORD_VERSION    1           // OCP NIC 3.0 OEM record version decoded by field name
+
+// multirecord types, section 18
+#define FRU_MR_POWER_SUPPLY       0x00
+#define FRU_MR_DC_OUTPUT          0x01
+#define FRU_MR_DC_LOAD            0x02
+#define FRU_MR_MGMT_ACCESS        0x03
+#define FRU_MR_BASE_COMPAT        0x04
+#define FRU_MR_EXT_COMPAT         0x05
+#define FRU_MR_OEM_FIRST          0xC0
+
+// one field of the OCP NIC 3.0 FRU OEM record, little endian, offset
+// into the record data (the IANA # is bytes 0-2)
+typedef struct {
+    uint8_t         offset;
+    uint8_t         size;                 // 1 or 2 bytes
+    const char      *name;
+    const char      *units;
+} fru_ocp_field_t;
+
+// one type/length coded field, data is in the image after the type/length byte
+typedef struct {
+    uint16_t        offset;               // image offset of type/length byte
+    uint8_t         type;                 // GET_TYPE()
+    uint8_t         length;               // data bytes
+} fru_field_t;
+
+// chassis, board or product info area
+typedef struct {
+    uint16_t        offset;               // image offset, 0 = area not present
+    uint16_t        length;               // bytes, including checksum
+    uint8_t         version;
+    uint8_t         langType;             // language code; chassis type for the chassis area
+    bool            cksumOk;
+    bool            truncated;            // area runs past the image read
+    uint8_t         fieldCount;
+    fru_field_t     fields[FRU_MAX_FIELDS];
+} fru_area_t;
+
+typedef struct {
+    uint16_t        offset;               // image offset of record header
+    uint8_t         type;
+    uint8_t         version;
+    uint8_t         length;               // data bytes after the header
+    bool            hdrCksumOk;
+    bool            dataCksumOk;
+} fru_record_t;
+
+// parsed FRU EEPROM, valid until PRSNTB[3:0] changes
+typedef struct {
+    uint8_t         i2cAddr;
+    uint16_t        imageLen;             // bytes read
+    uint16_t        reads;                // I2C read transactions used, see eeprom_ReadTransactions()
+    uint32_t        readUsec;             // time to read and parse
+    uint32_t        busHz;                // I2C speed of the read
+    common_hdr_t    header;
+    bool            hdrCksumOk;
+    uint16_t        internalOffset;       // internal use area, 0 = not present
+    uint16_t        multirecordOffset;
+    uint32_t        mfgMinutes;           // board mfg time, mins since 0:00 1/1/1996
+    fru_area_t      chassis;
+    fru_area_t      board;
+    fru_area_t      product;
+    uint8_t         recordCount;
+    bool            recordsTruncated;     // no end-of-list record within the image
+    fru_record_t    records[FRU_MAX_RECORDS];
+    uint8_t         image[FRU_IMAGE_MAX];
+} fru_info_t;
+
+const fru_info_t *fru_Get(uint8_t i2cAddr, bool *cached);
+void fru_Invalidate(void);
+void fru_FieldText(const fru_info_t *fru, const fru_field_t *f, char *s, uint16_t size);
+void fru_Show(const fru_info_t *fru);
+
+#endif // _FRU_H_
@@ -0,0 +1,81 @@
+#ifndef _I2CQ_H_
+#define _I2CQ_H_
+//===================================================================
+// i2cq.hpp
+// Definitions for the SERCOM1 I2C transaction queue (see i2cq.cpp).
+//===================================================================
+#include <stdint-gcc.h>
+
+#define I2CQ_SERCOM               SERCOM1     // PA16 PAD0 SDA, PA17 PAD1 SCL
+#define I2CQ_STD_HZ               100000
+#define I2CQ_FAST_HZ              400000      // above this the SERCOM runs in Fast-mode Plus
+#define I2CQ_MAX_HZ               1000000
+#define I2CQ_MAX_LEN              255         // ADDR.LEN is 8 bits
+#define I2CQ_DEPTH                8           // queued transactions per priority
+#define I2CQ_TIMEOUT_US           2000        // added to the wire time of each transaction
+
+// i2cq_BusLines() bits, set = line is high
+#define I2CQ_LINE_SDA             0x01
+#define I2CQ_LINE_SCL             0x02
+
+// telemetry is started ahead of anything else waiting
+#define I2CQ_PRIO_TELEMETRY       0
+#define I2CQ_PRIO_NORMAL          1
+#define I2CQ_PRIO_CNT             2
+
+typedef enum {
+    I2CQ_IDLE = 0,                          // never submitted
+    I2CQ_PENDING,                           // queued
+    I2CQ_BUSY,                              // on the bus
+    I2CQ_OK,
+    I2CQ_NACK,                              // address or data byte not ACKed
+    I2CQ_BUSERR,                            // bus error, lost arbitration or DMA error
+    I2CQ_TIMEOUT,
+} I2CQ_STATUS;
+
+struct i2cq_xfer;
+
+// called once a transaction ends, from ISR context; keep it short
+typedef void (*i2cq_callback_t)(struct i2cq_xfer *x);
+
+// one transaction: write txLen bytes, then read rxLen bytes. Either
+// part may be empty; both empty is an address-only probe. Owned by
+// the caller and must not be touched until status is no longer
+// I2CQ_PENDING or I2CQ_BUSY.
+typedef struct i2cq_xfer {
+    uint8_t             addr;               // 7 bit address
+    uint8_t             txLen;
+    uint8_t             rxLen;
+    uint8_t             priority;           // I2CQ_PRIO_xxx
+    const uint8_t       *tx;
+    uint8_t             *rx;
+    uint32_t            hz;                 // bus speed, 0 = I2CQ_STD_HZ
+    i2cq_callback_t     callback;           // NULL = poll status
+    void                *context;           // for the callback
+    volatile I2CQ_STATUS status;
+    uint32_t            usec;               // submit -> done
+} i2cq_xfer_t;
+
+typedef struct {
+    uint32_t        done;                   // transactions ended, any status
+    uint32_t        nacks;
+    uint32_t        errors;
+    uint32_t        timeouts;
+    uint32_t        recoveries;             // 9-clock recoveries run
+    uint32_t        recoverFails;           // ... that left a line low
+    uint32_t        recoverClocks;          // SCL pulses it took, total
+    uint32_t        waitMaxUsec;            // longest submit -> start
+    uint32_t        startTime;              // millis() at reset
+} i2cq_stats_t;
+
+void i2cq_Init(void);
+bool i2cq_Submit(i2cq_xfer_t *x);
+void i2cq_Service(void);
+bool i2cq_Busy(void);
+I2CQ_STATUS i2cq_Transfer(uint8_t addr, const uint8_t *tx, uint8_t txLen, uint8_t *rx, uint8_t rxLen, uint32_t hz);
+uint8_t i2cq_BusLines(void);
+bool i2cq_Recover(void);
+void i2cq_getStats(i2cq_stats_t *stats);
+void i2cq_resetStats(void);
+
+#endif // _I2CQ_H_
@@ -0,0 +1,35 @@
+#ifndef _INRUSH_H_
+#define _INRUSH_H_
+//===================================================================
+// inrush.hpp
+// Definitions for the power-up inrush capture (see inrush.cpp).
+//===================================================================
+#include <stdint-gcc.h>
+#include "power.hpp"
+
+#define INRUSH_SAMPLES            768         // 6 bytes each
+#define INRUSH_TICK_US            64          // sample time unit, 16 bits covers 4.19 secs
+#define INRUSH_PRE_MS             5           // baseline before MAIN_EN
+#define INRUSH_BURST_MS           20          // every read stored for this long after each enable ...
+#define INRUSH_BURST_SAMPLES      128         // ... up to this many (a read pair takes about 160 usec)
+#define INRUSH_SLOW_US            1000        // otherwise one sample stored per this many usec or more,
+                                              // spread so the whole sequence fits what bursts leave
+#define INRUSH_PWRGOOD_MS         1000        // wait this long after AUX_EN for NIC_PWR_GOOD
+#define INRUSH_POST_MS            100         // keep capturing this long after NIC_PWR_GOOD
+#define INRUSH_FINAL_MS           10          // final value is the mean of this much at the end
+#define INRUSH_SETTLE_PCT         10          // settled = within this % of the final value ...
+#define INRUSH_SETTLE_MIN_MA      20          // ... or this many mA, whichever is larger
+
+// INA219 setup during the capture: shunt only, single 9 bit conversions
+#define INRUSH_INA219_CONFIG      (INA219_CFG_PGA_320MV | INA219_CFG_SADC(INA219_ADC_9BIT) | INA219_CFG_MODE_SHUNT)
+
+// one stored sample, both rails read back to back
+typedef struct {
+    uint16_t        tick;                 // INRUSH_TICK_US units from the start of the capture
+    int16_t         currentMa[POWER_RAIL_CNT];
+} inrush_sample_t;
+
+bool inrush_PowerUp(bool stream);
+int powerInrushCmd(int arg);
+
+#endif // _INRUSH_H_
@@ -0,0 +1,83 @@
+#ifndef _PINS_H_
+#define _PINS_H_
+//===================================================================
+// pins.hpp
+// Compile-time Arduino pin number to SAMD21 port group/bit map and
+// the PORT register snapshot used to sample all inputs at once.
+//===================================================================
+#include <Arduino.h>
+
+// port group in bit 5, bit number in bits 4..0
+#define PORTBIT_A(n)            ((uint8_t) (n))
+#define PORTBIT_B(n)            ((uint8_t) (0x20 | (n)))
+#define PORTBIT_GROUP(pb)       ((pb) >> 5)
+#define PORTBIT_BIT(pb)         ((pb) & 0x1F)
+
+// NOTE: This MUST match g_APinDescription[] in platformio/variants/ttf/variant.cpp
+// (see pinMapVerify() which checks it at boot).  Index is the Arduino pin number.
+constexpr uint8_t       pinPortBit[PINS_COUNT] = {
+    PORTBIT_A(22), PORTBIT_A(23), PORTBIT_A(10), PORTBIT_A(11),     //  0..3
+    PORTBIT_B(10), PORTBIT_B(11), PORTBIT_A(20), PORTBIT_A(21),     //  4..7
+    PORTBIT_A(8),  PORTBIT_A(9),  PORTBIT_A(19), PORTBIT_A(16),     //  8..11
+    PORTBIT_A(17), PORTBIT_B(23), PORTBIT_B(22), PORTBIT_A(2),      // 12..15
+    PORTBIT_B(2),  PORTBIT_B(8),  PORTBIT_B(9),  PORTBIT_A(5),      // 16..19
+    PORTBIT_A(6),  PORTBIT_A(7),  PORTBIT_A(24), PORTBIT_A(25),     // 20..23
+    PORTBIT_A(18), PORTBIT_A(3),  PORTBIT_A(12), PORTBIT_A(13),     // 24..27
+    PORTBIT_A(14), PORTBIT_A(15), PORTBIT_A(27), PORTBIT_A(28),     // 28..31
+    PORTBIT_A(4),  PORTBIT_B(3),  PORTBIT_A(0),  PORTBIT_A(1),      // 32..35
+};
+
+constexpr uint8_t pinGroup(uint8_t pinNo)   { return(PORTBIT_GROUP(pinPortBit[pinNo])); }
+constexpr uint32_t pinMask(uint8_t pinNo)   { return(1ul << PORTBIT_BIT(pinPortBit[pinNo])); }
+
+#define EIC_LINE_CNT            16
+#define EIC_LINE_NONE           0xFF
+
+/**
+  * @name   eicLineOf
+  * @brief  EIC EXTINT line of a pin (SAMD21 datasheet table 7-1)
+  * @param  pinNo  Arduino pin #
+  * @retval uint8_t  line 0..15 or EIC_LINE_NONE (PA08 is NMI)
+  */
+constexpr uint8_t eicLineOf(uint8_t pinNo)
+{
+    return((pinPortBit[pinNo] == PORTBIT_A(8))  ? EIC_LINE_NONE :
+           (pinPortBit[pinNo] == PORTBIT_A(27)) ? 15 :
+           (pinPortBit[pinNo] == PORTBIT_A(28)) ? 8 :
+           (pinPortBit[pinNo] == PORTBIT_B(30)) ? 14 :
+           (pinPortBit[pinNo] == PORTBIT_B(31)) ? 15 :
+           (PORTBIT_BIT(pinPortBit[pinNo]) & 0xF));
+}
+
+// both PORT groups' IN registers sampled back to back
+typedef struct {
+    uint32_t        in[2];
+} pin_snapshot_t;
+
+/**
+  * @name   pinSnapshotRead
+  * @brief  sample PORT A and B inputs
+  * @param  snap  snapshot to fill
+  * @retval None
+  */
+inline void pinSnapshotRead(pin_snapshot_t *snap)
+{
+    snap->in[0] = PORT->Group[0].IN.reg;
+    snap->in[1] = PORT->Group[1].IN.reg;
+}
+
+/**
+  * @name   pinSnapshotGet
+  * @brief  decode one pin from a snapshot
+  * @param  snap  snapshot
+  * @param  pinNo  Arduino pin number
+  * @retval uint8_t  0 or 1
+  */
+inline uint8_t pinSnapshotGet(const pin_snapshot_t *snap, uint8_t pinNo)
+{
+    return((snap->in[pinGroup(pinNo)] & pinMask(pinNo)) ? 1 : 0);
+}
+
+bool pinMapVerify(void);
+
+#endif // _PINS_H_
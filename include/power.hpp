@@ -0,0 +1,75 @@
+#ifndef _POWER_H_
+#define _POWER_H_
+//===================================================================
+// power.hpp
+// Definitions for the INA219 rail power telemetry (see power.cpp).
+//===================================================================
+#include <stdint-gcc.h>
+
+#define POWER_RAIL_CNT            2
+#define POWER_RAIL_MAIN           0           // U2, 12V MAIN
+#define POWER_RAIL_AUX            1           // U3, 3.3V AUX
+
+#define POWER_SAMPLE_MS           20          // > shunt + bus conversion time at POWER_ADC_AVG
+#define POWER_RING_SIZE           128         // samples kept for 'power stats', MUST be a power of 2
+
+// INA219 registers
+#define INA219_REG_CONFIG         0
+#define INA219_REG_SHUNT          1           // signed, 10 uV/LSB
+#define INA219_REG_BUS            2           // bits 15..3, 4 mV/LSB
+
+// INA219 CONFIG fields
+#define INA219_CFG_RESET          0x8000
+#define INA219_CFG_BRNG_32V       0x2000
+#define INA219_CFG_PGA_160MV      0x1000      // /4
+#define INA219_CFG_PGA_320MV      0x1800      // /8
+#define INA219_CFG_BADC(x)        ((x) << 7)
+#define INA219_CFG_SADC(x)        ((x) << 3)
+#define INA219_CFG_MODE_CONT      0x0007      // shunt and bus, continuous
+#define INA219_CFG_MODE_SHUNT     0x0005      // shunt only, continuous
+#define INA219_ADC_9BIT           0x0         // 84 usec
+#define INA219_ADC_12BIT          0x3         // 532 usec
+#define INA219_ADC_AVG16          0xC         // 16 x 12 bit, 8.51 msec
+#define INA219_BUS_OVF            0x0001      // math overflow flag in the bus register
+#define INA219_BUS_SHIFT          3
+#define INA219_BUS_MV_LSB         4
+#define INA219_SHUNT_UV_LSB       10
+
+#define POWER_ADC_AVG             INA219_ADC_AVG16
+
+// one reading of both rails
+typedef struct {
+    uint32_t        msec;                 // millis() when the reads were queued
+    uint16_t        busMv[POWER_RAIL_CNT];
+    int16_t         currentMa[POWER_RAIL_CNT];
+} power_sample_t;
+
+// min/max/sum of one quantity
+typedef struct {
+    int32_t         min;
+    int32_t         max;
+    int64_t         sum;
+} power_stat_t;
+
+// per rail totals since the last reset
+typedef struct {
+    power_stat_t    busMv;
+    power_stat_t    currentMa;
+    power_stat_t    powerMw;
+    uint32_t        samples;
+    uint32_t        errors;               // I2C transactions that failed
+    uint32_t        overflows;            // readings with the OVF flag set
+} power_rail_stats_t;
+
+void monitorsInit(void);
+void power_Service(void);
+bool power_Present(uint8_t rail);
+uint8_t power_RailAddr(uint8_t rail);
+const char *power_RailName(uint8_t rail);
+int16_t power_ShuntToMa(uint8_t rail, int16_t raw);
+int16_t power_MaToShunt(uint8_t rail, int16_t ma);
+void power_Suspend(void);
+void power_Resume(void);
+int powerStatsCmd(int arg);
+
+#endif // _POWER_H_
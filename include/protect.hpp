@@ -0,0 +1,44 @@
+#ifndef _PROTECT_H_
+#define _PROTECT_H_
+//===================================================================
+// protect.hpp
+// Definitions for the over-current / TEMP_CRIT power trip (see
+// protect.cpp).
+//===================================================================
+#include <stdint-gcc.h>
+#include "power.hpp"
+
+#define PROTECT_POLL_MS           1           // shunt reads queued from SysTick this often
+#define PROTECT_MAX_MA            15000       // limit must stay under the PGA /4 range (16 A with 10 mOhm)
+
+// defaults for 'set ocpmain', 'set ocpaux' and 'set tcrit'
+#define PROTECT_MAIN_MA_DEFAULT   8000        // 12V MAIN
+#define PROTECT_AUX_MA_DEFAULT    1500        // 3.3V AUX
+#define PROTECT_TCRIT_DEFAULT     1
+
+typedef enum {
+    PROTECT_CAUSE_NONE = 0,
+    PROTECT_CAUSE_OCP_MAIN,                 // MAIN rail over ocpmain
+    PROTECT_CAUSE_OCP_AUX,                  // AUX rail over ocpaux
+    PROTECT_CAUSE_TCRIT,                    // TEMP_CRIT edge (EIC)
+    PROTECT_CAUSE_TCRIT_LEVEL,              // TEMP_CRIT already asserted at SysTick check
+} PROTECT_CAUSE;
+
+// one trip, filled in from ISR context
+typedef struct {
+    uint8_t         cause;                // PROTECT_CAUSE_xxx
+    int16_t         currentMa;            // over-current: reading that tripped
+    uint32_t        msec;                 // millis() of the trip
+    uint32_t        latencyUs;            // detection -> enables low
+    uint32_t        readUs;               // over-current: shunt read queued -> enables low
+} protect_trip_t;
+
+void protect_Init(void);
+void protect_Configure(void);
+void protect_Service(void);
+bool protect_Tripped(void);
+void protect_Tick(void);
+void protect_TempCritIsr(uint32_t usec);
+int powerProtectCmd(int arg);
+
+#endif // _PROTECT_H_
@@ -0,0 +1,70 @@
+#ifndef _SCAN_H_
+#define _SCAN_H_
+//===================================================================
+// scan.hpp
+// Definitions for the SERCOM SPI scan chain engine (see scan.cpp).
+//===================================================================
+#include <stdint-gcc.h>
+
+#define SCAN_SERCOM               SERCOM0     // PA08 PAD0 MOSI, PA10 PAD2 MISO, PA11 PAD3 SCK
+#define SCAN_CLK_DEFAULT_HZ       100000
+#define SCAN_CLK_MIN_HZ           93750       // GCLK0 / (2 * 256)
+#define SCAN_CLK_MAX_HZ           12000000
+#define SCAN_LD_PULSE_USEC        200         // SCAN_LD_N low time before shifting
+#define SCAN_MAX_BYTES            16
+
+// SCAN_DATA_IN sample point; falling = SPI mode 2, rising = SPI mode 3
+#define SCAN_EDGE_FALLING         0
+#define SCAN_EDGE_RISING          1
+
+// chain layout: byte 0 holds the card status bits, then SCAN_PORT_BITS
+// per port starting at bit SCAN_PORT_BASE (byte N bit k = bit 8N+k)
+#define SCAN_PORT_BASE            8
+#define SCAN_PORT_BITS            3           // LINK_SPDA, LINK_SPDB, ACT
+#define SCAN_MAX_PORTS            8
+
+typedef enum {
+    SCAN_IDLE = 0,                          // no transfer started yet
+    SCAN_BUSY,                              // DMA shifting the chain
+    SCAN_DONE,
+    SCAN_ERROR,                             // DMA error or timeout
+} SCAN_STATE;
+
+// called when a transfer ends; rx is valid until the next one starts
+typedef void (*scan_cb_t)(SCAN_STATE state, const uint8_t *rx, uint16_t len);
+
+// chain length/port count selected by SCAN_VER[1:0]
+typedef struct {
+    uint8_t         scanVer;
+    uint8_t         bytes;
+    uint8_t         ports;
+    const char      *desc;
+} scan_chain_t;
+
+void scan_Init(void);
+uint32_t scan_SetClock(uint32_t hz);
+uint32_t scan_GetClock(void);
+void scan_SetSampleEdge(uint8_t edge);
+uint8_t scan_GetSampleEdge(void);
+bool scan_Start(const uint8_t *tx, uint16_t len, scan_cb_t callback);
+bool scan_StartChain(uint16_t len, scan_cb_t callback);
+SCAN_STATE scan_Poll(uint8_t *rx);
+bool scan_Transfer(const uint8_t *tx, uint8_t *rx, uint16_t len);
+bool scan_Capture(uint32_t txWord, uint32_t *rxWord);
+bool scan_CaptureChain(uint8_t *rx, uint16_t len);
+const scan_chain_t *scan_GetChain(void);
+uint8_t scan_SetLength(uint8_t bytes);
+
+/**
+  * @name   scan_GetBit
+  * @brief  get one bit of a captured chain
+  * @param  data  chain bytes from scan_CaptureChain()
+  * @param  bit  bit # (byte N bit k = 8N+k)
+  * @retval uint8_t  0 or 1
+  */
+inline uint8_t scan_GetBit(const uint8_t *data, uint16_t bit)
+{
+    return((data[bit >> 3] >> (bit & 7)) & 1);
+}
+
+#endif // _SCAN_H_
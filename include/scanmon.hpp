@@ -0,0 +1,25 @@
+#ifndef _SCANMON_H_
+#define _SCANMON_H_
+//===================================================================
+// scanmon.hpp
+// Definitions for the background scan chain monitor (see
+// scanmon.cpp).
+//===================================================================
+#include <stdint-gcc.h>
+#include "scan.hpp"
+
+#define SCANMON_DEFAULT_HZ        10
+#define SCANMON_MAX_HZ            1000
+#define SCANMON_LOG_SIZE          32          // change records kept for 'scan mon show'
+
+// one change record: capture time and bits that changed
+typedef struct {
+    uint32_t        msec;                 // millis() at capture
+    uint8_t         xorMask[SCAN_MAX_BYTES];
+} scanmon_rec_t;
+
+void scanmon_Service(void);
+bool scanmon_Running(void);
+int scanmonCmd(int arg);
+
+#endif // _SCANMON_H_
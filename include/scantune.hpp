@@ -0,0 +1,15 @@
+#ifndef _SCANTUNE_H_
+#define _SCANTUNE_H_
+//===================================================================
+// scantune.hpp
+// Definitions for the scan clock rate/sample edge sweep (see
+// scantune.cpp).
+//===================================================================
+#include <stdint-gcc.h>
+
+#define SCANTUNE_DEFAULT_PASSES   20          // captures per rate/edge step
+#define SCANTUNE_MAX_PASSES       1000
+
+int scantuneCmd(int arg);
+
+#endif // _SCANTUNE_H_
@@ -0,0 +1,43 @@
+#ifndef _TIMERS_H_
+#define _TIMERS_H_
+//===================================================================
+// timers.hpp
+// Definitions for the TC5 bit-bang scan chain path (see timers.cpp).
+//===================================================================
+#include <stdint-gcc.h>
+
+#define TIMERS_SCAN_BITS          32
+#define TIMERS_SCAN_TIMEOUT_MS    100         // LD + 32 clocks take ~16 ms at 4096 ticks/sec
+
+typedef enum {
+    TIMERS_SCAN_IDLE = 0,                   // no capture started yet
+    TIMERS_SCAN_BUSY,                       // TC5 clocking the chain
+    TIMERS_SCAN_DONE,
+    TIMERS_SCAN_TIMEOUT,
+} TIMERS_SCAN_STATE;
+
+// called when a capture ends; data has the first bit shifted in at bit 31
+typedef void (*timers_scan_cb_t)(TIMERS_SCAN_STATE state, uint32_t data);
+
+// TC5 ISR cost and jitter, in CPU cycles
+typedef struct {
+    uint32_t        calls;                // TC5 interrupts since reset
+    uint32_t        idleCalls;            // interrupts with no capture running, should stay 0
+    uint32_t        captures;
+    uint32_t        timeouts;
+    uint32_t        cyclesTotal;          // ISR body
+    uint32_t        cyclesMax;
+    uint32_t        latencyTotal;         // compare match -> ISR entry
+    uint32_t        latencyMax;
+    uint32_t        startTime;            // millis() at reset
+} timers_stats_t;
+
+void timers_Init(void);
+bool timers_scanStart(timers_scan_cb_t callback);
+TIMERS_SCAN_STATE timers_scanPoll(uint32_t *data);
+bool timers_scanChainCapture(void);
+bool timers_Running(void);
+void timers_getStats(timers_stats_t *stats);
+void timers_resetStats(void);
+
+#endif // _TIMERS_H_
@@ -0,0 +1,153 @@
+#ifndef _TXFMT_H_
+#define _TXFMT_H_
+//===================================================================
+// txfmt.hpp
+// Integer-only output formatting into the console TX ring (see
+// txfmt.cpp).  Fields are typed values built with txDec(), txFixed(),
+// txHex() and txStr(); widths and decimal places are template
+// arguments, so a bad field or a non-integer value is a compile error
+// and there is no format string to get out of step with its arguments.
+//
+//   TxLine  line;
+//   line << "P" << txDec(port) << ' ' << txFixed<1, 8>(rate10) << "/s";
+//   line.end();
+//===================================================================
+#include <stdint-gcc.h>
+#include <type_traits>
+#include "main.hpp"
+
+#define TXFMT_LINE_MAX            (OUTBFR_SIZE + 2)   // text + CR/LF, same as the outBfr[] it replaces
+#define TXFMT_WIDTH_MAX           20
+
+static_assert(TXFMT_LINE_MAX <= 255, "TxLine length is a uint8_t");
+
+// signed or unsigned decimal, right aligned in W columns (0 = as needed);
+// P > 0 prints the value as v / 10^P with P decimals
+template <uint8_t P, uint8_t W>
+struct tx_dec_t {
+    static_assert(P <= 9, "txFixed: at most 9 decimal places");
+    static_assert(W <= TXFMT_WIDTH_MAX, "txDec/txFixed: field width too large");
+    uint32_t        mag;
+    bool            neg;
+};
+
+// upper case hex, zero padded to D digits
+template <uint8_t D>
+struct tx_hex_t {
+    static_assert(D >= 1 && D <= 8, "txHex: 1 to 8 digits");
+    uint32_t        v;
+};
+
+// string left aligned, padded to W columns
+template <uint8_t W>
+struct tx_str_t {
+    static_assert(W <= TXFMT_WIDTH_MAX, "txStr: field width too large");
+    const char      *s;
+};
+
+template <uint8_t P, uint8_t W, typename T>
+constexpr tx_dec_t<P, W> txMakeDec(T v)
+{
+    static_assert(std::is_integral<T>::value && sizeof(T) <= 4, "txDec/txFixed: value must be an integer of 32 bits or less");
+    return(tx_dec_t<P, W>{(std::is_signed<T>::value && v < 0) ? 0u - (uint32_t) v : (uint32_t) v,
+                          std::is_signed<T>::value && v < 0});
+}
+
+template <uint8_t W = 0, typename T>
+constexpr tx_dec_t<0, W> txDec(T v)
+{
+    return(txMakeDec<0, W>(v));
+}
+
+template <uint8_t P, uint8_t W = 0, typename T>
+constexpr tx_dec_t<P, W> txFixed(T v)
+{
+    static_assert(P >= 1, "txFixed: use txDec for no decimal places");
+    return(txMakeDec<P, W>(v));
+}
+
+template <uint8_t D, typename T>
+constexpr tx_hex_t<D> txHex(T v)
+{
+    static_assert(std::is_integral<T>::value && std::is_unsigned<T>::value && sizeof(T) <= 4,
+                  "txHex: value must be an unsigned integer of 32 bits or less");
+    return(tx_hex_t<D>{v});
+}
+
+template <uint8_t W>
+constexpr tx_str_t<W> txStr(const char *s)
+{
+    return(tx_str_t<W>{s});
+}
+
+// one line of output, formatted in place in the console TX ring when it
+// has room without wrapping, else in bfr[]; text past TXFMT_LINE_MAX - 2
+// is dropped. No other console output may be written between creating
+// a TxLine and its end() or send().
+class TxLine {
+public:
+    TxLine(void);
+
+    TxLine &operator<<(const char *s)
+    {
+        putStr(s, 0);
+        return(*this);
+    }
+
+    TxLine &operator<<(char *s)
+    {
+        putStr(s, 0);
+        return(*this);
+    }
+
+    TxLine &operator<<(char c)
+    {
+        if ( p == NULL )
+            open();
+        if ( len < TXFMT_LINE_MAX - 2 )
+            p[len++] = c;
+        return(*this);
+    }
+
+    template <uint8_t P, uint8_t W>
+    TxLine &operator<<(const tx_dec_t<P, W> &f)
+    {
+        putDec(f.mag, f.neg, P, W);
+        return(*this);
+    }
+
+    template <uint8_t D>
+    TxLine &operator<<(const tx_hex_t<D> &f)
+    {
+        putHex(f.v, D);
+        return(*this);
+    }
+
+    template <uint8_t W>
+    TxLine &operator<<(const tx_str_t<W> &f)
+    {
+        putStr(f.s, W);
+        return(*this);
+    }
+
+    // fields are only accepted through the wrappers above
+    template <typename T>
+    TxLine &operator<<(const T &) = delete;
+
+    void cursor(uint8_t row, uint8_t col);
+    void end(void);
+    void send(void);
+
+private:
+    void open(void);
+    void putDec(uint32_t mag, bool neg, uint8_t places, uint8_t width);
+    void putHex(uint32_t v, uint8_t digits);
+    void putStr(const char *s, uint8_t width);
+
+    char            *p;                   // ring space, bfr or NULL until the first field
+    uint8_t         len;
+    bool            inRing;
+    char            bfr[TXFMT_LINE_MAX];
+};
+
+#endif // _TXFMT_H_
@@ -32,6 +32,13 @@
 #warning Using expected USBCore.cpp with OCP modifications
 // end modification
 
+// R Lewis: console output ring buffer is drained from the USB ISR
+#include "console.hpp"
+
+// CDC is the only PluggableUSB module so its endpoints are allocated
+// from 1: ACM = 1, OUT = 2, IN = 3 (CDC_ENDPOINT_IN is class-relative)
+#define CONSOLE_EP_IN		3
+
 #include "api/PluggableUSB.h"
 
 #include <stdlib.h>
@@ -456,6 +463,12 @@ void USBDeviceClass::initEP(uint32_t ep, uint32_t config)
 
 void USBDeviceClass::flush(uint32_t ep)
 {
+	// R Lewis: flush on the console endpoint marks the end of a response
+	if (ep == CONSOLE_EP_IN) {
+		console_endResponse();
+		return;
+	}
+
 	if (available(ep)) {
 		// RAM buffer is full, we can send data (IN)
 		usbd.epBank1SetReady(ep);
@@ -627,6 +640,12 @@ uint32_t USBDeviceClass::send(uint32_t ep, const void *data, uint32_t len)
 	if (len > 16384)
 		return -1;
 
+	// R Lewis: console output is coalesced into full packets by console.cpp
+	if (ep == CONSOLE_EP_IN) {
+		console_write((const char *)data, len);
+		return len;
+	}
+
 #ifdef PIN_LED_TXL
 	if (txLEDPulse == 0)
 		digitalWrite(PIN_LED_TXL, LOW);
@@ -724,6 +743,48 @@ uint32_t USBDeviceClass::sendControl(const void* _data, uint32_t len)
 	return length;
 }
 
+// R Lewis: hand the next packet of console output (see console.cpp) to
+// the CDC IN endpoint if the bank is free.  Called at the end of every
+// USB interrupt (SOF every 1 ms and IN transfer complete) so output
+// drains back to back without the caller waiting.  console_txPop()
+// decides when a short packet or a ZLP is due, so AUTO_ZLP is not used.
+static void consoleTxService(void)
+{
+	uint32_t ep = CONSOLE_EP_IN;
+	uint32_t length;
+	bool zlp;
+
+	if (!_usbConfiguration)
+		return;
+
+	// previous packet not yet taken by the host
+	if (usbd.epBank1IsReady(ep))
+		return;
+
+	length = console_txPop(udd_ep_in_cache_buffer[ep], EPX_SIZE, &zlp);
+	if (length == 0 && !zlp)
+		return;
+
+	usbd.epBank1DisableAutoZLP(ep);
+	usbd.epBank1SetAddress(ep, &udd_ep_in_cache_buffer[ep]);
+	usbd.epBank1SetByteCount(ep, length);
+
+	// Clear the transfer complete flag, interrupt on completion refills the bank
+	usbd.epBank1AckTransferComplete(ep);
+	usbd.epBank1EnableTransferComplete(ep);
+
+	// RAM buffer is full, we can send data (IN)
+	usbd.epBank1SetReady(ep);
+}
+
+// R Lewis: thread context entry to consoleTxService()
+void console_txKick(void)
+{
+	NVIC_DisableIRQ((IRQn_Type) USB_IRQn);
+	consoleTxService();
+	NVIC_EnableIRQ((IRQn_Type) USB_IRQn);
+}
+
 void USBDeviceClass::sendZlp(uint32_t ep)
 {
 	// Set the byte count as zero
@@ -862,6 +923,9 @@ void USBDeviceClass::ISRHandler()
 	{
 		usbd.ackStartOfFrameInterrupt();
 
+		// R Lewis: console partial packet idle timer
+		console_txTick();
+
 		// check whether the one-shot period has elapsed.  if so, turn off the LED
 #ifdef PIN_LED_TXL
 		if (txLEDPulse > 0) {
@@ -937,6 +1001,9 @@ void USBDeviceClass::ISRHandler()
 			}
 		}
 	}
+
+	// R Lewis: refill CDC IN bank from console ring buffer
+	consoleTxService();
 }
 
 // PluggableUSB contructor
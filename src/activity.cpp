@@ -0,0 +1,234 @@
+//===================================================================
+// activity.cpp
+// Hardware activity counters for the P1/P3 link ACT LEDs.  Each LED
+// pin drives an EIC line (level sense, asserted low) whose event is
+// routed through EVSYS twice:
+//   - asynchronous path to a TCC counting prescaled clocks while the
+//     event is active -> time the LED was on (duty cycle)
+//   - resynchronized rising-edge path to a counter -> LED assertions
+// Counting needs no CPU time; activity_Service() only reads the
+// counters once per ACT_INTERVAL_MS.
+//
+//   port  pin            EIC   on-time   assertions
+//   P1    P1_LED_ACT_N   7     TCC0      TC4
+//   P3    P3_LED_ACT_N   6     TCC1      TCC2
+//===================================================================
+#include <Arduino.h>
+#include "main.hpp"
+#include "pins.hpp"
+#include "activity.hpp"
+
+#define TCC_DUTY_MASK           0xFFFFFF    // TCC0/TCC1 are 24 bit
+#define EDGE_MASK               0xFFFF      // TC4 & TCC2 are 16 bit
+
+static const uint8_t        actPins[ACT_PORT_CNT] = {P1_LED_ACT_N, P3_LED_ACT_N};
+static Tcc * const          dutyTcc[ACT_PORT_CNT] = {TCC0, TCC1};
+
+static uint32_t             lastTicks[ACT_PORT_CNT];
+static uint32_t             lastEdges[ACT_PORT_CNT];
+static uint32_t             lastTime;
+static uint32_t             intervals = 0;
+static activity_port_t      results[ACT_PORT_CNT];
+
+/**
+  * @name   tccRead
+  * @brief  read TCC counter
+  * @param  tcc  TCC instance
+  * @retval uint32_t  COUNT
+  */
+static uint32_t tccRead(Tcc *tcc)
+{
+    tcc->CTRLBSET.reg = TCC_CTRLBSET_CMD_READSYNC;
+    while (tcc->SYNCBUSY.bit.CTRLB);
+    while (tcc->SYNCBUSY.bit.COUNT);
+    return(tcc->COUNT.reg);
+}
+
+/**
+  * @name   readEdges
+  * @brief  read assertion counter of a port
+  * @param  port  0 = P1, 1 = P3
+  * @retval uint32_t  16-bit count
+  */
+static uint32_t readEdges(uint8_t port)
+{
+    if ( port == 0 )
+    {
+        TC4->COUNT16.READREQ.reg = TC_READREQ_RREQ | TC_READREQ_ADDR(TC_COUNT16_COUNT_OFFSET);
+        while (TC4->COUNT16.STATUS.reg & TC_STATUS_SYNCBUSY);
+        return(TC4->COUNT16.COUNT.reg);
+    }
+
+    return(tccRead(TCC2) & EDGE_MASK);
+}
+
+/**
+  * @name   tccStart
+  * @brief  reset TCC and count on event input 0
+  * @param  tcc  TCC instance
+  * @param  evact  TCC_EVCTRL_EVACT0_xxx
+  * @param  prescaler  TCC_CTRLA_PRESCALER_xxx
+  * @retval None
+  */
+static void tccStart(Tcc *tcc, uint32_t evact, uint32_t prescaler)
+{
+    tcc->CTRLA.reg = TCC_CTRLA_SWRST;
+    while (tcc->SYNCBUSY.bit.SWRST);
+
+    tcc->EVCTRL.reg = TCC_EVCTRL_TCEI0 | evact;
+    tcc->CTRLA.reg = prescaler | TCC_CTRLA_ENABLE;
+    while (tcc->SYNCBUSY.bit.ENABLE);
+}
+
+/**
+  * @name   evsysRoute
+  * @brief  connect EIC line event to a peripheral event user
+  * @param  ch  EVSYS channel
+  * @param  line  EIC line
+  * @param  user  EVSYS_ID_USER_xxx
+  * @param  async  true = level (asynchronous path), false = rising edge pulses
+  * @retval None
+  */
+static void evsysRoute(uint8_t ch, uint8_t line, uint8_t user, bool async)
+{
+    if ( async == false )
+    {
+        GCLK->CLKCTRL.reg = (uint16_t) (GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID(GCM_EVSYS_CHANNEL_0 + ch));
+        while (GCLK->STATUS.bit.SYNCBUSY);
+    }
+
+    EVSYS->USER.reg = (uint16_t) (EVSYS_USER_CHANNEL(ch + 1) | EVSYS_USER_USER(user));
+    EVSYS->CHANNEL.reg = EVSYS_CHANNEL_CHANNEL(ch) | EVSYS_CHANNEL_EVGEN(EVSYS_ID_GEN_EIC_EXTINT_0 + line) |
+                         (async ? (EVSYS_CHANNEL_PATH_ASYNCHRONOUS | EVSYS_CHANNEL_EDGSEL_NO_EVT_OUTPUT) :
+                                  (EVSYS_CHANNEL_PATH_RESYNCHRONIZED | EVSYS_CHANNEL_EDGSEL_RISING_EDGE));
+}
+
+/**
+  * @name   activity_Init
+  * @brief  route ACT LED pins through EIC/EVSYS to the counters
+  * @param  None
+  * @retval None
+  * @note   call after events_Init(), which clocks and enables the EIC
+  */
+void activity_Init(void)
+{
+    PM->APBCMASK.reg |= PM_APBCMASK_EVSYS | PM_APBCMASK_TCC0 | PM_APBCMASK_TCC1 | PM_APBCMASK_TCC2 | PM_APBCMASK_TC4;
+
+    GCLK->CLKCTRL.reg = (uint16_t) (GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID(GCM_TCC0_TCC1));
+    while (GCLK->STATUS.bit.SYNCBUSY);
+    GCLK->CLKCTRL.reg = (uint16_t) (GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID(GCM_TCC2_TC3));
+    while (GCLK->STATUS.bit.SYNCBUSY);
+    GCLK->CLKCTRL.reg = (uint16_t) (GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID(GCM_TC4_TC5));
+    while (GCLK->STATUS.bit.SYNCBUSY);
+
+    // CONFIG/EVCTRL can only be written with the EIC disabled
+    EIC->CTRL.bit.ENABLE = 0;
+    while (EIC->STATUS.bit.SYNCBUSY);
+
+    for ( uint8_t port = 0; port < ACT_PORT_CNT; port++ )
+    {
+        uint8_t     pinNo = actPins[port];
+        uint8_t     line = eicLineOf(pinNo);
+        uint8_t     group = pinGroup(pinNo);
+        uint8_t     bit = PORTBIT_BIT(pinPortBit[pinNo]);
+
+        // peripheral function A (EIC), input buffer stays on so PORT IN still works
+        if ( bit & 1 )
+            PORT->Group[group].PMUX[bit >> 1].reg &= ~PORT_PMUX_PMUXO_Msk;
+        else
+            PORT->Group[group].PMUX[bit >> 1].reg &= ~PORT_PMUX_PMUXE_Msk;
+        PORT->Group[group].PINCFG[bit].reg |= (PORT_PINCFG_PMUXEN | PORT_PINCFG_INEN);
+
+        // LED on = pin low; level sense so the event is active while it's on
+        EIC->CONFIG[line >> 3].reg &= ~(0xFul << ((line & 7) * 4));
+        EIC->CONFIG[line >> 3].reg |= ((EIC_CONFIG_SENSE0_LOW_Val | EIC_CONFIG_FILTEN0) << ((line & 7) * 4));
+        EIC->EVCTRL.reg |= (1ul << line);
+    }
+
+    EIC->CTRL.bit.ENABLE = 1;
+    while (EIC->STATUS.bit.SYNCBUSY);
+
+    // P1: on-time in TCC0, assertions in TC4
+    tccStart(TCC0, TCC_EVCTRL_EVACT0_COUNT, TCC_CTRLA_PRESCALER_DIV1024);
+    evsysRoute(ACT_EVSYS_CH, eicLineOf(P1_LED_ACT_N), EVSYS_ID_USER_TCC0_EV_0, true);
+
+    TC4->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+    while (TC4->COUNT16.STATUS.reg & TC_STATUS_SYNCBUSY);
+    while (TC4->COUNT16.CTRLA.bit.SWRST);
+    TC4->COUNT16.EVCTRL.reg = TC_EVCTRL_TCEI | TC_EVCTRL_EVACT_COUNT;
+    TC4->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_ENABLE;
+    while (TC4->COUNT16.STATUS.reg & TC_STATUS_SYNCBUSY);
+    evsysRoute(ACT_EVSYS_CH + 1, eicLineOf(P1_LED_ACT_N), EVSYS_ID_USER_TC4_EVU, false);
+
+    // P3: on-time in TCC1, assertions in TCC2
+    tccStart(TCC1, TCC_EVCTRL_EVACT0_COUNT, TCC_CTRLA_PRESCALER_DIV1024);
+    evsysRoute(ACT_EVSYS_CH + 2, eicLineOf(P3_LED_ACT_N), EVSYS_ID_USER_TCC1_EV_0, true);
+
+    tccStart(TCC2, TCC_EVCTRL_EVACT0_COUNTEV, TCC_CTRLA_PRESCALER_DIV1);
+    evsysRoute(ACT_EVSYS_CH + 3, eicLineOf(P3_LED_ACT_N), EVSYS_ID_USER_TCC2_EV_0, false);
+
+    for ( uint8_t port = 0; port < ACT_PORT_CNT; port++ )
+    {
+        lastTicks[port] = tccRead(dutyTcc[port]);
+        lastEdges[port] = readEdges(port);
+        memset(&results[port], 0, sizeof(activity_port_t));
+    }
+
+    lastTime = millis();
+}
+
+/**
+  * @name   activity_Service
+  * @brief  compute rate and duty cycle every ACT_INTERVAL_MS
+  * @param  None
+  * @retval None
+  * @note   called from loop() and the status screen
+  */
+void activity_Service(void)
+{
+    uint32_t        now = millis();
+    uint32_t        elapsed = now - lastTime;
+    uint32_t        ticks;
+    uint32_t        edges;
+    uint32_t        cur;
+    uint32_t        duty10;
+
+    if ( elapsed < ACT_INTERVAL_MS )
+        return;
+
+    lastTime = now;
+
+    for ( uint8_t port = 0; port < ACT_PORT_CNT; port++ )
+    {
+        cur = tccRead(dutyTcc[port]);
+        ticks = (cur - lastTicks[port]) & TCC_DUTY_MASK;
+        lastTicks[port] = cur;
+
+        cur = readEdges(port);
+        edges = (cur - lastEdges[port]) & EDGE_MASK;
+        lastEdges[port] = cur;
+
+        // fixed point, 1 decimal; on-time ticks are SystemCoreClock / ACT_DUTY_CLK_DIV per sec
+        results[port].rate10 = (edges * 10000ul) / elapsed;
+        duty10 = ((uint64_t) ticks * ACT_DUTY_CLK_DIV * 1000000ul) / ((uint64_t) elapsed * SystemCoreClock);
+        results[port].duty10 = (duty10 > 1000) ? 1000 : duty10;
+        results[port].total += edges;
+    }
+
+    intervals++;
+}
+
+/**
+  * @name   activity_Get
+  * @brief  get last interval's results for a port
+  * @param  port  0 = P1, 1 = P3
+  * @param  a  filled with results
+  * @retval uint32_t  interval #, changes when new results are available
+  */
+uint32_t activity_Get(uint8_t port, activity_port_t *a)
+{
+    if ( port < ACT_PORT_CNT )
+        *a = results[port];
+
+    return(intervals);
+}
@@ -0,0 +1,557 @@
+//===================================================================
+// capture.cpp
+// Logic-analyzer style capture of every pin in staticPins[].  TC3
+// overflows at the sample rate and its event (via EVSYS) triggers
+// two DMAC channels that copy the PORT A and PORT B IN registers into
+// SRAM rings, so sampling costs no CPU time.  Each ring is split into
+// CAPTURE_CHUNK sample descriptors linked in a circle; the chunk
+// interrupt looks for the trigger edge and stops TC3 once the
+// post-trigger window is filled.
+//
+// 'capture dump' binary format, all values little endian:
+//   "TCAP"  magic
+//   u8      version (CAPTURE_DUMP_VERSION)
+//   u8      n = channel count
+//   u8[n]   Arduino pin # of channel 0..n-1
+//   u32     sample rate in Hz
+//   u32     sample count
+//   u32     trigger sample (0 = first sample)
+//   u16     record count
+//   records u32 state (bit i = channel i level), u16 repeat count
+//   u16     sum of all bytes after the magic
+//===================================================================
+#include <Arduino.h>
+#include "main.hpp"
+#include "commands.hpp"
+#include "cli.hpp"
+#include "console.hpp"
+#include "pins.hpp"
+#include "dma.hpp"
+#include "capture.hpp"
+#include "txfmt.hpp"
+
+extern char                 *tokens[];
+static char                 outBfr[OUTBFR_SIZE];
+
+#define CAPTURE_MASK            (CAPTURE_SAMPLES - 1)
+#define CAPTURE_CHUNKS          (CAPTURE_SAMPLES / CAPTURE_CHUNK)
+#define CAPTURE_DEF_PRE_PCT     25
+
+#if (CAPTURE_SAMPLES & CAPTURE_MASK) != 0 || (CAPTURE_SAMPLES % CAPTURE_CHUNK) != 0
+#error CAPTURE_SAMPLES must be a power of 2 and a multiple of CAPTURE_CHUNK
+#endif
+
+// sample rings, [0] = PORT A IN, [1] = PORT B IN
+static uint32_t             capBuf[2][CAPTURE_SAMPLES];
+
+// chunk descriptors after the first (which is dmaDescriptors[ch])
+__attribute__((aligned(16))) static DmacDescriptor capDesc[2][CAPTURE_CHUNKS - 1];
+
+static volatile CAPTURE_STATE capState = CAP_IDLE;
+static volatile uint32_t    capChunks;                  // chunks completed since arming
+static volatile uint32_t    capTrigger;                 // absolute sample # of trigger edge
+static volatile uint32_t    capEnd;                     // absolute sample # capture stopped at
+static uint32_t             capStopAt;                  // stop once this many samples are in
+static uint32_t             capPost;                    // requested post-trigger samples
+static uint32_t             capRate;
+static uint32_t             trigMask[2];
+static uint32_t             lastSample[2];
+
+// channels: every pin in staticPins[], in Arduino pin order
+static uint8_t              capPins[32];
+static uint8_t              capPinCount = 0;
+
+/**
+  * @name   capTimerStop
+  * @brief  stop sample clock
+  * @param  None
+  * @retval None
+  */
+static void capTimerStop(void)
+{
+    TC3->COUNT16.CTRLA.reg &= ~TC_CTRLA_ENABLE;
+    while (TC3->COUNT16.STATUS.reg & TC_STATUS_SYNCBUSY);
+}
+
+/**
+  * @name   capTimerConfig
+  * @brief  configure TC3 to overflow at the sample rate
+  * @param  rate  samples/sec
+  * @retval None
+  * @note   timer is left stopped
+  */
+static void capTimerConfig(uint32_t rate)
+{
+    TC3->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+    while (TC3->COUNT16.STATUS.reg & TC_STATUS_SYNCBUSY);
+    while (TC3->COUNT16.CTRLA.bit.SWRST);
+
+    // match frequency: count 0..CC0 then overflow
+    TC3->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_WAVEGEN_MFRQ | TC_CTRLA_PRESCALER_DIV1;
+    TC3->COUNT16.CC[0].reg = (uint16_t) (SystemCoreClock / rate - 1);
+    while (TC3->COUNT16.STATUS.reg & TC_STATUS_SYNCBUSY);
+
+    TC3->COUNT16.EVCTRL.reg = TC_EVCTRL_OVFEO;
+}
+
+/**
+  * @name   capDescriptorsInit
+  * @brief  build circular descriptor list for one PORT group
+  * @param  group  0=A 1=B
+  * @param  ch  DMA channel
+  * @param  blockAct  DMAC_BTCTRL_BLOCKACT_xxx for each chunk
+  * @retval None
+  */
+static void capDescriptorsInit(uint8_t group, uint8_t ch, uint16_t blockAct)
+{
+    for ( unsigned k = 0; k < CAPTURE_CHUNKS; k++ )
+    {
+        DmacDescriptor  *d = (k == 0) ? &dmaDescriptors[ch] : &capDesc[group][k - 1];
+
+        d->BTCTRL.reg = DMAC_BTCTRL_VALID | DMAC_BTCTRL_BEATSIZE_WORD | DMAC_BTCTRL_DSTINC | blockAct;
+        d->BTCNT.reg = CAPTURE_CHUNK;
+        d->SRCADDR.reg = (uint32_t) &PORT->Group[group].IN.reg;
+
+        // incrementing addresses are the end of the block
+        d->DSTADDR.reg = (uint32_t) &capBuf[group][(k + 1) * CAPTURE_CHUNK];
+        d->DESCADDR.reg = (k == CAPTURE_CHUNKS - 1) ? (uint32_t) &dmaDescriptors[ch] : (uint32_t) &capDesc[group][k];
+    }
+}
+
+/**
+  * @name   capChunkDone
+  * @brief  DMA callback for each completed chunk
+  * @param  ch  channel (DMA_CH_CAPTURE_B)
+  * @param  flags  CHINTFLAG bits
+  * @retval None
+  * @note   DMAC ISR context; PORT B channel has the lower priority so
+  *         when its chunk is done the PORT A chunk is too
+  */
+static void capChunkDone(uint8_t ch, uint8_t flags)
+{
+    uint32_t        base = capChunks * CAPTURE_CHUNK;
+    uint32_t        i = 0;
+
+    (void) ch;
+
+    if ( (flags & DMAC_CHINTFLAG_TCMPL) == 0 )
+        return;
+
+    capChunks++;
+
+    if ( capState == CAP_ARMED )
+    {
+        // first sample of the capture is the reference
+        if ( base == 0 )
+        {
+            lastSample[0] = capBuf[0][0];
+            lastSample[1] = capBuf[1][0];
+            i = 1;
+        }
+
+        for ( ; i < CAPTURE_CHUNK; i++ )
+        {
+            uint32_t    idx = (base + i) & CAPTURE_MASK;
+
+            if ( ((capBuf[0][idx] ^ lastSample[0]) & trigMask[0]) || ((capBuf[1][idx] ^ lastSample[1]) & trigMask[1]) )
+            {
+                capTrigger = base + i;
+                capStopAt = capTrigger + capPost;
+                capState = CAP_TRIGGERED;
+                break;
+            }
+        }
+
+        if ( capState == CAP_ARMED )
+        {
+            lastSample[0] = capBuf[0][(base + CAPTURE_CHUNK - 1) & CAPTURE_MASK];
+            lastSample[1] = capBuf[1][(base + CAPTURE_CHUNK - 1) & CAPTURE_MASK];
+        }
+    }
+
+    if ( capState == CAP_TRIGGERED && capChunks * CAPTURE_CHUNK >= capStopAt )
+    {
+        capTimerStop();
+        capEnd = capChunks * CAPTURE_CHUNK;
+        capState = CAP_DONE;
+    }
+}
+
+/**
+  * @name   capture_Init
+  * @brief  clock TC3/EVSYS and route TC3 overflow to the capture DMA channels
+  * @param  None
+  * @retval None
+  * @note   call after dma_Init() and configureIOPins()
+  */
+void capture_Init(void)
+{
+    PM->APBCMASK.reg |= PM_APBCMASK_TC3 | PM_APBCMASK_EVSYS;
+
+    GCLK->CLKCTRL.reg = (uint16_t) (GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID(GCM_TCC2_TC3));
+    while (GCLK->STATUS.bit.SYNCBUSY);
+    GCLK->CLKCTRL.reg = (uint16_t) (GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID(GCM_EVSYS_CHANNEL_0 + CAPTURE_EVSYS_CH));
+    while (GCLK->STATUS.bit.SYNCBUSY);
+
+    // one event channel feeds both DMA channels so A and B are sampled on the same tick
+    EVSYS->USER.reg = (uint16_t) (EVSYS_USER_CHANNEL(CAPTURE_EVSYS_CH + 1) | EVSYS_USER_USER(EVSYS_ID_USER_DMAC_CH_0 + DMA_CH_CAPTURE_A));
+    EVSYS->USER.reg = (uint16_t) (EVSYS_USER_CHANNEL(CAPTURE_EVSYS_CH + 1) | EVSYS_USER_USER(EVSYS_ID_USER_DMAC_CH_0 + DMA_CH_CAPTURE_B));
+    EVSYS->CHANNEL.reg = EVSYS_CHANNEL_CHANNEL(CAPTURE_EVSYS_CH) | EVSYS_CHANNEL_EVGEN(EVSYS_ID_GEN_TC3_OVF) |
+                         EVSYS_CHANNEL_PATH_RESYNCHRONIZED | EVSYS_CHANNEL_EDGSEL_RISING_EDGE;
+
+    capPinCount = 0;
+    for ( uint8_t pinNo = 0; pinNo < PINS_COUNT; pinNo++ )
+    {
+        if ( getPinIndex(pinNo) >= 0 && capPinCount < sizeof(capPins) )
+            capPins[capPinCount++] = pinNo;
+    }
+
+    dma_setCallback(DMA_CH_CAPTURE_B, capChunkDone);
+}
+
+/**
+  * @name   capture_State
+  * @brief  get capture state
+  * @param  None
+  * @retval CAPTURE_STATE
+  */
+CAPTURE_STATE capture_State(void)
+{
+    return(capState);
+}
+
+/**
+  * @name   captureStop
+  * @brief  abort capture, stop timer & DMA
+  * @param  None
+  * @retval None
+  */
+static void captureStop(void)
+{
+    capTimerStop();
+    dma_channelDisable(DMA_CH_CAPTURE_A);
+    dma_channelDisable(DMA_CH_CAPTURE_B);
+}
+
+/**
+  * @name   captureArm
+  * @brief  start sampling and wait for trigger edge
+  * @param  rate  samples/sec
+  * @param  trigPin  Arduino pin # or -1 for any pin
+  * @param  prePct  % of window before trigger
+  * @retval None
+  */
+static void captureArm(uint32_t rate, int trigPin, uint32_t prePct)
+{
+    uint32_t        chctrlb = DMAC_CHCTRLB_EVIE | DMAC_CHCTRLB_EVACT_TRIG | DMAC_CHCTRLB_TRIGACT_BEAT | DMAC_CHCTRLB_LVL(0);
+
+    captureStop();
+    capState = CAP_IDLE;
+
+    if ( trigPin < 0 )
+    {
+        // heartbeat LED toggles on its own, never a useful trigger
+        trigMask[0] = trigMask[1] = 0;
+        for ( uint8_t i = 0; i < capPinCount; i++ )
+        {
+            if ( capPins[i] != OCP_HEARTBEAT_LED )
+                trigMask[pinGroup(capPins[i])] |= pinMask(capPins[i]);
+        }
+    }
+    else
+    {
+        trigMask[0] = trigMask[1] = 0;
+        trigMask[pinGroup(trigPin)] = pinMask(trigPin);
+    }
+
+    capRate = rate;
+    capPost = (CAPTURE_WINDOW * (100 - prePct)) / 100;
+    capChunks = 0;
+    capTrigger = capEnd = 0;
+
+    capTimerConfig(rate);
+    capDescriptorsInit(0, DMA_CH_CAPTURE_A, DMAC_BTCTRL_BLOCKACT_NOACT);
+    capDescriptorsInit(1, DMA_CH_CAPTURE_B, DMAC_BTCTRL_BLOCKACT_INT);
+    dma_channelConfig(DMA_CH_CAPTURE_A, chctrlb, 0);
+    dma_channelConfig(DMA_CH_CAPTURE_B, chctrlb, DMAC_CHINTENSET_TCMPL);
+    dma_channelEnable(DMA_CH_CAPTURE_A);
+    dma_channelEnable(DMA_CH_CAPTURE_B);
+
+    capState = CAP_ARMED;
+    TC3->COUNT16.CTRLA.reg |= TC_CTRLA_ENABLE;
+    while (TC3->COUNT16.STATUS.reg & TC_STATUS_SYNCBUSY);
+}
+
+/**
+  * @name   capState32
+  * @brief  pack captured sample into channel bits
+  * @param  n  absolute sample #
+  * @retval uint32_t  bit i = level of capPins[i]
+  */
+static uint32_t capState32(uint32_t n)
+{
+    pin_snapshot_t  snap;
+    uint32_t        state = 0;
+
+    snap.in[0] = capBuf[0][n & CAPTURE_MASK];
+    snap.in[1] = capBuf[1][n & CAPTURE_MASK];
+
+    for ( uint8_t i = 0; i < capPinCount; i++ )
+        state |= ((uint32_t) pinSnapshotGet(&snap, capPins[i]) << i);
+
+    return(state);
+}
+
+/**
+  * @name   capWindowStart
+  * @brief  first valid sample of a completed capture
+  * @param  None
+  * @retval uint32_t  absolute sample #
+  * @note   samples taken between the last chunk interrupt and TC3
+  *         stopping overwrite the oldest chunk, so it is not used
+  */
+static uint32_t capWindowStart(void)
+{
+    return((capEnd > CAPTURE_WINDOW) ? capEnd - CAPTURE_WINDOW : 0);
+}
+
+/**
+  * @name   timeUs10
+  * @brief  time of a sample relative to the trigger
+  * @param  n  absolute sample #
+  * @retval int32_t  0.1 usec, clamped to the int32_t range
+  * @note   from the rate, not the rounded period, so the error doesn't
+  *         grow with distance from the trigger
+  */
+static int32_t timeUs10(uint32_t n)
+{
+    int64_t         t = (int64_t) (int32_t) (n - capTrigger) * 10000000 / (int32_t) capRate;
+
+    if ( t > INT32_MAX )
+        return(INT32_MAX);
+    if ( t < INT32_MIN )
+        return(INT32_MIN);
+
+    return((int32_t) t);
+}
+
+/**
+  * @name   captureShow
+  * @brief  display pin transitions relative to the trigger
+  * @param  None
+  * @retval None
+  */
+static void captureShow(void)
+{
+    uint32_t        start = capWindowStart();
+    uint32_t        prev = capState32(start);
+    uint32_t        cur;
+    uint32_t        usPerSample10 = (10000000ul + capRate / 2) / capRate;
+    TxLine          line;
+
+    line << txDec(capEnd - start) << " samples @ " << txDec(capRate) << " Hz (" << txFixed<1>(usPerSample10)
+         << " us/sample), trigger at sample " << txDec(capTrigger - start);
+    line.end();
+
+    terminalOut((char *) "Initial levels:");
+    for ( uint8_t i = 0; i < capPinCount; i++ )
+    {
+        sprintf(outBfr, "  %-14s %lu", getPinName(capPins[i]), (prev >> i) & 1);
+        terminalOut(outBfr);
+    }
+
+    terminalOut((char *) "     Time(us)  Pin            Level");
+    for ( uint32_t n = start + 1; n < capEnd; n++ )
+    {
+        cur = capState32(n);
+
+        for ( uint8_t i = 0; i < capPinCount && cur != prev; i++ )
+        {
+            if ( ((cur ^ prev) >> i) & 1 )
+            {
+                line << txFixed<1, 13>(timeUs10(n)) << "  " << txStr<14>(getPinName(capPins[i]))
+                     << ' ' << txDec((cur >> i) & 1);
+                line.end();
+            }
+        }
+
+        prev = cur;
+    }
+}
+
+/**
+  * @name   dumpBytes
+  * @brief  send binary data and add to checksum
+  * @param  p  data
+  * @param  len  byte count
+  * @param  sum  running checksum
+  * @retval None
+  */
+static void dumpBytes(const void *p, uint32_t len, uint16_t *sum)
+{
+    const uint8_t   *b = (const uint8_t *) p;
+
+    for ( uint32_t i = 0; i < len; i++ )
+        *sum += b[i];
+
+    console_write((const char *) p, len);
+}
+
+/**
+  * @name   captureDump
+  * @brief  stream completed capture in run-length binary format
+  * @param  None
+  * @retval None
+  */
+static void captureDump(void)
+{
+    uint32_t        start = capWindowStart();
+    uint32_t        count = capEnd - start;
+    uint32_t        trig = capTrigger - start;
+    uint32_t        state;
+    uint32_t        next;
+    uint16_t        run;
+    uint16_t        records = 0;
+    uint16_t        sum = 0;
+    uint8_t         version = CAPTURE_DUMP_VERSION;
+
+    // count records first so the header can carry it
+    state = capState32(start);
+    for ( uint32_t n = start + 1; n < capEnd; n++ )
+    {
+        next = capState32(n);
+        if ( next != state )
+        {
+            records++;
+            state = next;
+        }
+    }
+    records++;
+
+    console_write("TCAP", 4);
+    dumpBytes(&version, 1, &sum);
+    dumpBytes(&capPinCount, 1, &sum);
+    dumpBytes(capPins, capPinCount, &sum);
+    dumpBytes(&capRate, 4, &sum);
+    dumpBytes(&count, 4, &sum);
+    dumpBytes(&trig, 4, &sum);
+    dumpBytes(&records, 2, &sum);
+
+    state = capState32(start);
+    run = 1;
+    for ( uint32_t n = start + 1; n <= capEnd; n++ )
+    {
+        next = (n < capEnd) ? capState32(n) : ~state;
+
+        if ( next != state )
+        {
+            dumpBytes(&state, 4, &sum);
+            dumpBytes(&run, 2, &sum);
+            state = next;
+            run = 1;
+        }
+        else
+        {
+            run++;
+        }
+    }
+
+    console_write((const char *) &sum, 2);
+    console_endResponse();
+}
+
+/**
+  * @name   captureStatus
+  * @brief  display capture state
+  * @param  None
+  * @retval None
+  */
+static void captureStatus(void)
+{
+    const char      *names[] = {"idle", "armed, waiting for trigger", "triggered", "done"};
+
+    sprintf(outBfr, "Capture %s, %lu Hz, %lu samples taken", names[capState], capRate, capChunks * CAPTURE_CHUNK);
+    terminalOut(outBfr);
+}
+
+/**
+  * @name   captureCmd
+  * @brief  'capture' command
+  * @param  arg  number of arguments
+  * @param  tokens[1]  arm, stop, show or dump; none = status
+  * @param  tokens[2]  arm: sample rate in Hz
+  * @param  tokens[3]  arm: trigger pin # or 'any' (default)
+  * @param  tokens[4]  arm: % of window before trigger (default 25)
+  * @retval 0=OK 1=error
+  */
+int captureCmd(int arg)
+{
+    if ( arg == 0 )
+    {
+        captureStatus();
+    }
+    else if ( strcmp(tokens[1], "arm") == 0 && arg >= 2 )
+    {
+        uint32_t    rate = strtoul(tokens[2], NULL, 0);
+        int         trigPin = -1;
+        uint32_t    prePct = CAPTURE_DEF_PRE_PCT;
+
+        if ( rate < CAPTURE_MIN_RATE || rate > CAPTURE_MAX_RATE )
+        {
+            sprintf(outBfr, "Sample rate must be %d..%d Hz", CAPTURE_MIN_RATE, CAPTURE_MAX_RATE);
+            terminalOut(outBfr);
+            return(1);
+        }
+
+        if ( arg >= 3 && strcmp(tokens[3], "any") != 0 )
+        {
+            trigPin = atoi(tokens[3]);
+            if ( trigPin < 0 || trigPin >= PINS_COUNT || getPinIndex(trigPin) < 0 )
+            {
+                terminalOut((char *) "Invalid trigger pin number; use 'pins' command for help.");
+                return(1);
+            }
+        }
+
+        if ( arg >= 4 )
+        {
+            prePct = atoi(tokens[4]);
+            if ( prePct > 100 )
+            {
+                terminalOut((char *) "Pre-trigger must be 0..100 %");
+                return(1);
+            }
+        }
+
+        captureArm(rate, trigPin, prePct);
+        sprintf(outBfr, "Capture armed: %lu Hz, trigger on %s, %lu%% pre-trigger",
+                rate, (trigPin < 0) ? "any pin" : getPinName(trigPin), prePct);
+        terminalOut(outBfr);
+    }
+    else if ( strcmp(tokens[1], "stop") == 0 )
+    {
+        captureStop();
+        capState = CAP_IDLE;
+        terminalOut((char *) "Capture stopped");
+    }
+    else if ( strcmp(tokens[1], "show") == 0 || strcmp(tokens[1], "dump") == 0 )
+    {
+        if ( capState != CAP_DONE )
+        {
+            captureStatus();
+            return(1);
+        }
+
+        if ( tokens[1][0] == 's' )
+            captureShow();
+        else
+            captureDump();
+    }
+    else
+    {
+        showCommandHelp(tokens[0]);
+        return(1);
+    }
+
+    return(0);
+}
@@ -7,6 +7,8 @@
 #include "main.hpp"
 #include "cli.hpp"
 #include "commands.hpp"
+#include "console.hpp"
+#include "txfmt.hpp"
 
 extern uint8_t  boardIDReal;
 
@@ -37,7 +39,9 @@ int setCmd(int arg);
 int pinCmd(int arg);
 int debug(int arg);
 int statusCmd(int arg);
+int captureCmd(int arg);
 int eepromCmd(int arg);
+int eventsCmd(int arg);
 int pwrCmd(int arg);
 int versCmd(int arg);
 int scanCmd(int arg);
@@ -49,15 +53,17 @@ int scanCmd(int arg);
 // NOTE: " " (space) on 2nd line of help doesn't display anything (for short helps)
 // NOTE: These are in alphabetical order for presentation (except help) FYI...
 cli_entry     cmdTable[CLI_COMMAND_CNT] = {
-    {"eeprom", eepromCmd,  -1, "'eeprom show' displays FRU EEPROM info areas.",  "'eeprom dump <addr> <length>' dumps <length> bytes @ <addr>"},
+    {"capture", captureCmd, -1, "Logic capture of all TTF pins (DMA sampled).",  "'capture arm <rate_hz> [<pin>|any] [pre_%]', 'capture show|dump|stop'"},
+    {"eeprom", eepromCmd,  -1, "'eeprom show' displays FRU EEPROM info areas.",  "'eeprom dump <addr> <length>|all [hex|bin]', 'eeprom program <length> [<addr>]'"},
+    {"events", eventsCmd,  -1, "Alarm/presence pin edge log and stats.",        "'events [show|stream|clear]'"},
     {"pins",      pinCmd,   0, "Displays pin names and numbers.",                "TTF uses Arduino-style pin numbering shown in this display."},
-    {"power",     pwrCmd,  -1, "Control power to NIC 3.0 card.",                 "'power <up|down> <main|aux|card>' or 'power status' "},
+    {"power",     pwrCmd,  -1, "Control power to NIC 3.0 card.",                 "'power <up|down> <main|aux|card>', 'power <status|stats|energy|inrush|protect>'"},
     {"read",     readCmd,   1, "Read input pin (Arduino numbering).",            "'read <pin_number>'"},
     {"set",       setCmd,  -1, "Set FLASH parameter to a value.",                "'set <param> <value>' sets value; or 'set' with no args for help."},
-    {"scan",     scanCmd,   0, "Scan chain query of NIC 3.0 card.",              " "},
+    {"scan",     scanCmd,  -1, "Scan chain query of NIC 3.0 card.",              "'scan len <n|auto>', 'scan tune [n]', 'scan mon [start [hz]|stop|stream|show]'"},
     {"status", statusCmd,   0, "Displays status of I/O pins etc.",               " "},
     {"vers",     versCmd,   0, "Shows firmware version information.",            " "},
-    {"write",   writeCmd,   2, "Write output pin (Arduino numbering).",          "'write <pin_number> <0|1>'"},
+    {"write",   writeCmd,  -1, "Write output pin (Arduino numbering).",          "'write <pin_number> <0|1>' or 'write <pin>=<0|1> ...' (simultaneous)"},
     {"xdebug",     debug,  -1, "Debug functions mostly for developer use.",      "Enter 'xdebug' with no arguments for more info."},
     {"help",        help,   0, "NOTE: THIS DOES NOT DISPLAY ON PURPOSE",         " "},    
 };
@@ -72,39 +78,34 @@ cli_entry     cmdTable[CLI_COMMAND_CNT] = {
   */
 void CURSOR(uint8_t r,uint8_t c)                 
 {
-    char          bfr[12];
+    TxLine        line;
 
-    sprintf(bfr, "\x1b[%d;%df", r, c);
-    SerialUSB.write(bfr);
-    SerialUSB.flush();
-    delay(5);
+    line.cursor(r, c);
+    line.send();
 }
 
 /**
   * @name   terminalOut
-  * @brief  wrapper to SerialUSB.print[ln]
+  * @brief  output line to terminal with CR/LF
   * @param  msg to output
   * @retval None
-  * @note   needed to address missing chars
+  * @note   queued in console TX ring buffer, does not block
   */
 void terminalOut(char *msg)
 {
-    SerialUSB.println(msg);
-    SerialUSB.flush();
-    delay(50);
+    console_puts(msg);
+    console_write("\r\n", 2);
 }
 
 /**
   * @name   displayLine
-  * @brief  wrapper to SerialUSB.write
-  * @param  None
+  * @brief  output string to terminal without CR/LF
+  * @param  m string to output
   * @retval None
   */
 void displayLine(char *m)
 {
-    SerialUSB.write(m);
-    SerialUSB.flush();
-    delay(10);
+    console_puts(m);
 }
 
 /**
@@ -115,11 +116,9 @@ void displayLine(char *m)
   */
 void doPrompt(void)
 {
-    SerialUSB.write(0x0a);
-    SerialUSB.write(0x0d);
-    SerialUSB.flush();
-    SerialUSB.print(cliPrompt);
-    SerialUSB.flush();
+    console_write("\n\r", 2);
+    console_puts(cliPrompt);
+    console_endResponse();
 }
 
 /**
@@ -208,7 +207,6 @@ bool cli(char *raw)
             {
                 // command funcs are passed arg count, tokens are global
                 (cmdTable[i].func) (argCount);
-                SerialUSB.flush();
                 rc = true;
                 error = CLI_ERR_NO_ERROR;
                 break;
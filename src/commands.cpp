@@ -10,13 +10,23 @@
 #include "main.hpp"
 #include "eeprom.hpp"
 #include "commands.hpp"
+#include "cli.hpp"
+#include "console.hpp"
+#include "pins.hpp"
+#include "events.hpp"
+#include "activity.hpp"
+#include "scan.hpp"
+#include "scanmon.hpp"
+#include "scantune.hpp"
+#include "power.hpp"
+#include "energy.hpp"
+#include "inrush.hpp"
+#include "txfmt.hpp"
+#include "protect.hpp"
 #include <math.h>
 
 extern char                 *tokens[];
 extern EEPROM_data_t        EEPROMData;
-extern volatile uint32_t    scanClockPulseCounter;
-extern volatile bool        enableScanClk;
-extern volatile uint32_t    scanShiftRegister_0;
 
 // pin defs used for 1) pin init and 2) copied into volatile status structure
 // to maintain state of inputs pins that get written 3) pin names (nice, right?) ;-)
@@ -26,7 +36,7 @@ extern volatile uint32_t    scanShiftRegister_0;
 // NOTE: The order of the entries in this table is the order they are displayed by the
 // 'pins' command. There is no other signficance to the order.  The first entry in a
 // pair is the left column while the second entry is the right column.
- const pin_mgt_t     staticPins[] = {
+constexpr pin_mgt_t  staticPins[] = {
   {               TEMP_WARN, INPUT,     ACT_HI, "TEMP_WARN"},
   {         OCP_MAIN_PWR_EN, OUTPUT,    ACT_HI, "MAIN_EN"},
 
@@ -72,60 +82,84 @@ extern volatile uint32_t    scanShiftRegister_0;
 
 uint16_t      static_pin_count = sizeof(staticPins) / sizeof(pin_mgt_t);
 
-typedef struct {
-    uint8_t     bitNo;
-    char        bitName[20];
-} scan_data_t;
-
-// NOTE: This table is processed aligning with bits 31..0
-// The bitNo entry is NOT used
-const scan_data_t     scanBitNames[] = {
-    // Byte 0
-    {7, "0.7 FAN_ON_AUX"},
-    {6, "0.6 TEMP_CRIT_N"},
-    {5, "0.5 TEMP_WARN_N"},
-    {4, "0.4 WAKE_N"},
-    {3, "0.3 PRSNTB[3]_P#"},
-    {2, "0.2 PRSNTB[2]_P#"},
-    {1, "0.1 PRSNTB[1]_P#"},
-    {0, "0.0 PRSNTB[0]_P#"},
-
-    // Byte 1
-    {15, "1.7 LINK_SPDB_P2#"},
-    {14, "1.6 LINK_SPDA_P2#"},
-    {13, "1.5 ACT_P1#"},
-    {12, "1.4 LINK_SPDB_P1#"},
-    {11, "1.3 LINK_SPDA_P1#"},
-    {10, "1.2 ACT_PO#"},
-    {9, "1.1 LINK_SPDB_PO#"},
-    {8, "1.0 LINK_SPDA_PO#"},
-
-    // Byte 2
-    {23, "2.7 LINK_SPDA_P5#"},
-    {22, "2.6 ACT_P4#"},
-    {21, "2.5 LINK_SPDB_P4#"},
-    {20, "2.4 LINK_SPDA_P4#"},
-    {19, "2.3 ACT_P3#"},
-    {18, "2.2 LINK_SPDB_P3#"},
-    {17, "2.1 LINK_SPDA_P3#"},
-    {16, "2.0 ACT_P2#"},
-
-    // Byte 3
-    {31, "3.7 ACT_P7#"},
-    {30, "3.6 LINK_SPDB_P7#"},
-    {29, "3.5 LINK_SPDA_P7#"},
-    {28, "3.4 ACT_P6#"},
-    {27, "3.3 LINK_SPDB_P6#"},
-    {26, "3.2 LINK_SPDA_P6#"},
-    {25, "3.1 ACT_P5#"},
-    {24, "3.0 LINK_SPDB_P5#"},
+#define STATIC_PIN_CNT          (sizeof(staticPins) / sizeof(pin_mgt_t))
+
+/**
+  * @name   inputMask
+  * @brief  compile-time PORT group mask of all input pins in staticPins[]
+  * @param  group  PORT group 0=A 1=B
+  * @param  i  table index to start at (recursion)
+  * @retval uint32_t  mask
+  */
+constexpr uint32_t inputMask(uint8_t group, unsigned i = 0)
+{
+    return((i >= STATIC_PIN_CNT) ? 0 :
+           (((staticPins[i].pinFunc != OUTPUT && pinGroup(staticPins[i].pinNo) == group) ? pinMask(staticPins[i].pinNo) : 0)
+            | inputMask(group, i + 1)));
+}
+
+constexpr uint32_t      portInputMask[2] = { inputMask(0), inputMask(1) };
+
+/**
+  * @name   pinIndexOf
+  * @brief  compile-time search of staticPins[] for a pin
+  * @param  pinNo  Arduino pin number
+  * @param  i  table index to start at (recursion)
+  * @retval int8_t  index or -1 if not found
+  */
+constexpr int8_t pinIndexOf(uint8_t pinNo, unsigned i = 0)
+{
+    return((i >= STATIC_PIN_CNT) ? -1 : (staticPins[i].pinNo == pinNo) ? (int8_t) i : pinIndexOf(pinNo, i + 1));
+}
+
+// Arduino pin number -> staticPins[] index, -1 if not a TTF pin.  Built at
+// compile time so getPinIndex()/getPinName() don't scan the table.
+static_assert(PINS_COUNT == 36, "pinIndexMap[] initializer must match PINS_COUNT");
+
+#define PIN_INDEX_4(n)          pinIndexOf(n), pinIndexOf(n + 1), pinIndexOf(n + 2), pinIndexOf(n + 3)
+
+constexpr int8_t        pinIndexMap[PINS_COUNT] = {
+    PIN_INDEX_4(0),  PIN_INDEX_4(4),  PIN_INDEX_4(8),  PIN_INDEX_4(12), PIN_INDEX_4(16),
+    PIN_INDEX_4(20), PIN_INDEX_4(24), PIN_INDEX_4(28), PIN_INDEX_4(32),
 };
 
+/**
+  * @name   pinsAreValid
+  * @brief  compile-time check that every staticPins[] entry is a real pin
+  *         and is listed only once
+  * @param  i  table index to start at (recursion)
+  * @retval bool
+  */
+constexpr bool pinsAreValid(unsigned i = 0)
+{
+    return((i >= STATIC_PIN_CNT) ? true :
+           (staticPins[i].pinNo < PINS_COUNT && pinIndexOf(staticPins[i].pinNo) == (int8_t) i && pinsAreValid(i + 1)));
+}
+
+static_assert(pinsAreValid(), "staticPins[] has an invalid or duplicate pin number");
+
+// card presence pins, all high = no card
+constexpr uint32_t      prsntMask[2] = {
+    (pinGroup(OCP_PRSNTB0_N) == 0 ? pinMask(OCP_PRSNTB0_N) : 0) | (pinGroup(OCP_PRSNTB1_N) == 0 ? pinMask(OCP_PRSNTB1_N) : 0) |
+    (pinGroup(OCP_PRSNTB2_N) == 0 ? pinMask(OCP_PRSNTB2_N) : 0) | (pinGroup(OCP_PRSNTB3_N) == 0 ? pinMask(OCP_PRSNTB3_N) : 0),
+    (pinGroup(OCP_PRSNTB0_N) == 1 ? pinMask(OCP_PRSNTB0_N) : 0) | (pinGroup(OCP_PRSNTB1_N) == 1 ? pinMask(OCP_PRSNTB1_N) : 0) |
+    (pinGroup(OCP_PRSNTB2_N) == 1 ? pinMask(OCP_PRSNTB2_N) : 0) | (pinGroup(OCP_PRSNTB3_N) == 1 ? pinMask(OCP_PRSNTB3_N) : 0),
+};
+
+// scan chain decode tables, see scan.hpp for the chain layout
+// byte 0: card status, bit 0..7
+const char      *scanByte0Names[8] = {
+    "PRSNTB[0]_P#", "PRSNTB[1]_P#", "PRSNTB[2]_P#", "PRSNTB[3]_P#",
+    "WAKE_N", "TEMP_WARN_N", "TEMP_CRIT_N", "FAN_ON_AUX",
+};
+
+// per port: bit SCAN_PORT_BASE + (port * SCAN_PORT_BITS) + index, all active low
+const char      *scanPortFieldNames[SCAN_PORT_BITS] = {"LINK_SPDA#", "LINK_SPDB#", "ACT#"};
+
 static char             outBfr[OUTBFR_SIZE];
 uint8_t                 pinStates[PINS_COUNT] = {0};
 
 // Prototypes
-void timers_scanChainCapture(void);
 void writePin(uint8_t pinNo, uint8_t value);
 void readAllPins(void);
 
@@ -163,34 +197,90 @@ void configureIOPins(void)
 
 /**
   * @name   readPin
-  * @brief  wrapper to digitalRead via pinStates[]
+  * @brief  read input pin into pinStates[]
   * @param  pinNo   Arduino pin # to read
-  * @retval bool    pin state
+  * @retval bool    pin state, false if pin is not in staticPins[]
   */
 bool readPin(uint8_t pinNo)
 {
-    uint8_t         index = getPinIndex(pinNo);
+    int8_t          index = getPinIndex(pinNo);
+
+    if ( index < 0 )
+        return(false);
 
     // if requested pin is an input, read that pin; else the
     // latest value written will be in pinStates[]
-    if ( staticPins[index].pinFunc == INPUT )
-        pinStates[index] = digitalRead((pin_size_t) pinNo);
+    if ( staticPins[index].pinFunc != OUTPUT )
+        pinStates[index] = (PORT->Group[pinGroup(pinNo)].IN.reg & pinMask(pinNo)) ? 1 : 0;
 
     return(pinStates[index]);
 }
 
 /**
   * @name   writePin
-  * @brief  wrapper to digitalWrite via pinStates[]
+  * @brief  write output pin and update pinStates[]
   * @param  pinNo = Arduino pin #
   * @param  value = value to write 0 or 1
   * @retval None
+  * @note   pins not in staticPins[] are ignored
   */
 void writePin(uint8_t pinNo, uint8_t value)
 {
+    int8_t          index = getPinIndex(pinNo);
+
+    if ( index < 0 )
+        return;
+
     value = (value == 0) ? 0 : 1;           // force value to boolean
-    digitalWrite(pinNo, value);
-    pinStates[getPinIndex(pinNo)] = value;
+
+    if ( value )
+        PORT->Group[pinGroup(pinNo)].OUTSET.reg = pinMask(pinNo);
+    else
+        PORT->Group[pinGroup(pinNo)].OUTCLR.reg = pinMask(pinNo);
+
+    pinStates[index] = value;
+}
+
+/**
+  * @name   writePins
+  * @brief  write several output pins at the same instant and update pinStates[]
+  * @param  writes  pin #/value pairs
+  * @param  count  number of pairs
+  * @retval bool  false if any pin is not an output in staticPins[] (nothing written)
+  * @note   each PORT group's OUT register is written once with IRQs off so
+  *         all edges in a group happen on the same clock; all TTF outputs
+  *         are on PORT A (a B write follows on the next IOBUS cycle)
+  */
+bool writePins(const pin_write_t *writes, uint8_t count)
+{
+    uint32_t        setMask[2] = {0, 0};
+    uint32_t        clrMask[2] = {0, 0};
+    uint32_t        primask;
+
+    for ( uint8_t i = 0; i < count; i++ )
+    {
+        int8_t      index = getPinIndex(writes[i].pinNo);
+
+        if ( index < 0 || staticPins[index].pinFunc != OUTPUT )
+            return(false);
+
+        if ( writes[i].value )
+            setMask[pinGroup(writes[i].pinNo)] |= pinMask(writes[i].pinNo);
+        else
+            clrMask[pinGroup(writes[i].pinNo)] |= pinMask(writes[i].pinNo);
+    }
+
+    // OUT read-modify-write must not race an ISR's OUTSET/OUTCLR
+    primask = __get_PRIMASK();
+    __disable_irq();
+    PORT_IOBUS->Group[0].OUT.reg = (PORT_IOBUS->Group[0].OUT.reg | setMask[0]) & ~clrMask[0];
+    PORT_IOBUS->Group[1].OUT.reg = (PORT_IOBUS->Group[1].OUT.reg | setMask[1]) & ~clrMask[1];
+    __set_PRIMASK(primask);
+
+    for ( uint8_t i = 0; i < count; i++ )
+        pinStates[getPinIndex(writes[i].pinNo)] = writes[i].value ? 1 : 0;
+
+    return(true);
 }
 
 /**
@@ -204,7 +294,7 @@ void writePin(uint8_t pinNo, uint8_t value)
 int readCmd(int arg)
 {
     uint8_t       pinNo = atoi(tokens[1]);
-    uint8_t       index = getPinIndex(pinNo);
+    int8_t        index = getPinIndex(pinNo);
 
     if ( isCardPresent() == false )
     {
@@ -212,31 +302,34 @@ int readCmd(int arg)
         return(1);
     }
 
-    if ( pinNo > PINS_COUNT )
+    if ( index < 0 )
     {
         terminalOut((char *) "Invalid pin number; please use Arduino numbering");
         return(1);
     }
 
     (void) readPin(pinNo);
-    sprintf(outBfr, "%s Pin %d (%s) = %d", (staticPins[index].pinFunc == INPUT) ? "Input" : "Output", 
-            pinNo, getPinName(pinNo), pinStates[index]);
+    sprintf(outBfr, "%s Pin %d (%s) = %d", (staticPins[index].pinFunc != OUTPUT) ? "Input" : "Output", 
+            pinNo, staticPins[index].name, pinStates[index]);
     terminalOut(outBfr);
     return(0);
 }
 
 /**
   * @name   writeCmd
-  * @brief  write a pin with 0 or 1
-  * @param  arg 1 Arduino pin #
-  * @param  arg 2 value to write
-  * @retval None
+  * @brief  write a pin with 0 or 1, or several pins at once
+  * @param  argCnt  number of arguments
+  * @param  tokens[1..2]  Arduino pin # and value to write, or
+  * @param  tokens[1..n]  <pin>=<value> pairs, all written simultaneously
+  * @retval 0=OK 1=error
   */
 int writeCmd(int argCnt)
 {
-    uint8_t     pinNo = atoi(tokens[1]);
-    uint8_t     value = atoi(tokens[2]);
-    uint8_t     index = getPinIndex(pinNo);
+    pin_write_t     writes[MAX_TOKENS];
+    uint8_t         count = 0;
+    char            *eq;
+    int8_t          index;
+    int             len;
 
     if ( isCardPresent() == false )
     {
@@ -244,27 +337,84 @@ int writeCmd(int argCnt)
         return(1);
     }
 
-    if ( pinNo > PINS_COUNT || index == -1 )
+    if ( argCnt == 0 )
     {
-        terminalOut((char *) "Invalid pin number; use 'pins' command for help.");
+        showCommandHelp(tokens[0]);
         return(1);
-    }    
+    }
 
-    if ( staticPins[index].pinFunc == INPUT )
+    // 'write <pin> <value>' or 'write <pin>=<value> ...'
+    if ( strchr(tokens[1], '=') == NULL )
     {
-        terminalOut((char *) "Cannot write to an input pin! Use 'pins' command for help.");
-        return(1);
-    }  
+        if ( argCnt != 2 )
+        {
+            showCommandHelp(tokens[0]);
+            return(1);
+        }
 
-    if ( value != 0 && value != 1 )
+        writes[0].pinNo = atoi(tokens[1]);
+        writes[0].value = atoi(tokens[2]);
+        count = 1;
+    }
+    else
     {
-        terminalOut((char *) "Invalid pin value; please enter either 0 or 1");
-        return(1);
+        for ( int i = 1; i <= argCnt; i++ )
+        {
+            eq = strchr(tokens[i], '=');
+            if ( eq == NULL )
+            {
+                terminalOut((char *) "Use <pin>=<value> for every pin when writing several pins");
+                return(1);
+            }
+
+            writes[count].pinNo = atoi(tokens[i]);
+            writes[count].value = atoi(eq + 1);
+            count++;
+        }
+    }
+
+    for ( uint8_t i = 0; i < count; i++ )
+    {
+        index = getPinIndex(writes[i].pinNo);
+
+        if ( index < 0 )
+        {
+            terminalOut((char *) "Invalid pin number; use 'pins' command for help.");
+            return(1);
+        }
+
+        if ( staticPins[index].pinFunc != OUTPUT )
+        {
+            terminalOut((char *) "Cannot write to an input pin! Use 'pins' command for help.");
+            return(1);
+        }
+
+        if ( writes[i].value != 0 && writes[i].value != 1 )
+        {
+            terminalOut((char *) "Invalid pin value; please enter either 0 or 1");
+            return(1);
+        }
+
+        // the enables stay off until the trip is cleared, same as 'power up'
+        if ( writes[i].value && (writes[i].pinNo == OCP_MAIN_PWR_EN || writes[i].pinNo == OCP_AUX_PWR_EN) &&
+             protect_Tripped() )
+        {
+            terminalOut((char *) "Power protection has tripped; see 'power protect', then 'power protect clear'");
+            return(1);
+        }
     }
 
-    writePin(pinNo, value);
+    // a trip clears the enables behind pinStates[]' back
+    protect_Service();
+    (void) writePins(writes, count);
+
+    len = sprintf(outBfr, "Wrote");
+    for ( uint8_t i = 0; i < count; i++ )
+    {
+        len += sprintf(&outBfr[len], "%s %d to pin # %d (%s)", (i == 0) ? "" : ",", writes[i].value,
+                       writes[i].pinNo, staticPins[getPinIndex(writes[i].pinNo)].name);
+    }
 
-    sprintf(outBfr, "Wrote %d to pin # %d (%s)", value, pinNo, getPinName(pinNo));
     terminalOut(outBfr);
     return(0);
 }
@@ -313,7 +463,7 @@ int pinCmd(int arg)
       if ( count == 1 )
       {
           sprintf(outBfr, "%2d %20s %c %d ", staticPins[index].pinNo, staticPins[index].name,
-                  getPinChar(index), readPin(staticPins[index].pinNo));
+                  getPinChar(index), pinStates[index]);
           terminalOut(outBfr);
           break;
       }
@@ -321,9 +471,9 @@ int pinCmd(int arg)
       {
           sprintf(outBfr, "%2d %20s %c %d\t\t%2d %20s %c %d ", 
                   staticPins[index].pinNo, staticPins[index].name, 
-                  getPinChar(index), readPin(staticPins[index].pinNo),
+                  getPinChar(index), pinStates[index],
                   staticPins[index+1].pinNo, staticPins[index+1].name, 
-                  getPinChar(index+1), readPin(staticPins[index+1].pinNo));
+                  getPinChar(index+1), pinStates[index+1]);
           terminalOut(outBfr);
           count -= 2;
           index += 2;
@@ -361,135 +511,282 @@ int pinCmd(int arg)
   * @brief  read all I/O pins into pinStates[]
   * @param  None
   * @retval None
+  * @note   all inputs come from one PORT snapshot so they are sampled
+  *         at the same instant; outputs keep their last written value
   */
 void readAllPins(void)
 {
-    for ( int i = 0; i < static_pin_count; i++ )
+    pin_snapshot_t      snap;
+
+    pinSnapshotRead(&snap);
+    snap.in[0] &= portInputMask[0];
+    snap.in[1] &= portInputMask[1];
+
+    for ( unsigned i = 0; i < STATIC_PIN_CNT; i++ )
     {
-        (void) readPin(staticPins[i].pinNo);
+        if ( staticPins[i].pinFunc != OUTPUT )
+            pinStates[i] = pinSnapshotGet(&snap, staticPins[i].pinNo);
     }
 }
 
 /**
-  * @name   statusCmd
-  * @brief  display status screen
-  * @param  argCnt = number of CLI arguments
+  * @name   getPinState
+  * @brief  last state read/written for a pin, no hardware access
+  * @param  pinNo  Arduino pin #
+  * @retval uint8_t  0 or 1
+  * @note   call readAllPins() first for current input states
+  */
+uint8_t getPinState(uint8_t pinNo)
+{
+    int8_t          index = getPinIndex(pinNo);
+
+    return((index < 0) ? 0 : pinStates[index]);
+}
+
+/**
+  * @name   pinMapVerify
+  * @brief  check compile-time pinPortBit[] against variant.cpp
+  * @param  None
+  * @retval bool  true if every pin matches g_APinDescription[]
+  */
+bool pinMapVerify(void)
+{
+    for ( unsigned pinNo = 0; pinNo < PINS_COUNT; pinNo++ )
+    {
+        if ( pinGroup(pinNo) != g_APinDescription[pinNo].ulPort ||
+             PORTBIT_BIT(pinPortBit[pinNo]) != g_APinDescription[pinNo].ulPin )
+            return(false);
+    }
+
+    return(true);
+}
+
+// Status screen field table: label is drawn once at row/col and the
+// value (pins[] MSB first) is drawn right after the label. Only values
+// that changed since the last refresh are redrawn.
+#define STATUS_FLD_CARD         0x01        // append CARD/VOID after value
+#define STATUS_MAX_PINS         4
+
+typedef struct {
+    uint8_t         row;
+    uint8_t         col;
+    char            label[22];
+    uint8_t         flags;
+    uint8_t         pinCount;
+    uint8_t         pins[STATUS_MAX_PINS];
+} status_field_t;
+
+constexpr status_field_t    statusFields[] = {
+    { 3,  1, "TEMP WARN         ",   0, 1, {TEMP_WARN}},
+    { 3, 57, "P1_LINK_A_N      ",    0, 1, {P1_LINKA_N}},
+    { 4,  1, "TEMP CRIT         ",   0, 1, {TEMP_CRIT}},
+    { 4, 56, "PRSNTB [3:0]   ",      STATUS_FLD_CARD, 4, {OCP_PRSNTB3_N, OCP_PRSNTB2_N, OCP_PRSNTB1_N, OCP_PRSNTB0_N}},
+    { 5,  1, "FAN ON AUX        ",   0, 1, {FAN_ON_AUX}},
+    { 5, 58, "ATX_PWR_OK      ",     0, 1, {ATX_PWR_OK}},
+    { 6,  1, "SCAN_LD_N         ",   0, 1, {OCP_SCAN_LD_N}},
+    { 6, 53, "SCAN VERS [1:0]     ", 0, 2, {SCAN_VER_1, SCAN_VER_0}},
+    { 7,  1, "AUX_EN            ",   0, 1, {OCP_AUX_PWR_EN}},
+    { 7, 60, "PWRBRK_N      ",       0, 1, {OCP_PWRBRK_N}},
+    { 8,  1, "MAIN_EN           ",   0, 1, {OCP_MAIN_PWR_EN}},
+    { 8, 62, "WAKE_N      ",         0, 1, {OCP_WAKE_N}},
+    { 9,  1, "P3_LED_ACT_N      ",   0, 1, {P3_LED_ACT_N}},
+    { 9, 58, "P3_LINKA_N      ",     0, 1, {P3_LINKA_N}},
+    {10,  1, "P1_LED_ACT_N      ",   0, 1, {P1_LED_ACT_N}},
+    {10, 58, "NCSI_RST_N      ",     0, 1, {NCSI_RST_N}},
+};
+
+#define STATUS_FIELD_CNT        (sizeof(statusFields) / sizeof(status_field_t))
+#define STATUS_NOT_DRAWN        0xFF        // shadow value that forces a redraw
+
+// link state + ACT LED activity per port, redrawn each counter interval
+#define STATUS_ACT_ROW          12
+
+constexpr uint8_t           statusLinkPins[ACT_PORT_CNT] = {P1_LINKA_N, P3_LINKA_N};
+constexpr const char        *statusActLabels[ACT_PORT_CNT] = {"P1 LINK/ACTIVITY  ", "P3 LINK/ACTIVITY  "};
+
+/**
+  * @name   statusPinsValid
+  * @brief  compile-time check that status fields only use staticPins[] pins
+  * @param  i  field index (recursion)
+  * @param  p  pin index within field (recursion)
+  * @retval bool
+  */
+constexpr bool statusPinsValid(unsigned i = 0, unsigned p = 0)
+{
+    return((i >= STATUS_FIELD_CNT) ? true :
+           (p >= statusFields[i].pinCount) ? statusPinsValid(i + 1, 0) :
+           (pinIndexOf(statusFields[i].pins[p]) >= 0 && statusPinsValid(i, p + 1)));
+}
+
+static_assert(statusPinsValid(), "statusFields[] uses a pin that is not in staticPins[]");
+
+/**
+  * @name   statusDrawLayout
+  * @brief  draw static part of status screen and invalidate shadow values
+  * @param  shadow  last rendered value per field
   * @retval None
   */
-int statusCmd(int arg)
+static void statusDrawLayout(uint8_t *shadow)
 {
-    uint16_t        count = EEPROMData.status_delay_secs;
-    bool            oneShot = (count == 0) ? true : false;
+    CLR_SCREEN();
+    CURSOR(1, 29);
+    displayLine((char *) "TTF Status Display");
 
-    if ( isCardPresent() == false )
+    for ( unsigned i = 0; i < STATUS_FIELD_CNT; i++ )
     {
-        terminalOut((char *) "NIC card is not present; cannot display status");
-        return(1);
+        CURSOR(statusFields[i].row, statusFields[i].col);
+        displayLine((char *) statusFields[i].label);
+        shadow[i] = STATUS_NOT_DRAWN;
     }
 
-    while ( 1 )
+    for ( unsigned port = 0; port < ACT_PORT_CNT; port++ )
     {
-        readAllPins();
+        CURSOR(STATUS_ACT_ROW + port, 1);
+        displayLine((char *) statusActLabels[port]);
+    }
+}
 
-        CLR_SCREEN();
-        CURSOR(1, 29);
-        displayLine((char *) "TTF Status Display");
+/**
+  * @name   statusUpdateActivity
+  * @brief  redraw link state and ACT LED rate/duty when a new counter
+  *         interval has completed
+  * @param  lastInterval  interval # last drawn
+  * @retval int  number of fields redrawn
+  */
+static int statusUpdateActivity(uint32_t *lastInterval)
+{
+    activity_port_t a;
+    uint32_t        interval = 0;
+    TxLine          line;
 
-        CURSOR(3,1);
-        sprintf(outBfr, "TEMP WARN         %d", readPin(TEMP_WARN));
-        displayLine(outBfr);
+    activity_Service();
 
-        CURSOR(3,57);
-        sprintf(outBfr, "P1_LINK_A_N      %u", readPin(P1_LINKA_N));
-        displayLine(outBfr);
+    for ( unsigned port = 0; port < ACT_PORT_CNT; port++ )
+    {
+        interval = activity_Get(port, &a);
+        if ( interval == *lastInterval )
+            return(0);
 
-        CURSOR(4,1);
-        sprintf(outBfr, "TEMP CRIT         %u", readPin(TEMP_CRIT));
-        displayLine(outBfr);
+        line.cursor(STATUS_ACT_ROW + port, 1 + strlen(statusActLabels[port]));
+        line << txStr<4>((getPinState(statusLinkPins[port]) == 0) ? "UP" : "DOWN") << ' '
+             << txFixed<1, 8>(a.rate10) << "/s " << txFixed<1, 5>(a.duty10) << "% on";
+        line.send();
+    }
 
-        CURSOR(4,56);
-        sprintf(outBfr, "PRSNTB [3:0]   %u%u%u%u %s", readPin(OCP_PRSNTB3_N), readPin(OCP_PRSNTB2_N), 
-                readPin(OCP_PRSNTB1_N), readPin(OCP_PRSNTB0_N), isCardPresent() ? "CARD" : "VOID");
-        displayLine(outBfr);
+    *lastInterval = interval;
+    return(ACT_PORT_CNT);
+}
 
-        CURSOR(5,1);
-        sprintf(outBfr, "FAN ON AUX        %u", readPin(FAN_ON_AUX));
-        displayLine(outBfr);
+/**
+  * @name   statusUpdateFields
+  * @brief  redraw only those status values that changed
+  * @param  shadow  last rendered value per field
+  * @retval int  number of fields redrawn
+  */
+static int statusUpdateFields(uint8_t *shadow)
+{
+    uint8_t         value;
+    int             redrawn = 0;
+    TxLine          line;
 
-        CURSOR(5,58);
-        sprintf(outBfr, "ATX_PWR_OK      %u", readPin(ATX_PWR_OK));
-        displayLine(outBfr);
+    readAllPins();
 
-        CURSOR(6,1);
-        sprintf(outBfr, "SCAN_LD_N         %d", readPin(OCP_SCAN_LD_N));
-        displayLine(outBfr);
+    for ( unsigned i = 0; i < STATUS_FIELD_CNT; i++ )
+    {
+        const status_field_t    *f = &statusFields[i];
 
-        CURSOR(6,53);
-        sprintf(outBfr, "SCAN VERS [1:0]     %u%u", readPin(SCAN_VER_1), readPin(SCAN_VER_0));
-        displayLine(outBfr);
+        value = 0;
+        for ( int p = 0; p < f->pinCount; p++ )
+            value = (value << 1) | getPinState(f->pins[p]);
 
-        CURSOR(7,1);
-        sprintf(outBfr, "AUX_EN            %d", readPin(OCP_AUX_PWR_EN));
-        displayLine(outBfr);      
+        if ( value == shadow[i] )
+            continue;
 
-        CURSOR(7,60);
-        sprintf(outBfr, "PWRBRK_N      %d", readPin(OCP_PWRBRK_N));
-        displayLine(outBfr);
+        shadow[i] = value;
+        redrawn++;
 
-        CURSOR(8,1);
-        sprintf(outBfr, "MAIN_EN           %d", readPin(OCP_MAIN_PWR_EN));
-        displayLine(outBfr);  
+        line.cursor(f->row, f->col + strlen(f->label));
+        for ( int p = f->pinCount - 1; p >= 0; p-- )
+            line << ((value & (1 << p)) ? '1' : '0');
 
-        CURSOR(8,62);
-        sprintf(outBfr, "WAKE_N      %d", readPin(OCP_WAKE_N));
-        displayLine(outBfr);
+        if ( f->flags & STATUS_FLD_CARD )
+            line << (isCardPresent() ? " CARD" : " VOID");
 
-        CURSOR(9,1);
-        sprintf(outBfr, "P3_LED_ACT_N      %d", readPin(P3_LED_ACT_N));
-        displayLine(outBfr);  
+        line.send();
+    }
 
-        CURSOR(9,58);
-        sprintf(outBfr, "P3_LINKA_N      %d", readPin(P3_LINKA_N));
-        displayLine(outBfr);
+    return(redrawn);
+}
 
-        CURSOR(10,1);
-        sprintf(outBfr, "P1_LED_ACT_N      %d", readPin(P1_LED_ACT_N));
-        displayLine(outBfr);
+/**
+  * @name   statusCmd
+  * @brief  display status screen
+  * @param  argCnt = number of CLI arguments
+  * @retval None
+  * @note   layout is drawn once, then changed values are redrawn every
+  *         sdelay msec until a key is hit
+  */
+int statusCmd(int arg)
+{
+    uint8_t         shadow[STATUS_FIELD_CNT];
+    uint32_t        lastRefresh;
+    uint32_t        lastInterval = 0xFFFFFFFF;
+    int             redrawn;
 
-        CURSOR(10, 58);
-        sprintf(outBfr, "NCSI_RST_N      %d", readPin(NCSI_RST_N));
-        displayLine(outBfr);
+    if ( isCardPresent() == false )
+    {
+        terminalOut((char *) "NIC card is not present; cannot display status");
+        return(1);
+    }
 
-        if ( oneShot )
-        {
-            CURSOR(12,1);
-            displayLine((char *) "Status delay 0, set sdelay to nonzero for this screen to loop.");
-            return(0);
-        }
+    statusDrawLayout(shadow);
+    (void) statusUpdateFields(shadow);
+    (void) statusUpdateActivity(&lastInterval);
 
-        CURSOR(24, 22);
-        displayLine((char *) "Hit any key to exit this display");
+    if ( EEPROMData.status_delay_msec == 0 )
+    {
+        CURSOR(15,1);
+        displayLine((char *) "Status delay 0, set sdelay to nonzero for this screen to loop.");
+        return(0);
+    }
 
-        while ( count-- > 0 )
+    CURSOR(24, 22);
+    displayLine((char *) "Hit any key to exit this display");
+    console_endResponse();
+    lastRefresh = millis();
+
+    while ( 1 )
+    {
+        events_Service();
+        scanmon_Service();
+
+        if ( SerialUSB.available() )
         {
-            if ( SerialUSB.available() )
+            // flush any user input and exit
+            while ( SerialUSB.available() )
             {
-                // flush any user input and exit
                 (void) SerialUSB.read();
-
-                while ( SerialUSB.available() )
-                {
-                    (void) SerialUSB.read();
-                }
-
-                CLR_SCREEN();
-                return(0);
             }
 
-            delay(1000);
+            CLR_SCREEN();
+            return(0);
         }
 
-        count = EEPROMData.status_delay_secs;
+        if ( millis() - lastRefresh >= EEPROMData.status_delay_msec )
+        {
+            lastRefresh = millis();
+
+            // fields first: it refreshes the pin states used for link state
+            redrawn = statusUpdateFields(shadow);
+            redrawn += statusUpdateActivity(&lastInterval);
+
+            if ( redrawn )
+            {
+                // park cursor after the exit prompt
+                CURSOR(24, 54);
+                console_endResponse();
+            }
+        }
     }
 
     return(0);
@@ -505,30 +802,42 @@ int statusCmd(int arg)
   */
 const char *getPinName(int pinNo)
 {
-    for ( int i = 0; i < static_pin_count; i++ )
-    {
-        if ( pinNo == staticPins[i].pinNo )
-            return(staticPins[i].name);
-    }
+    int8_t          index = getPinIndex(pinNo);
+
+    if ( index < 0 )
+        return("Unknown");
+
+    return(staticPins[index].name);
+}
+
+/**
+  * @name   getPinActiveState
+  * @brief  get active state of pin
+  * @param  Arduino pin number
+  * @retval ACT_LO, ACT_HI or ACT_UNDEF if pin is not in table
+  */
+ACTIVE_STATE getPinActiveState(uint8_t pinNo)
+{
+    int8_t          index = getPinIndex(pinNo);
+
+    if ( index < 0 )
+        return(ACT_UNDEF);
 
-    return("Unknown");
+    return(staticPins[index].activeState);
 }
 
 /**
   * @name   getPinIndex
   * @brief  get index into static/dynamic pin arrays
   * @param  Arduino pin number
-  * @retval None
+  * @retval index into staticPins[] or -1 if pin is not in table
   */
 int8_t getPinIndex(uint8_t pinNo)
 {
-    for ( int i = 0; i < static_pin_count; i++ )
-    {
-        if ( staticPins[i].pinNo == pinNo )
-            return(i);
-    }
+    if ( pinNo >= PINS_COUNT )
+        return(-1);
 
-    return(-1);
+    return(pinIndexMap[pinNo]);
 }
 
 /**
@@ -540,10 +849,23 @@ int8_t getPinIndex(uint8_t pinNo)
 void set_help(void)
 {
     terminalOut((char *) "FLASH Parameters are:");
-    sprintf(outBfr, "  sdelay <integer> - status display delay in seconds; current: %d", EEPROMData.status_delay_secs);
+    sprintf(outBfr, "  sdelay <integer> - status display refresh in milliseconds; current: %d", EEPROMData.status_delay_msec);
     terminalOut(outBfr);
     sprintf(outBfr, "  pdelay <integer> - power up sequence delay in milliseconds; current: %d", EEPROMData.pwr_seq_delay_msec);
     terminalOut(outBfr);
+    sprintf(outBfr, "  sclk <integer>   - scan chain clock in Hz (%d..%d); current: %lu (actual %lu)", SCAN_CLK_MIN_HZ,
+            SCAN_CLK_MAX_HZ, EEPROMData.scan_clk_hz, scan_GetClock());
+    terminalOut(outBfr);
+    sprintf(outBfr, "  sedge <0|1>      - scan chain sample edge, 0 = falling, 1 = rising; current: %d", EEPROMData.scan_sample_edge);
+    terminalOut(outBfr);
+    sprintf(outBfr, "  ocpmain <mA>     - MAIN rail trip current, 0 = off (max %d); current: %d", PROTECT_MAX_MA,
+            EEPROMData.ocp_main_ma);
+    terminalOut(outBfr);
+    sprintf(outBfr, "  ocpaux <mA>      - AUX rail trip current, 0 = off (max %d); current: %d", PROTECT_MAX_MA,
+            EEPROMData.ocp_aux_ma);
+    terminalOut(outBfr);
+    sprintf(outBfr, "  tcrit <0|1>      - TEMP_CRIT turns off card power, 0 = off, 1 = on; current: %d", EEPROMData.tcrit_trip);
+    terminalOut(outBfr);
     terminalOut((char *) "'set <parameter> <value>' sets a parameter from list above to value");
     terminalOut((char *) "  value can be <integer>, <string> or <float> depending on the parameter");
 
@@ -581,10 +903,10 @@ int setCmd(int argCnt)
     if ( strcmp(parameter, "sdelay") == 0 )
     {
         iValue = valueEntered.toInt();
-        if (EEPROMData.status_delay_secs != iValue )
+        if (EEPROMData.status_delay_msec != iValue )
         {
           isDirty = true;
-          EEPROMData.status_delay_secs = iValue;
+          EEPROMData.status_delay_msec = iValue;
         }
     }
     else if ( strcmp(parameter, "pdelay") == 0 )
@@ -596,6 +918,81 @@ int setCmd(int argCnt)
           EEPROMData.pwr_seq_delay_msec = iValue;
         }
     }
+    else if ( strcmp(parameter, "sclk") == 0 )
+    {
+        iValue = valueEntered.toInt();
+        if ( iValue < SCAN_CLK_MIN_HZ || iValue > SCAN_CLK_MAX_HZ )
+        {
+            terminalOut((char *) "Invalid scan clock rate");
+            set_help();
+            return(1);
+        }
+
+        if ( EEPROMData.scan_clk_hz != (uint32_t) iValue )
+        {
+          isDirty = true;
+          EEPROMData.scan_clk_hz = iValue;
+        }
+
+        sprintf(outBfr, "Scan clock set to %lu Hz", scan_SetClock(EEPROMData.scan_clk_hz));
+        terminalOut(outBfr);
+    }
+    else if ( strcmp(parameter, "sedge") == 0 )
+    {
+        iValue = valueEntered.toInt();
+        if ( (iValue != SCAN_EDGE_FALLING && iValue != SCAN_EDGE_RISING) || valueEntered.length() != 1 )
+        {
+            terminalOut((char *) "Invalid scan sample edge");
+            set_help();
+            return(1);
+        }
+
+        if ( EEPROMData.scan_sample_edge != iValue )
+        {
+          isDirty = true;
+          EEPROMData.scan_sample_edge = iValue;
+        }
+
+        scan_SetSampleEdge(EEPROMData.scan_sample_edge);
+    }
+    else if ( strcmp(parameter, "ocpmain") == 0 || strcmp(parameter, "ocpaux") == 0 )
+    {
+        uint16_t    *limit = (strcmp(parameter, "ocpmain") == 0) ? &EEPROMData.ocp_main_ma : &EEPROMData.ocp_aux_ma;
+
+        iValue = valueEntered.toInt();
+        if ( iValue < 0 || iValue > PROTECT_MAX_MA || (iValue == 0 && valueEntered != "0") )
+        {
+            terminalOut((char *) "Invalid trip current");
+            set_help();
+            return(1);
+        }
+
+        if ( *limit != iValue )
+        {
+          isDirty = true;
+          *limit = iValue;
+        }
+
+        protect_Configure();
+    }
+    else if ( strcmp(parameter, "tcrit") == 0 )
+    {
+        iValue = valueEntered.toInt();
+        if ( (iValue != 0 && iValue != 1) || valueEntered.length() != 1 )
+        {
+            terminalOut((char *) "Invalid TEMP_CRIT trip setting");
+            set_help();
+            return(1);
+        }
+
+        if ( EEPROMData.tcrit_trip != iValue )
+        {
+          isDirty = true;
+          EEPROMData.tcrit_trip = iValue;
+        }
+
+        protect_Configure();
+    }
     else
     {
         terminalOut((char *) "Invalid parameter name");
@@ -612,40 +1009,81 @@ int setCmd(int argCnt)
 
 /**
   * @name   queryScanChain
-  * @brief  extract info from scan chain output
+  * @brief  capture scan chain and decode it
   * @param  displayResults  true to display results, else false
-  * @retval uint32_t    32 bits of scan chain data received
+  * @retval uint32_t    first 32 bits of scan chain data, byte 0 in bits 31..24
+  * @note   chain length is chosen by SCAN_VER[1:0] or 'scan len'
   */
 uint32_t queryScanChain(bool displayResults)
 {
-    uint8_t             shift = 31;
-    char                *s = outBfr;
-    const char          fmt[] = "%-20s ... %d    ";
-    unsigned            i = 0;
+    const scan_chain_t  *chain = scan_GetChain();
+    uint8_t             data[SCAN_MAX_BYTES];
+    uint32_t            first32 = 0;
+    uint16_t            bit;
+    TxLine              line;
+
+    memset(data, 0, sizeof(data));
 
-    timers_scanChainCapture();
+    if ( scan_CaptureChain(data, chain->bytes) == false )
+    {
+        if ( displayResults )
+            terminalOut((char *) "Scan chain transfer failed");
+
+        return(0);
+    }
+
+    for ( int i = 0; i < 4; i++ )
+        first32 = (first32 << 8) | data[i];
 
     if ( displayResults == false )
-        return(scanShiftRegister_0);
+        return(first32);
 
-    sprintf(outBfr, "scan chain shift register 0: %08X", (unsigned int) scanShiftRegister_0);
-    terminalOut(outBfr);
+    line << "Scan chain SCAN_VER " << txDec(chain->scanVer) << " (" << chain->desc << "), " << txDec(chain->bytes)
+         << " bytes:";
+    for ( int i = 0; i < chain->bytes; i++ )
+        line << ' ' << txHex<2>(data[i]);
+    line.end();
 
-    // WARNING: This code below expects the entries in scanBitNames[] to be in order order 31..0
-    // to align with incoming shifted left bits from SCAN_DATA_IN
-    while ( i < 32 )
+    // byte 0, two per line high bit first as on the card's scan chain
+    for ( int i = 7; i >= 0; i -= 2 )
     {
-        sprintf(s, fmt, scanBitNames[i++].bitName, (scanShiftRegister_0 & (1 << shift--)) ? 1 : 0);
-        s += 30;
-        sprintf(s, fmt, scanBitNames[i++].bitName, (scanShiftRegister_0 & (1 << shift--)) ? 1 : 0);
-        s += 30;
-        *s = 0;
+        line << "0." << txDec(i) << ' ' << txStr<16>(scanByte0Names[i]) << " ... " << txDec(scan_GetBit(data, i))
+             << "    0." << txDec(i - 1) << ' ' << txStr<16>(scanByte0Names[i - 1]) << " ... "
+             << txDec(scan_GetBit(data, i - 1));
+        line.end();
+    }
 
-        terminalOut(outBfr);
-        s = outBfr;
+    line << "Port";
+    for ( int f = 0; f < SCAN_PORT_BITS; f++ )
+        line << "  " << txStr<10>(scanPortFieldNames[f]);
+    line.end();
+
+    for ( int port = 0; port < chain->ports; port++ )
+    {
+        line << " P" << txDec(port) << ' ';
+        for ( int f = 0; f < SCAN_PORT_BITS; f++ )
+        {
+            bit = SCAN_PORT_BASE + (port * SCAN_PORT_BITS) + f;
+            line << "  " << txDec(scan_GetBit(data, bit)) << " (" << txDec(bit >> 3) << '.' << txDec(bit & 7) << ")    ";
+        }
+        line.end();
     }
 
-    return(scanShiftRegister_0);
+    // bits past the last port field, raw
+    bit = SCAN_PORT_BASE + (chain->ports * SCAN_PORT_BITS);
+    if ( bit < chain->bytes * 8 )
+    {
+        line << "Undecoded bits " << txDec(bit >> 3) << '.' << txDec(bit & 7) << ".." << txDec(chain->bytes - 1) << ".7:";
+        for ( ; bit < chain->bytes * 8; bit++ )
+        {
+            if ( (bit & 7) == 0 )
+                line << ' ';
+            line << txDec(scan_GetBit(data, bit));
+        }
+        line.end();
+    }
+
+    return(first32);
     
 } // queryScanChain()
 
@@ -661,14 +1099,20 @@ static void pwrCmdHelp(void)
     terminalOut((char *) "  'power status' requires no argument and shows the power status of NIC card");
     terminalOut((char *) "  main = MAIN_EN to NIC card; aux = AUX_EN to NIC card; ");
     terminalOut((char *) "  card = MAIN_EN=1 then pdelay msecs then AUX_EN=1; see 'set' command for pdelay");
+    terminalOut((char *) "  'power up card stream' also dumps the rail current captured during power up");
+    terminalOut((char *) "  'power inrush [stream]' shows the capture from the last 'power up card'");
+    terminalOut((char *) "  'power stats [reset]' shows MAIN/AUX rail V, mA and W from the INA219 monitors");
+    terminalOut((char *) "  'power energy [start | stop | reset]' integrates rail energy over a test window");
+    terminalOut((char *) "  'power protect [clear]' shows or clears the over-current/TEMP_CRIT trip");
 }
 
 /**
   * @name   pwrCmd
   * @brief  Control AUX and MAIN power to NIC 3.0 board
   * @param  argCnt  number of arguments
-  * @param  tokens[1]  up, down or status
+  * @param  tokens[1]  up, down, status, stats, energy, inrush or protect
   * @param  tokens[2]   main, aux or card
+  * @param  tokens[3]   optional 'stream' after 'up card'
   * @retval 0   OK
   * @retval 1   error
   * @note   Delay is changed with 'set pdelay <msec>'
@@ -678,9 +1122,15 @@ int pwrCmd(int argCnt)
 {
     int             rc = 0;
     bool            isPowered = false;
-    uint8_t         mainPin = readPin(OCP_MAIN_PWR_EN);
-    uint8_t         auxPin = readPin(OCP_AUX_PWR_EN);
-    uint8_t         pwrGoodPin = readPin(NIC_PWR_GOOD_JMP);
+    uint8_t         mainPin;
+    uint8_t         auxPin;
+    uint8_t         pwrGoodPin;
+
+    // a trip clears the enables behind pinStates[]' back
+    protect_Service();
+    mainPin = readPin(OCP_MAIN_PWR_EN);
+    auxPin = readPin(OCP_AUX_PWR_EN);
+    pwrGoodPin = readPin(NIC_PWR_GOOD_JMP);
 
     if ( argCnt == 0 )
     {
@@ -688,6 +1138,16 @@ int pwrCmd(int argCnt)
         return(1);
     }
 
+    // rail telemetry works with or without a card
+    if ( strcmp(tokens[1], "stats") == 0 )
+        return(powerStatsCmd(argCnt));
+    else if ( strcmp(tokens[1], "energy") == 0 )
+        return(powerEnergyCmd(argCnt));
+    else if ( strcmp(tokens[1], "inrush") == 0 )
+        return(powerInrushCmd(argCnt));
+    else if ( strcmp(tokens[1], "protect") == 0 )
+        return(powerProtectCmd(argCnt));
+
     if ( isCardPresent() == false )
     {
         terminalOut((char *) "NIC card is not present; no power info available");
@@ -712,6 +1172,15 @@ int pwrCmd(int argCnt)
             return(1);
         }
     }
+    else if ( argCnt == 3 )
+    {
+        if ( strcmp(tokens[1], "up") != 0 || strcmp(tokens[2], "card") != 0 || strcmp(tokens[3], "stream") != 0 )
+        {
+            terminalOut((char *) "Incorrect number of command arguments");
+            pwrCmdHelp();
+            return(1);
+        }
+    }
     else if ( argCnt != 2 )
     {
         terminalOut((char *) "Incorrect number of command arguments");
@@ -721,19 +1190,21 @@ int pwrCmd(int argCnt)
 
     if ( strcmp(tokens[1], "up") == 0 )
     {
+        if ( protect_Tripped() )
+        {
+            terminalOut((char *) "Power protection has tripped; see 'power protect', then 'power protect clear'");
+            return(1);
+        }
+
         if ( strcmp(tokens[2], "card") == 0 )
         {
             if ( isPowered == false )
             {
                 sprintf(outBfr, "Starting NIC power up sequence, delay = %d msec", EEPROMData.pwr_seq_delay_msec);
                 SHOW();
-                writePin(OCP_MAIN_PWR_EN, 1);
-                delay(EEPROMData.pwr_seq_delay_msec);
-                writePin(OCP_AUX_PWR_EN, 1);
 
-                // NIC card takes a bit of time to power up
-                delay(50);
-                if ( readPin(NIC_PWR_GOOD_JMP) )
+                // sequences MAIN_EN/AUX_EN and waits for NIC_PWR_GOOD while capturing rail current
+                if ( inrush_PowerUp(argCnt == 3) )
                     terminalOut((char *) "Power up sequence complete");
                 else
                 {
@@ -743,7 +1214,6 @@ int pwrCmd(int argCnt)
 
                 terminalOut((char *) "Waiting for scan chain data...");
                 delay(2000);
-                queryScanChain(false);
                 queryScanChain(true);
 
             }
@@ -871,15 +1341,13 @@ int versCmd(int arg)
   */
 bool isCardPresent(void)
 {
-    uint8_t         present = readPin(OCP_PRSNTB0_N);
+    pin_snapshot_t      snap;
 
-    present |= (readPin(OCP_PRSNTB1_N) << 1);
-    present |= (readPin(OCP_PRSNTB2_N) << 2);
-    present |= (readPin(OCP_PRSNTB3_N) << 3);
+    pinSnapshotRead(&snap);
 
-    if ( present == 0xF )
+    if ( (snap.in[0] & prsntMask[0]) == prsntMask[0] && (snap.in[1] & prsntMask[1]) == prsntMask[1] )
         return(false);
-    
+
     return(true);
 }
 
@@ -887,11 +1355,44 @@ bool isCardPresent(void)
 /**
   * @name   scanCmd
   * @brief  implement scan command
-  * @param  argCnt  not used
+  * @param  argCnt  number of arguments
+  * @param  tokens[1]  'len' to set chain length, 'mon' for monitor or 'tune' for clock sweep
+  * @param  tokens[2]  chain length in bytes or 'auto' for SCAN_VER[1:0]
   * @retval int 0=OK, 1=error
   */
 int scanCmd(int argCnt)
 {
+    int         bytes;
+
+    if ( argCnt >= 1 && strcmp(tokens[1], "mon") == 0 )
+    {
+        return(scanmonCmd(argCnt));
+    }
+    else if ( argCnt >= 1 && strcmp(tokens[1], "tune") == 0 )
+    {
+        return(scantuneCmd(argCnt));
+    }
+    else if ( argCnt == 2 && strcmp(tokens[1], "len") == 0 )
+    {
+        bytes = (strcmp(tokens[2], "auto") == 0) ? 0 : atoi(tokens[2]);
+
+        if ( bytes < 0 || bytes > SCAN_MAX_BYTES || (bytes == 0 && strcmp(tokens[2], "auto") != 0) )
+        {
+            sprintf(outBfr, "Chain length must be 1..%d bytes or 'auto'", SCAN_MAX_BYTES);
+            terminalOut(outBfr);
+            return(1);
+        }
+
+        scan_SetLength(bytes);
+        terminalOut((char *) (bytes ? "Scan chain length set" : "Scan chain length set by SCAN_VER[1:0]"));
+        return(0);
+    }
+    else if ( argCnt != 0 )
+    {
+        showCommandHelp(tokens[0]);
+        return(1);
+    }
+
     if ( isCardPresent() )
     {
         queryScanChain(true);
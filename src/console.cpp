@@ -0,0 +1,342 @@
+//===================================================================
+// console.cpp
+// Buffered console output.  All terminal output is copied into a
+// TX ring buffer and returns immediately; the USB ISR drains the
+// ring into the CDC IN endpoint (see consoleTxService() in
+// USBCore.cpp) on every start-of-frame and transfer complete.
+// Replaces the flush()/delay() pairs that were used to work around
+// missing characters on the USB-serial connection.
+//
+// Output is coalesced into full 64-byte packets.  A short packet is
+// only sent once the writer has been idle for CONSOLE_TX_IDLE_FRAMES
+// or console_endResponse() is called, and a transfer that ends
+// exactly on a packet boundary is closed with a zero length packet.
+//===================================================================
+#include <Arduino.h>
+#include "main.hpp"
+#include "console.hpp"
+
+#define TX_RING_MASK            (CONSOLE_TX_BFR_SIZE - 1)
+
+#if (CONSOLE_TX_BFR_SIZE & TX_RING_MASK) != 0
+#error CONSOLE_TX_BFR_SIZE must be a power of 2
+#endif
+
+// head is only written by thread context, tail only by USB ISR; both
+// are free-running so (head - tail) is the number of bytes pending
+static uint8_t              txRing[CONSOLE_TX_BFR_SIZE];
+static volatile uint32_t    txHead = 0;
+static volatile uint32_t    txTail = 0;
+static bool                 txBlocked = false;
+static volatile bool        txFlushReq = false;         // end of response, send partial packet
+static volatile uint8_t     txIdleFrames = 0;           // frames since last write
+static bool                 txLastFull = false;         // last packet was 64 bytes, ZLP may be owed
+static console_stats_t      txStats;
+
+/**
+  * @name   console_txPending
+  * @brief  number of bytes waiting to be sent
+  * @param  None
+  * @retval uint32_t  byte count
+  */
+uint32_t console_txPending(void)
+{
+    return(txHead - txTail);
+}
+
+/**
+  * @name   waitForSpace
+  * @brief  backpressure: wait for the USB ISR to free ring space
+  * @param  need  bytes of space wanted
+  * @retval bool  true if space is available, false if output should be dropped
+  * @note   once a wait times out (terminal closed, host not reading) output is
+  *         dropped without waiting until the host starts draining again
+  */
+static bool waitForSpace(uint32_t need)
+{
+    uint32_t        start = millis();
+
+    if ( txBlocked || USBDevice.configured() == false )
+        return(false);
+
+    txStats.stalls++;
+
+    while ( CONSOLE_TX_BFR_SIZE - console_txPending() < need )
+    {
+        console_txKick();
+
+        if ( millis() - start >= CONSOLE_TX_TIMEOUT_MS )
+        {
+            txBlocked = true;
+            return(false);
+        }
+    }
+
+    return(true);
+}
+
+/**
+  * @name   console_write
+  * @brief  queue bytes for output to terminal
+  * @param  s pointer to data
+  * @param  len number of bytes
+  * @retval None
+  * @note   thread context only, do not call from an ISR
+  */
+void console_write(const char *s, uint32_t len)
+{
+    uint32_t        space;
+    uint32_t        chunk;
+    uint32_t        offset;
+
+    while ( len > 0 )
+    {
+        space = CONSOLE_TX_BFR_SIZE - console_txPending();
+
+        if ( space == 0 )
+        {
+            if ( waitForSpace(1) == false )
+            {
+                txStats.dropped += len;
+                return;
+            }
+
+            continue;
+        }
+
+        txBlocked = false;
+        chunk = (len < space) ? len : space;
+        offset = txHead & TX_RING_MASK;
+
+        // copy with wrap at end of ring
+        if ( offset + chunk > CONSOLE_TX_BFR_SIZE )
+        {
+            uint32_t    first = CONSOLE_TX_BFR_SIZE - offset;
+
+            memcpy(&txRing[offset], s, first);
+            memcpy(&txRing[0], s + first, chunk - first);
+        }
+        else
+        {
+            memcpy(&txRing[offset], s, chunk);
+        }
+
+        for ( uint32_t i = 0; i < chunk; i++ )
+        {
+            if ( s[i] == '\n' )
+                txStats.lines++;
+        }
+
+        // data must be in the ring before the ISR can see the new head
+        __DMB();
+        txHead += chunk;
+        txIdleFrames = 0;
+
+        txStats.bytes += chunk;
+        s += chunk;
+        len -= chunk;
+    }
+
+    console_txKick();
+}
+
+/**
+  * @name   console_txClaim
+  * @brief  get ring space to format into directly
+  * @param  len  bytes wanted
+  * @retval char *  contiguous space for len bytes, NULL if the ring
+  *         wraps within len bytes or output is being dropped
+  * @note   nothing is sent until console_txCommit(); no other console
+  *         output may be written in between
+  */
+char *console_txClaim(uint32_t len)
+{
+    uint32_t        offset = txHead & TX_RING_MASK;
+
+    if ( offset + len > CONSOLE_TX_BFR_SIZE )
+        return(NULL);
+
+    if ( CONSOLE_TX_BFR_SIZE - console_txPending() < len && waitForSpace(len) == false )
+        return(NULL);
+
+    txBlocked = false;
+    return((char *) &txRing[offset]);
+}
+
+/**
+  * @name   console_txCommit
+  * @brief  queue bytes written to the space from console_txClaim()
+  * @param  len  bytes written, <= the length claimed
+  * @retval None
+  */
+void console_txCommit(uint32_t len)
+{
+    const uint8_t   *p = &txRing[txHead & TX_RING_MASK];
+
+    for ( uint32_t i = 0; i < len; i++ )
+    {
+        if ( p[i] == '\n' )
+            txStats.lines++;
+    }
+
+    __DMB();
+    txHead += len;
+    txIdleFrames = 0;
+    txStats.bytes += len;
+
+    console_txKick();
+}
+
+/**
+  * @name   console_puts
+  * @brief  queue string for output to terminal
+  * @param  s null terminated string
+  * @retval None
+  */
+void console_puts(const char *s)
+{
+    console_write(s, strlen(s));
+}
+
+/**
+  * @name   console_putc
+  * @brief  queue single char for output to terminal
+  * @param  c char to output
+  * @retval None
+  */
+void console_putc(char c)
+{
+    console_write(&c, 1);
+}
+
+/**
+  * @name   console_flush
+  * @brief  wait for all queued output to be handed to USB
+  * @param  timeoutMs max time to wait
+  * @retval bool  true if ring is empty
+  */
+bool console_flush(uint32_t timeoutMs)
+{
+    uint32_t        start = millis();
+
+    console_endResponse();
+
+    while ( console_txPending() )
+    {
+        if ( USBDevice.configured() == false || millis() - start >= timeoutMs )
+            return(false);
+
+        console_txKick();
+    }
+
+    return(true);
+}
+
+/**
+  * @name   console_endResponse
+  * @brief  mark end of a response so a partial packet is sent now
+  * @param  None
+  * @retval None
+  * @note   also reached via SerialUSB.flush()
+  */
+void console_endResponse(void)
+{
+    txFlushReq = true;
+    console_txKick();
+}
+
+/**
+  * @name   console_txTick
+  * @brief  USB start-of-frame tick for the idle timer
+  * @param  None
+  * @retval None
+  * @note   USB ISR context
+  */
+void console_txTick(void)
+{
+    if ( txIdleFrames < 0xFF )
+        txIdleFrames++;
+}
+
+/**
+  * @name   console_txPop
+  * @brief  remove next packet from ring for transmission
+  * @param  dest  USB endpoint buffer
+  * @param  maxLen  max bytes to copy (endpoint size)
+  * @param  zlp  set true if a zero length packet must be sent
+  * @retval uint32_t  bytes copied, 0 if nothing to send yet
+  * @note   USB ISR context (or thread context with USB IRQ masked)
+  */
+uint32_t console_txPop(uint8_t *dest, uint32_t maxLen, bool *zlp)
+{
+    uint32_t        count = console_txPending();
+    uint32_t        offset = txTail & TX_RING_MASK;
+    bool            canEnd = txFlushReq || (txIdleFrames >= CONSOLE_TX_IDLE_FRAMES);
+
+    *zlp = false;
+
+    if ( count >= maxLen )
+    {
+        count = maxLen;
+    }
+    else if ( count == 0 || canEnd == false )
+    {
+        // hold a partial packet until the writer is done; when the ring is
+        // empty close a transfer that ended on a packet boundary with a ZLP
+        if ( count == 0 && canEnd )
+        {
+            if ( txLastFull )
+            {
+                *zlp = true;
+                txStats.zlps++;
+            }
+
+            txLastFull = false;
+            txFlushReq = false;
+        }
+
+        return(0);
+    }
+
+    for ( uint32_t i = 0; i < count; i++ )
+    {
+        *dest++ = txRing[offset];
+        offset = (offset + 1) & TX_RING_MASK;
+    }
+
+    txTail += count;
+    txStats.packets++;
+    txLastFull = (count == maxLen);
+
+    if ( txLastFull == false )
+        txStats.shortPackets++;
+
+    return(count);
+}
+
+/**
+  * @name   console_getStats
+  * @brief  get copy of console output counters
+  * @param  stats  pointer to struct to fill
+  * @retval None
+  */
+void console_getStats(console_stats_t *stats)
+{
+    NVIC_DisableIRQ(USB_IRQn);
+    *stats = txStats;
+    NVIC_EnableIRQ(USB_IRQn);
+}
+
+/**
+  * @name   console_resetStats
+  * @brief  zero console output counters
+  * @param  None
+  * @retval None
+  */
+void console_resetStats(void)
+{
+    NVIC_DisableIRQ(USB_IRQn);
+    memset((void *) &txStats, 0, sizeof(console_stats_t));
+    txStats.startTime = millis();
+    NVIC_EnableIRQ(USB_IRQn);
+}
@@ -4,13 +4,21 @@
 //===================================================================
 #include <Arduino.h>
 #include "main.hpp"
-#include "Wire.h"
 #include "eeprom.hpp"
+#include "console.hpp"
+#include "scan.hpp"
+#include "timers.hpp"
+#include "i2cq.hpp"
 
 extern uint8_t          eepromAddresses[];
 extern EEPROM_data_t    EEPROMData;
 static char             outBfr[OUTBFR_SIZE];
 extern char             *tokens[];
+extern volatile uint32_t scanShiftRegister_0;
+
+// 7 bit addresses probed by 'xdebug scan', reserved ones excluded
+#define I2C_SCAN_FIRST          8
+#define I2C_SCAN_LAST           119
 
 // --------------------------------------------
 // dumpMem() - debug utility to dump memory
@@ -63,56 +71,127 @@ void dumpMem(unsigned char *s, int len)
 
 } // dumpMem()
 
+// --------------------------------------------
+// scanLines() - SDA/SCL levels as text
+// --------------------------------------------
+static const char *scanLines(uint8_t lines)
+{
+  if ( (lines & I2CQ_LINE_SDA) == 0 && (lines & I2CQ_LINE_SCL) == 0 )
+    return("SDA and SCL low");
+  else if ( (lines & I2CQ_LINE_SDA) == 0 )
+    return("SDA low");
+  else if ( (lines & I2CQ_LINE_SCL) == 0 )
+    return("SCL low");
+
+  return("idle");
+}
+
 // --------------------------------------------
 // debug_scan() - I2C bus scanner
 //
 // While not associated with the board function,
 // this was developed in order to locate the
 // temp sensor. Left in for future use.
+//
+// Each address gets one address-only probe
+// through the I2C queue, which times out on
+// its own and clocks a stuck bus free, so a
+// card holding SDA low can't hang the scan.
+// Results are printed after the probes so the
+// scan time is bus time only.
 // --------------------------------------------
 void debug_scan(void)
 {
-  byte        count = 0;
-  int         scanCount = 0;
-  uint32_t    startTime = millis();
-  const char        *s;
+  uint8_t       found[I2C_SCAN_LAST - I2C_SCAN_FIRST + 1];
+  byte          count = 0;
+  int           scanCount = 0;
+  uint32_t      timeouts = 0;
+  uint32_t      busErrors = 0;
+  uint32_t      startTime;
+  uint32_t      elapsed;
+  uint8_t       lines;
+  i2cq_stats_t  before;
+  i2cq_stats_t  after;
+  I2CQ_STATUS   status;
+  const char    *s;
 
   terminalOut ((char *) "Scanning I2C bus...");
+  i2cq_getStats(&before);
+
+  lines = i2cq_BusLines();
+  if ( lines != (I2CQ_LINE_SDA | I2CQ_LINE_SCL) )
+  {
+    sprintf(outBfr, "Bus stuck before scan (%s), recovering", scanLines(lines));
+    terminalOut(outBfr);
+
+    if ( i2cq_Recover() == false )
+    {
+      sprintf(outBfr, "Recovery failed, %s; scan not run", scanLines(i2cq_BusLines()));
+      terminalOut(outBfr);
+      return;
+    }
+  }
+
+  startTime = micros();
 
-  for (byte i = 8; i < 120; i++)
+  for (byte i = I2C_SCAN_FIRST; i <= I2C_SCAN_LAST; i++)
   {
     scanCount++;
-    Wire.beginTransmission(i);
-    if (Wire.endTransmission() == 0)
+    status = i2cq_Transfer(i, NULL, 0, NULL, 0, 0);
+
+    if ( status == I2CQ_OK )
+      found[count++] = i;
+    else if ( status == I2CQ_TIMEOUT )
+      timeouts++;
+    else if ( status == I2CQ_BUSERR )
+      busErrors++;
+
+    // queue already tried the 9-clock recovery, no point going on
+    if ( i2cq_BusLines() != (I2CQ_LINE_SDA | I2CQ_LINE_SCL) )
+    {
+      sprintf(outBfr, "Bus stuck at address 0x%02X (%s), scan stopped", i, scanLines(i2cq_BusLines()));
+      terminalOut(outBfr);
+      break;
+    }
+  }
+
+  elapsed = micros() - startTime;
+
+  for ( int n = 0; n < count; n++ )
+  {
+    if ( found[n] == 0x40 )
+      s = "U2 INA219";
+    else if ( found[n] == 0x41 )
+      s = "U3 INA219";
+    else
     {
-      if ( i == 0x40 )
-        s = "U2 INA219";
-      else if ( i == 0x41 )
-        s = "U3 INA219";
-      else
+      s = "Unknown device";
+      for ( int j = 0; j < 4; j++ )
       {
-        s = "Unknown device";
-        for ( int j = 0; j < 4; j++ )
+        if ( eepromAddresses[j] == found[n] )
         {
-
-            if ( eepromAddresses[j] == i )
-            {
-                s = "FRU EEPROM";
-                break;
-            }
+          s = "FRU EEPROM";
+          break;
         }
       }
+    }
 
-      sprintf(outBfr, "Found device at address %d 0x%2X %s ", i, i, s);
-      terminalOut(outBfr);
-      count++;
-      delay(10);  
-    } 
-  } 
+    sprintf(outBfr, "Found device at address %d 0x%02X %s", found[n], found[n], s);
+    terminalOut(outBfr);
+  }
 
-  sprintf(outBfr, "Scan complete, %d addresses scanned in %lu ms", scanCount, millis() - startTime);
+  sprintf(outBfr, "Scan complete, %d addresses scanned in %lu.%03lu ms", scanCount, elapsed / 1000, elapsed % 1000);
   terminalOut(outBfr);
 
+  i2cq_getStats(&after);
+  if ( timeouts || busErrors || after.recoveries != before.recoveries )
+  {
+    sprintf(outBfr, "Bus faults: %lu timeouts, %lu bus errors, %lu recoveries (%lu failed, %lu SCL clocks)",
+            timeouts, busErrors, after.recoveries - before.recoveries, after.recoverFails - before.recoverFails,
+            after.recoverClocks - before.recoverClocks);
+    terminalOut(outBfr);
+  }
+
   if ( count )
   {
     sprintf(outBfr, "Found %d I2C device(s)", count);
@@ -143,20 +222,188 @@ void debug_dump_eeprom(void)
     terminalOut((char *) "FLASH Contents:");
     sprintf(outBfr, "Signature:                            %08X", (unsigned int) EEPROMData.sig);
     terminalOut(outBfr);
-    sprintf(outBfr, "sdelay - status refresh delay (secs): %d", EEPROMData.status_delay_secs);
+    sprintf(outBfr, "sdelay - status refresh delay (msec): %d", EEPROMData.status_delay_msec);
     SHOW();
     sprintf(outBfr, "pdelay - power delay (msec):          %d", EEPROMData.pwr_seq_delay_msec);
     SHOW();
+    sprintf(outBfr, "sclk   - scan chain clock (Hz):       %lu", EEPROMData.scan_clk_hz);
+    SHOW();
+    sprintf(outBfr, "sedge  - scan sample edge:            %s", EEPROMData.scan_sample_edge ? "rising" : "falling");
+    SHOW();
+    sprintf(outBfr, "ocpmain - MAIN trip current (mA):     %d%s", EEPROMData.ocp_main_ma, EEPROMData.ocp_main_ma ? "" : " (off)");
+    SHOW();
+    sprintf(outBfr, "ocpaux - AUX trip current (mA):       %d%s", EEPROMData.ocp_aux_ma, EEPROMData.ocp_aux_ma ? "" : " (off)");
+    SHOW();
+    sprintf(outBfr, "tcrit  - TEMP_CRIT power trip:        %s", EEPROMData.tcrit_trip ? "on" : "off");
+    SHOW();
 
     // TODO add more fields
 }
 
+// --------------------------------------------
+// debug_scancmp() - check SPI scan chain engine
+//
+// Captures the scan chain with the SERCOM SPI
+// engine and the original TC5 bit-bang ISR
+// back to back and reports any bit mismatch.
+// tokens[2] = optional number of passes
+// --------------------------------------------
+void debug_scancmp(int arg)
+{
+    int         passes = (arg >= 2) ? atoi(tokens[2]) : 10;
+    int         errors = 0;
+    uint32_t    spiData;
+    uint32_t    spiTime;
+    uint32_t    isrTime;
+
+    if ( passes <= 0 )
+        passes = 1;
+
+    for ( int i = 0; i < passes; i++ )
+    {
+        spiTime = micros();
+        if ( scan_Capture(0, &spiData) == false )
+        {
+            terminalOut((char *) "SPI scan chain transfer failed");
+            return;
+        }
+        spiTime = micros() - spiTime;
+
+        isrTime = micros();
+        if ( timers_scanChainCapture() == false )
+        {
+            terminalOut((char *) "TC5 scan chain capture timed out");
+            return;
+        }
+        isrTime = micros() - isrTime;
+
+        if ( spiData != scanShiftRegister_0 )
+        {
+            sprintf(outBfr, "Pass %d: SPI %08lX != ISR %08lX", i, spiData, scanShiftRegister_0);
+            terminalOut(outBfr);
+            errors++;
+        }
+    }
+
+    sprintf(outBfr, "%d passes, %d mismatches; last SPI %lu usec @ %lu Hz, ISR %lu usec",
+            passes, errors, spiTime, scan_GetClock(), isrTime);
+    terminalOut(outBfr);
+}
+
+// --------------------------------------------
+// debug_timers() - TC5 ISR cost and jitter
+//
+// Shows TC5 interrupt counters since last
+// reset. TC5 only runs during bit-bang scan
+// captures so 'idle' should stay at 0.
+// Costs are in CPU cycles; latency is from
+// compare match to ISR entry.
+// 'xdebug timers scan' runs one capture with
+// the non-blocking API and counts the polls
+// made while it was in flight.
+// --------------------------------------------
+void debug_timers(int arg)
+{
+    timers_stats_t      stats;
+    TIMERS_SCAN_STATE   state;
+    uint32_t            data = 0;
+    uint32_t            polls = 0;
+    uint32_t            startTime;
+
+    if ( arg == 2 && strcmp(tokens[2], "scan") == 0 )
+    {
+        startTime = micros();
+        if ( timers_scanStart(NULL) == false )
+        {
+            terminalOut((char *) "TC5 scan chain capture already in flight");
+            return;
+        }
+
+        while ( (state = timers_scanPoll(&data)) == TIMERS_SCAN_BUSY )
+            polls++;
+
+        sprintf(outBfr, "%s in %lu usec, %lu polls while in flight, data %08lX",
+                (state == TIMERS_SCAN_DONE) ? "Captured" : "Timed out", micros() - startTime, polls, data);
+        terminalOut(outBfr);
+        return;
+    }
+
+    timers_getStats(&stats);
+
+    sprintf(outBfr, "TC5 %s, last %lu ms: %lu interrupts, %lu idle, %lu captures, %lu timeouts",
+            timers_Running() ? "running" : "stopped", millis() - stats.startTime,
+            stats.calls, stats.idleCalls, stats.captures, stats.timeouts);
+    terminalOut(outBfr);
+    sprintf(outBfr, "  ISR cycles avg %lu max %lu  latency avg %lu max %lu",
+            (stats.calls) ? stats.cyclesTotal / stats.calls : 0, stats.cyclesMax,
+            (stats.calls) ? stats.latencyTotal / stats.calls : 0, stats.latencyMax);
+    terminalOut(outBfr);
+
+    timers_resetStats();
+}
+
+// --------------------------------------------
+// debug_console() - console output counters
+//
+// 'xdebug console' shows counters since last
+// reset; 'xdebug console test' writes a burst
+// of lines and reports the drain rate.
+// --------------------------------------------
+void debug_console(int arg)
+{
+    console_stats_t     stats;
+    uint32_t            elapsed;
+    uint32_t            startTime;
+
+    if ( arg == 2 && strcmp(tokens[2], "test") == 0 )
+    {
+        console_resetStats();
+        startTime = micros();
+
+        for ( int i = 0; i < 100; i++ )
+        {
+            sprintf(outBfr, "%03d ---------------------------------------------------------------------", i);
+            terminalOut(outBfr);
+        }
+
+        console_flush(1000);
+        elapsed = micros() - startTime;
+        console_getStats(&stats);
+
+        sprintf(outBfr, "%lu bytes in %lu usec = %lu bytes/sec", stats.bytes, elapsed,
+                (elapsed) ? (uint32_t) ((uint64_t) stats.bytes * 1000000 / elapsed) : 0);
+        terminalOut(outBfr);
+        return;
+    }
+
+    console_getStats(&stats);
+    elapsed = millis() - stats.startTime;
+
+    sprintf(outBfr, "Console output in last %lu ms:", elapsed);
+    terminalOut(outBfr);
+    sprintf(outBfr, "  bytes %lu  lines %lu  packets %lu  dropped %lu  stalls %lu",
+            stats.bytes, stats.lines, stats.packets, stats.dropped, stats.stalls);
+    terminalOut(outBfr);
+    sprintf(outBfr, "  short packets %lu  ZLPs %lu  avg packet %lu bytes", stats.shortPackets, stats.zlps,
+            (stats.packets) ? stats.bytes / stats.packets : 0);
+    terminalOut(outBfr);
+    sprintf(outBfr, "  average %lu bytes/sec  %lu lines/sec",
+            (elapsed) ? (uint32_t) ((uint64_t) stats.bytes * 1000 / elapsed) : 0,
+            (elapsed) ? (uint32_t) ((uint64_t) stats.lines * 1000 / elapsed) : 0);
+    terminalOut(outBfr);
+
+    console_resetStats();
+}
+
 static void debug_help(void)
 {
     terminalOut((char *) "xdebug subcommands are:");
-    terminalOut((char *) "\tscan ..... I2C bus scanner");
+    terminalOut((char *) "\tscan ..... I2C bus scanner with scan time and stuck-bus recovery");
     terminalOut((char *) "\treset .... Reset board, requires reconnection to serial");
     terminalOut((char *) "\tflash .... Dump FLASH-simulated EEPROM parameters");
+    terminalOut((char *) "\tconsole .. Console output counters; 'console test' measures throughput");
+    terminalOut((char *) "\tscancmp .. Compare SPI scan chain with TC5 bit-bang path; 'scancmp <count>'");
+    terminalOut((char *) "\ttimers ... TC5 ISR count, cost and jitter; 'timers scan' async capture");
 
     // add new command help here
     // NOTE: debug stuff is not part of CLI so
@@ -191,6 +438,12 @@ int debug(int arg)
       debug_reset();
     else if ( strcmp(tokens[1], "flash") == 0 )
       debug_dump_eeprom();
+    else if ( strcmp(tokens[1], "console") == 0 )
+      debug_console(arg);
+    else if ( strcmp(tokens[1], "scancmp") == 0 )
+      debug_scancmp(arg);
+    else if ( strcmp(tokens[1], "timers") == 0 )
+      debug_timers(arg);
     else
     {
       terminalOut((char *) "Invalid debug command");
@@ -0,0 +1,148 @@
+//===================================================================
+// dma.cpp
+// DMAC setup shared by all modules that use DMA.  The DMAC has one
+// descriptor table and one interrupt for all channels, so the tables
+// live here and DMAC_Handler() dispatches to per-channel callbacks.
+// Channel numbers are assigned in dma.hpp.
+//===================================================================
+#include <Arduino.h>
+#include "main.hpp"
+#include "dma.hpp"
+
+// first descriptor of each channel and the DMAC's write-back area,
+// both MUST be 16 byte aligned
+__attribute__((aligned(16))) DmacDescriptor   dmaDescriptors[DMA_CH_CNT];
+__attribute__((aligned(16))) DmacDescriptor   dmaWriteback[DMA_CH_CNT];
+
+static dma_callback_t       dmaCallbacks[DMA_CH_CNT];
+
+/**
+  * @name   dma_Init
+  * @brief  clock and enable the DMAC
+  * @param  None
+  * @retval None
+  */
+void dma_Init(void)
+{
+    memset(dmaDescriptors, 0, sizeof(dmaDescriptors));
+    memset(dmaWriteback, 0, sizeof(dmaWriteback));
+    memset(dmaCallbacks, 0, sizeof(dmaCallbacks));
+
+    PM->AHBMASK.reg |= PM_AHBMASK_DMAC;
+    PM->APBBMASK.reg |= PM_APBBMASK_DMAC;
+
+    DMAC->CTRL.reg = 0;
+    DMAC->CTRL.reg = DMAC_CTRL_SWRST;
+    while (DMAC->CTRL.bit.SWRST);
+
+    DMAC->BASEADDR.reg = (uint32_t) dmaDescriptors;
+    DMAC->WRBADDR.reg = (uint32_t) dmaWriteback;
+    DMAC->CTRL.reg = DMAC_CTRL_DMAENABLE | DMAC_CTRL_LVLEN(0xF);
+
+    NVIC_DisableIRQ(DMAC_IRQn);
+    NVIC_ClearPendingIRQ(DMAC_IRQn);
+    NVIC_SetPriority(DMAC_IRQn, 1);
+    NVIC_EnableIRQ(DMAC_IRQn);
+}
+
+/**
+  * @name   dma_setCallback
+  * @brief  set function called on channel interrupt
+  * @param  ch  channel
+  * @param  func  callback or NULL
+  * @retval None
+  */
+void dma_setCallback(uint8_t ch, dma_callback_t func)
+{
+    if ( ch < DMA_CH_CNT )
+        dmaCallbacks[ch] = func;
+}
+
+/**
+  * @name   dma_channelConfig
+  * @brief  reset channel and set trigger/event/interrupt config
+  * @param  ch  channel
+  * @param  chctrlb  CHCTRLB value (trigger source, action, event input)
+  * @param  intenset  CHINTENSET bits
+  * @retval None
+  * @note   descriptor dmaDescriptors[ch] must be set up before enabling;
+  *         may be called from a DMA callback
+  */
+void dma_channelConfig(uint8_t ch, uint32_t chctrlb, uint8_t intenset)
+{
+    uint32_t        primask = __get_PRIMASK();
+
+    // CHID selects the channel for all CHxxx registers; DMAC_Handler
+    // restores it so thread code can't be corrupted by the ISR
+    __disable_irq();
+    DMAC->CHID.reg = DMAC_CHID_ID(ch);
+    DMAC->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+    DMAC->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+    while (DMAC->CHCTRLA.bit.SWRST);
+    DMAC->CHCTRLB.reg = chctrlb;
+    DMAC->CHINTFLAG.reg = DMAC_CHINTFLAG_MASK;
+    DMAC->CHINTENCLR.reg = DMAC_CHINTENCLR_MASK;
+    DMAC->CHINTENSET.reg = intenset;
+    __set_PRIMASK(primask);
+}
+
+/**
+  * @name   dma_channelEnable
+  * @brief  start channel, first transfer waits for its trigger
+  * @param  ch  channel
+  * @retval None
+  * @note   may be called from a DMA callback
+  */
+void dma_channelEnable(uint8_t ch)
+{
+    uint32_t        primask = __get_PRIMASK();
+
+    __disable_irq();
+    DMAC->CHID.reg = DMAC_CHID_ID(ch);
+    DMAC->CHCTRLA.reg |= DMAC_CHCTRLA_ENABLE;
+    __set_PRIMASK(primask);
+}
+
+/**
+  * @name   dma_channelDisable
+  * @brief  stop channel
+  * @param  ch  channel
+  * @retval None
+  * @note   may be called from a DMA callback
+  */
+void dma_channelDisable(uint8_t ch)
+{
+    uint32_t        primask = __get_PRIMASK();
+
+    __disable_irq();
+    DMAC->CHID.reg = DMAC_CHID_ID(ch);
+    DMAC->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+    while (DMAC->CHCTRLA.bit.ENABLE);
+    __set_PRIMASK(primask);
+}
+
+/**
+  * @name   DMAC_Handler
+  * @brief  DMAC ISR: dispatch channel interrupts to callbacks
+  * @param  None
+  * @retval None
+  */
+void DMAC_Handler(void)
+{
+    uint8_t         savedId = DMAC->CHID.reg;
+    uint8_t         ch;
+    uint8_t         flags;
+
+    while ( DMAC->INTSTATUS.reg )
+    {
+        ch = DMAC->INTPEND.bit.ID;
+        DMAC->CHID.reg = DMAC_CHID_ID(ch);
+        flags = DMAC->CHINTFLAG.reg;
+        DMAC->CHINTFLAG.reg = flags;
+
+        if ( ch < DMA_CH_CNT && dmaCallbacks[ch] != NULL )
+            (dmaCallbacks[ch]) (ch, flags);
+    }
+
+    DMAC->CHID.reg = savedId;
+}
@@ -4,206 +4,543 @@
 //===================================================================
 #include <Arduino.h>
 #include "main.hpp"
-#include <Wire.h>
 #include "FlashAsEEPROM_SAMD.h"
-#include <time.h>
 #include "eeprom.hpp"
 #include "cli.hpp"
 #include "commands.hpp"
-
-// uncomment line below to enable hex dumps of EEPROM regions
-//#define EEPROM_DEBUG 1
+#include "scan.hpp"
+#include "fru.hpp"
+#include "console.hpp"
+#include "i2cq.hpp"
+#include "protect.hpp"
 
 extern const uint16_t   static_pin_count;
 extern char             *tokens[];
 static char             outBfr[OUTBFR_SIZE];
-const uint32_t          EEPROM_signature = 0xDE110C03;
+const uint32_t          EEPROM_signature = 0xDE110C07;
+const uint32_t          EEPROM_signature_v03 = 0xDE110C03;          // original layout, sdelay in seconds
 uint8_t                 eepromAddresses[4] = {0x50, 0x52, 0x54, 0x56};      // NOTE: these DO NOT match Table 67
-const uint32_t          jan1996 = 820454400;                                // epoch time (secs) of 1/1/1996 00:00
 
 // FLASH/EEPROM Data buffer
 EEPROM_data_t           EEPROMData;
 
-// FRU EEPROM stuff
-common_hdr_t            commonHeader;
-board_hdr_t             boardHeader;
-prod_hdr_t              prodHeader;
-eeprom_desc_t           EEPROMDescriptor;
-const char              sixBitASCII[64] = " !\"$%&'()*+,-./123456789:;<=>?ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_";
-
 //===================================================================
 //                      EEPROM/NVM Stuff
 //===================================================================
 
-#define MAX_I2C_WRITE     16        // safe size, could be larger?
-#define EEPROM_MAX_LEN    256
 
 // temporary read buffer for FRU EEPROM
 byte              EEPROMBuffer[EEPROM_MAX_LEN];
 
+static uint8_t    busAddr = 0;              // device busHz was picked for
+static uint32_t   busHz = 0;                // 0 = probe on next access
+static uint32_t   lastHz = 0;               // speed of last access
+static uint32_t   readXfers = 0;            // readChunk() I2C transactions, incl. retries
+
+// page write counters, cleared by 'eeprom program'
+static struct {
+    uint32_t        pages;
+    uint32_t        polls;                  // NACKed ACK polls while a write cycle ran
+    uint32_t        cycleMaxUsec;           // longest write cycle
+} writeStats;
+
+/**
+  * @name   readChunk
+  * @brief  one random read: address write, then a current address read
+  * @param  i2cAddr  device address
+  * @param  eeaddress  EEPROM offset
+  * @param  dest  pointer to write data to
+  * @param  length  bytes, max EEPROM_READ_CHUNK
+  * @param  hz  bus speed
+  * @retval bool  false on NACK, bus error or timeout
+  * @note   the queue puts a STOP between the two, the 24C64 keeps its
+  *         address pointer across it
+  */
+static bool readChunk(uint8_t i2cAddr, uint32_t eeaddress, uint8_t *dest, uint8_t length, uint32_t hz)
+{
+    uint8_t         addrBytes[2];
+
+    addrBytes[0] = (uint8_t) (eeaddress >> 8);      // MSB
+    addrBytes[1] = (uint8_t) (eeaddress & 0xFF);    // LSB
+
+    readXfers++;
+    return(i2cq_Transfer(i2cAddr, addrBytes, 2, dest, length, hz) == I2CQ_OK);
+}
+
+/**
+  * @name   busProbe
+  * @brief  pick fastest bus speed that reads the same data as standard mode
+  * @param  i2cAddr  device address
+  * @retval None
+  */
+static void busProbe(uint8_t i2cAddr)
+{
+    const uint32_t  rates[] = {EEPROM_I2C_FASTPLUS_HZ, EEPROM_I2C_FAST_HZ};
+    uint8_t         ref[EEPROM_PROBE_LEN];
+    uint8_t         data[EEPROM_PROBE_LEN];
+
+    busAddr = i2cAddr;
+    busHz = EEPROM_I2C_STD_HZ;
+
+    if ( readChunk(i2cAddr, 0, ref, EEPROM_PROBE_LEN, busHz) == false )
+        return;
+
+    for ( unsigned i = 0; i < sizeof(rates) / sizeof(uint32_t); i++ )
+    {
+        if ( readChunk(i2cAddr, 0, data, EEPROM_PROBE_LEN, rates[i]) && memcmp(ref, data, EEPROM_PROBE_LEN) == 0 )
+        {
+            busHz = rates[i];
+            return;
+        }
+    }
+}
+
+/**
+  * @name   busBegin
+  * @brief  pick the speed for a device, probing if needed
+  * @param  i2cAddr  device address
+  * @retval None
+  */
+static void busBegin(uint8_t i2cAddr)
+{
+    if ( busHz == 0 || busAddr != i2cAddr )
+        busProbe(i2cAddr);
+
+    lastHz = busHz;
+}
+
+/**
+  * @name   eeprom_BusHz
+  * @brief  bus speed used for the last FRU EEPROM access
+  * @param  None
+  * @retval uint32_t  Hz, 0 if there was none yet
+  */
+uint32_t eeprom_BusHz(void)
+{
+    return(lastHz);
+}
+
+/**
+  * @name   eeprom_ReadTransactions
+  * @brief  count of I2C read transactions since boot
+  * @param  None
+  * @retval uint32_t  one per EEPROM_READ_CHUNK piece, retries and
+  *         speed probes included
+  */
+uint32_t eeprom_ReadTransactions(void)
+{
+    return(readXfers);
+}
+
 /**
   * @name   readEEPROM
   * @brief  read FRU EEPROM
   * @param  i2cAddr 
   * @param  eeaddress 
   * @param  dest pointer to write data to
-  * @param  length in bytes to read
-  * @retval None
+  * @param  length in bytes to read, any size up to the end of the device
+  * @retval bool  true if all bytes were read
+  * @note   split into aligned EEPROM_READ_CHUNK reads at the fastest speed the
+  *         device passed busProbe() at; a failed chunk is retried once
+  *         in standard mode and the speed is probed again next time
   */
-void readEEPROM(uint8_t i2cAddr, uint32_t eeaddress, uint8_t *dest, uint16_t length)
+bool readEEPROM(uint8_t i2cAddr, uint32_t eeaddress, uint8_t *dest, uint16_t length)
 {
-  if ( length > EEPROM_MAX_LEN )
-    length = EEPROM_MAX_LEN;
+    uint8_t         chunk;
+    bool            ok = true;
 
-  Wire.beginTransmission(i2cAddr);
+    if ( eeaddress + length > EEPROM_SIZE )
+        return(false);
 
-  Wire.write((int)(eeaddress >> 8));      // MSB
-  Wire.write((int)(eeaddress & 0xFF));    // LSB
-  Wire.endTransmission();
+    busBegin(i2cAddr);
 
-  Wire.requestFrom(i2cAddr, length);
+    while ( length > 0 )
+    {
+        // chunks end on EEPROM_READ_CHUNK boundaries, which are also page boundaries
+        chunk = EEPROM_READ_CHUNK - (eeaddress % EEPROM_READ_CHUNK);
+        if ( chunk > length )
+            chunk = length;
+
+        if ( readChunk(i2cAddr, eeaddress, dest, chunk, busHz) == false )
+        {
+            if ( busHz == EEPROM_I2C_STD_HZ )
+                ok = false;
+            else
+                ok = readChunk(i2cAddr, eeaddress, dest, chunk, EEPROM_I2C_STD_HZ);
 
-  while ( Wire.available() && length-- > 0 ) 
-  {
-      *dest++  = Wire.read();
-  }
+            busHz = 0;
+            lastHz = EEPROM_I2C_STD_HZ;
+            if ( ok == false )
+                break;
+        }
+
+        eeaddress += chunk;
+        dest += chunk;
+        length -= chunk;
+    }
+
+    return(ok);
 }
 
-// --------------------------------------------
-// writeEEPROMPage() - write a 'page' to the
-// FRU EEPROM. NOTE: Not in use, here in case.
-// NOTE: Not tested! Should work, hahah.
-// --------------------------------------------
 /**
-  * @name   writeEEPROMPage
-  * @brief  write page of data to FRU EEPROM
-  * @param  None
-  * @retval None
-  * @note   NOT TESTED!
+  * @name   ackPoll
+  * @brief  wait for the end of an internal write cycle
+  * @param  i2cAddr  device address
+  * @retval bool  false if the device did not ACK within EEPROM_WRITE_TIMEOUT_MS
+  * @note   the device NACKs its address until the write has finished
   */
-void writeEEPROMPage(uint8_t i2cAddr, long eeAddress, byte *buffer)
+static bool ackPoll(uint8_t i2cAddr)
 {
+    uint32_t        startTime = micros();
+    uint32_t        elapsed;
 
-  Wire.beginTransmission(i2cAddr);
+    while ( 1 )
+    {
+        if ( i2cq_Transfer(i2cAddr, NULL, 0, NULL, 0, busHz) == I2CQ_OK )
+            break;
 
-  Wire.write((int)(eeAddress >> 8));        // MSB
-  Wire.write((int)(eeAddress & 0xFF));      // LSB
+        writeStats.polls++;
+        if ( micros() - startTime > EEPROM_WRITE_TIMEOUT_MS * 1000ul )
+            return(false);
+    }
 
-  // Write bytes to EEPROM
-  for (byte x = 0 ; x < MAX_I2C_WRITE ; x++)
-    Wire.write(buffer[x]);                //Write the data
+    elapsed = micros() - startTime;
+    if ( elapsed > writeStats.cycleMaxUsec )
+        writeStats.cycleMaxUsec = elapsed;
 
-  Wire.endTransmission();                 //Send stop condition
+    return(true);
 }
 
-// --------------------------------------------
-// unpack6bitASCII()
-// --------------------------------------------
 /**
-  * @name   unpack6bitASCII
-  * @brief  unpack into 8-bit ASCII
-  * @param  s pointer to write unpacked  data to
-  * @param  field_length
-  * @param  bytes pointer to packed data
-  * @retval None
+  * @name   writeEEPROM
+  * @brief  write and verify FRU EEPROM
+  * @param  i2cAddr  device address
+  * @param  eeaddress  EEPROM offset
+  * @param  src  data to write
+  * @param  length  bytes, any size up to the end of the device
+  * @retval bool  true if every byte was written and read back OK
+  * @note   one page write per EEPROM_PAGE_SIZE page touched, each
+  *         followed by ACK polling and a read back of the page
   */
-void unpack6bitASCII(char *s, uint8_t field_length, uint8_t *bytes)
+bool writeEEPROM(uint8_t i2cAddr, uint32_t eeaddress, const uint8_t *src, uint16_t length)
+{
+    uint8_t         page[2 + EEPROM_PAGE_SIZE];     // address + data
+    uint8_t         verify[EEPROM_PAGE_SIZE];
+    uint8_t         chunk;
+    bool            ok = true;
+
+    if ( eeaddress + length > EEPROM_SIZE )
+        return(false);
+
+    busBegin(i2cAddr);
+
+    while ( length > 0 )
+    {
+        // a page write wraps within the page, so never cross a page boundary
+        chunk = EEPROM_PAGE_SIZE - (eeaddress % EEPROM_PAGE_SIZE);
+        if ( chunk > length )
+            chunk = length;
+
+        page[0] = (uint8_t) (eeaddress >> 8);       // MSB
+        page[1] = (uint8_t) (eeaddress & 0xFF);     // LSB
+        memcpy(&page[2], src, chunk);
+
+        if ( i2cq_Transfer(i2cAddr, page, 2 + chunk, NULL, 0, busHz) != I2CQ_OK || ackPoll(i2cAddr) == false ||
+             readChunk(i2cAddr, eeaddress, verify, chunk, busHz) == false || memcmp(verify, src, chunk) != 0 )
+        {
+            ok = false;
+            break;
+        }
+
+        writeStats.pages++;
+        eeaddress += chunk;
+        src += chunk;
+        length -= chunk;
+    }
+
+    return(ok);
+}
+
+// --------------------------------------------
+// crc32Update() - CRC-32 (IEEE 802.3, as used
+// by zlib) of a block, 4 bits at a time
+//
+// Start with crc = 0xFFFFFFFF and invert the
+// final value.
+// --------------------------------------------
+static uint32_t crc32Update(uint32_t crc, const uint8_t *p, uint16_t len)
 {
-    uint8_t         temp;
-    uint16_t        field_offset = 0;
+    static const uint32_t   crcNibble[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
 
-    while ( field_length > 0 )
+    while ( len-- > 0 )
     {
-        temp = bytes[field_offset] & 0x3F;
-        *s++ = sixBitASCII[temp];
+        crc = (crc >> 4) ^ crcNibble[(crc ^ *p) & 0x0F];
+        crc = (crc >> 4) ^ crcNibble[(crc ^ (*p >> 4)) & 0x0F];
+        p++;
+    }
 
-        temp = bytes[field_offset + 1] << 2 | (bytes[field_offset] >> 6);
-        *s++ = sixBitASCII[temp];
+    return(crc);
+}
+
+// --------------------------------------------
+// eepromDumpAll() - stream the whole FRU
+// EEPROM followed by its CRC-32
+//
+// hex: 32 bytes per line with the offset, then
+// a summary line with the CRC.
+// binary: "TFRU", uint32_t size, the data and
+// uint32_t CRC, all little endian. A read
+// error ends the stream early so the host sees
+// a short file.
+// --------------------------------------------
+static int eepromDumpAll(uint8_t i2cAddr, bool binary)
+{
+    const char      hexDigits[] = "0123456789ABCDEF";
+    uint32_t        crc = 0xFFFFFFFF;
+    uint32_t        size = EEPROM_SIZE;
+    uint32_t        startTime = micros();
+    char            *s;
 
-        temp = (bytes[field_offset + 1] >> 4) | (bytes[field_offset + 2] & 3);
-        *s++ = sixBitASCII[temp];
+    if ( binary )
+    {
+        console_write("TFRU", 4);
+        console_write((const char *) &size, 4);
+    }
 
-        *s++ = sixBitASCII[bytes[field_offset + 2] >> 2];
+    for ( uint32_t offset = 0; offset < size; offset += EEPROM_MAX_LEN )
+    {
+        if ( readEEPROM(i2cAddr, offset, EEPROMBuffer, EEPROM_MAX_LEN) == false )
+        {
+            if ( binary )
+            {
+                console_endResponse();
+                return(1);
+            }
 
-        field_length -= 3;
-        field_offset += 3;
+            sprintf(outBfr, "EEPROM read failed at offset %lu", offset);
+            SHOW();
+            return(1);
+        }
+
+        crc = crc32Update(crc, EEPROMBuffer, EEPROM_MAX_LEN);
+
+        if ( binary )
+        {
+            console_write((const char *) EEPROMBuffer, EEPROM_MAX_LEN);
+            continue;
+        }
+
+        for ( int i = 0; i < EEPROM_MAX_LEN; i += 32 )
+        {
+            s = outBfr + sprintf(outBfr, "%04lX:", offset + i);
+            for ( int j = i; j < i + 32; j++ )
+            {
+                *s++ = ' ';
+                *s++ = hexDigits[EEPROMBuffer[j] >> 4];
+                *s++ = hexDigits[EEPROMBuffer[j] & 0x0F];
+            }
+
+            *s = 0;
+            SHOW();
+        }
+    }
+
+    crc ^= 0xFFFFFFFF;
+
+    if ( binary )
+    {
+        console_write((const char *) &crc, 4);
+        console_endResponse();
+        return(0);
     }
 
-    *s = 0;
+    sprintf(outBfr, "CRC32 %08lX over %lu bytes, %lu usec at %lu Hz", crc, size, micros() - startTime, eeprom_BusHz());
+    SHOW();
+    return(0);
 }
 
 // --------------------------------------------
-// extractField() - extract next field in an
-// EEPROM area
+// eepromDump() - 'eeprom dump' subcommand
 //
-// Uses data in EEPROMBuffer at field_offset
-// which is the type/length byte of the first
-// field, then extracts/decodes the data into
-// the char field pointed to by t.
+// 'eeprom dump <offset> <length>' dumps any
+// range of the device; 'eeprom dump all
+// [hex|bin]' streams all of it with a CRC.
 // --------------------------------------------
-uint16_t extractField(char *t, uint16_t field_offset)
+static int eepromDump(uint8_t i2cAddr, int arg)
 {
-    uint8_t             field_type = GET_TYPE(EEPROMBuffer[field_offset]);
-    uint16_t            field_length = GET_LENGTH(EEPROMBuffer[field_offset]);
-    uint8_t             temp;
+    uint32_t        offset;
+    uint32_t        length;
+    uint16_t        chunk;
+
+    if ( strcmp(tokens[2], "all") == 0 )
+    {
+        if ( arg == 2 || (arg == 3 && strcmp(tokens[3], "hex") == 0) )
+            return(eepromDumpAll(i2cAddr, false));
+        else if ( arg == 3 && strcmp(tokens[3], "bin") == 0 )
+            return(eepromDumpAll(i2cAddr, true));
 
-    field_offset++;
+        showCommandHelp(tokens[0]);
+        return(1);
+    }
 
-    if ( field_type == 3 )
+    if ( arg != 3 )
     {
-        // 8-bit ASCII
-        strncpy(t, (char *) &EEPROMBuffer[field_offset], field_length);
-        t[field_length] = 0;
+        showCommandHelp(tokens[0]);
+        return(1);
     }
-    else if ( field_type == 2 )
+
+    offset = strtoul(tokens[2], NULL, 0);
+    length = strtoul(tokens[3], NULL, 0);
+
+    if ( offset > MAX_EEPROM_ADDR )
     {
-        // 6-bit ASCII
-        unpack6bitASCII(t, field_length, &EEPROMBuffer[field_offset]);
+        sprintf(outBfr, "offset of %lu exceeds EEPROM capacity, use a smaller number", offset);
+        SHOW();
+        return(1);
     }
-    else if ( field_type == 1 )
+
+    if ( length == 0 || offset + length > EEPROM_SIZE )
     {
-        // BCD plus per 13.1 in platform mgt spec 
-        // TODO - untested, haven't seen this type of data in test boards
-        while ( field_length-- > 0 )
+        sprintf(outBfr, "length of %lu runs past the end of the EEPROM (%d bytes)", length, EEPROM_SIZE);
+        SHOW();
+        return(1);
+    }
+
+    // EEPROM_MAX_LEN is a multiple of 16 so only the last line is short
+    while ( length > 0 )
+    {
+        chunk = (length > EEPROM_MAX_LEN) ? EEPROM_MAX_LEN : length;
+
+        if ( readEEPROM(i2cAddr, offset, EEPROMBuffer, chunk) == false )
         {
-            temp = EEPROMBuffer[field_offset] >> 4;
-            if ( temp >= 0 && temp <= 9 )
-                *t++ = temp | '0';
-            else if ( temp == 0xA )
-                *t++ = ' ';
-            else if ( temp == 0xB )
-                *t++ = '-';
-            else if ( temp == 0xC )
-                *t++ = '.';
-            else
-                *t++ = '?';
-            temp = EEPROMBuffer[field_offset] & 0xF;
-            if ( temp >= 0 && temp <= 9 )
-                *t++ = temp | '0';
-            else if ( temp == 0xA )
-                *t++ = ' ';
-            else if ( temp == 0xB )
-                *t++ = '-';
-            else if ( temp == 0xC )
-                *t++ = '.';
-            else
-                *t++ = '?';
+            sprintf(outBfr, "EEPROM read failed at offset %lu", offset);
+            SHOW();
+            return(1);
+        }
+
+        dumpMem(EEPROMBuffer, chunk);
+        offset += chunk;
+        length -= chunk;
+    }
+
+    return(0);
+}
+
+// --------------------------------------------
+// eepromProgram() - 'eeprom program <length>
+// [<offset>]' writes an image streamed by the
+// host as raw bytes.
+//
+// Framing: the command line ends with CR or
+// CRLF, then the host waits for the "Send ..."
+// prompt and sends exactly <length> bytes. An
+// LF that arrives before the prompt is the end
+// of a CRLF line and is dropped; everything
+// after the prompt is image data, 0x0A included.
+//
+// Bytes are collected a page at a time and each
+// page is written, ACK polled and verified as
+// soon as it is complete; USB flow control
+// holds the host off meanwhile. The CRC-32 of
+// the data written is reported so the host can
+// check it against the image file.
+// --------------------------------------------
+static int eepromProgram(uint8_t i2cAddr, int arg)
+{
+    uint8_t         page[EEPROM_PAGE_SIZE];
+    uint32_t        length = strtoul(tokens[2], NULL, 0);
+    uint32_t        offset = (arg >= 3) ? strtoul(tokens[3], NULL, 0) : 0;
+    uint32_t        written = 0;
+    uint32_t        crc = 0xFFFFFFFF;
+    uint32_t        startTime;
+    uint32_t        lastByte;
+    uint16_t        got;
+    uint16_t        n;
+
+    if ( length == 0 || offset > MAX_EEPROM_ADDR || offset + length > EEPROM_SIZE )
+    {
+        sprintf(outBfr, "offset + length must be within the EEPROM (%d bytes)", EEPROM_SIZE);
+        SHOW();
+        return(1);
+    }
 
-            field_offset++;
+    // the loop only ends a command line on CR
+    for ( startTime = millis(); millis() - startTime < EEPROM_PROGRAM_LF_MS; )
+    {
+        if ( SerialUSB.available() )
+        {
+            if ( SerialUSB.peek() == '\n' )
+                (void) SerialUSB.read();
+            break;
         }
     }
-    else
+
+    sprintf(outBfr, "Send %lu bytes of image data for offset %lu now", length, offset);
+    SHOW();
+    console_endResponse();
+
+    memset(&writeStats, 0, sizeof(writeStats));
+    startTime = millis();
+
+    while ( written < length )
     {
-        // binary or unspecified
-        strcpy(t, "Binary or unspecified format");
-        while ( field_length-- > 0 )
+        n = EEPROM_PAGE_SIZE - ((offset + written) % EEPROM_PAGE_SIZE);
+        if ( n > length - written )
+            n = length - written;
+
+        lastByte = millis();
+        for ( got = 0; got < n; )
+        {
+            if ( SerialUSB.available() )
+            {
+                page[got++] = SerialUSB.read();
+                lastByte = millis();
+            }
+            else if ( millis() - lastByte > EEPROM_PROGRAM_TIMEOUT_MS )
+            {
+                sprintf(outBfr, "Timed out waiting for image data, %lu of %lu bytes written", written, length);
+                SHOW();
+                fru_Invalidate();
+                return(1);
+            }
+        }
+
+        if ( writeEEPROM(i2cAddr, offset + written, page, n) == false )
         {
-            sprintf(t++, "%02X", EEPROMBuffer[field_offset++]);
+            sprintf(outBfr, "Write or verify failed at offset %lu, %lu of %lu bytes written", offset + written,
+                    written, length);
+            SHOW();
+            fru_Invalidate();
+
+            // discard the rest of the image so it isn't taken as commands
+            for ( lastByte = millis(); millis() - lastByte < 250; )
+            {
+                if ( SerialUSB.available() )
+                {
+                    (void) SerialUSB.read();
+                    lastByte = millis();
+                }
+            }
+
+            return(1);
         }
+
+        crc = crc32Update(crc, page, n);
+        written += n;
     }
 
-    // adjust field offset for caller past field just processed
-    return(field_offset + field_length);
+    fru_Invalidate();
+
+    sprintf(outBfr, "Programmed and verified %lu bytes at offset %lu in %lu ms, %lu pages at %lu Hz",
+            written, offset, millis() - startTime, writeStats.pages, eeprom_BusHz());
+    SHOW();
+    sprintf(outBfr, "Longest write cycle %lu usec, %lu ACK polls; CRC32 %08lX", writeStats.cycleMaxUsec,
+            writeStats.polls, crc ^ 0xFFFFFFFF);
+    SHOW();
+    return(0);
 }
 
 // --------------------------------------------
@@ -213,13 +550,10 @@ uint16_t extractField(char *t, uint16_t field_offset)
 // --------------------------------------------
 int eepromCmd(int arg)
 {
-    uint16_t          eepromAddr = 0;
     uint8_t           eepromI2CAddr = 0x52;
-    char              tempStr[256];
-    uint16_t          field_offset;
     uint8_t           slot;
-    uint32_t          deltaTime;
-    time_t            t;
+    const fru_info_t  *fru;
+    bool              cached;
 
     if ( isCardPresent() == false )
     {
@@ -242,44 +576,26 @@ int eepromCmd(int arg)
         return(1);
     }
 
-    if ( arg == 1 )
+    if ( arg >= 2 && strcmp(tokens[1], "dump") == 0 )
     {
-        if ( strcmp(tokens[1], "show") != 0 )
-        {
-            terminalOut((char *) "Invalid subcommand, use 'show' to display EEPROM contents.");
-            return(1);
-        }
+        return(eepromDump(eepromI2CAddr, arg));
     }
-    else if ( arg == 3 )
+    else if ( arg >= 2 && arg <= 3 && strcmp(tokens[1], "program") == 0 )
     {
-        if ( strcmp(tokens[1], "dump") == 0 )
-        {
-            // 'eeprom dump <offset> <length>' command dumps FRU EEPROM at offset for length bytes
-            uint16_t        offset = atoi(tokens[2]);
-            uint16_t        length = atoi(tokens[3]);
-
-            if ( offset > MAX_EEPROM_ADDR )
-            {
-                sprintf(outBfr, "offset of %d exceeds EEPROM capacity, use a smaller number", offset);
-                SHOW();
-                return(1);
-            }
-
-            if ( length > (16 * 20) )
-            {
-                sprintf(outBfr, "length of %d exceeds maximum, use a smaller number", length);
-                SHOW();
-                return(1);
-            }
-
-            readEEPROM(eepromI2CAddr, offset, EEPROMBuffer, length);
-            dumpMem(EEPROMBuffer, length);
-            return(0);
-        }
-        else
+        return(eepromProgram(eepromI2CAddr, arg));
+    }
+    else if ( arg == 1 && strcmp(tokens[1], "program") == 0 )
+    {
+        terminalOut((char *) "Usage: eeprom program <length> [<addr>]");
+        terminalOut((char *) "  end the line with CR or CRLF, wait for the 'Send ...' prompt, then send");
+        terminalOut((char *) "  exactly <length> raw bytes; a CRC-32 of what was written is reported");
+        return(1);
+    }
+    else if ( arg == 1 )
+    {
+        if ( strcmp(tokens[1], "show") != 0 )
         {
-            sprintf(outBfr, "Invalid eeprom subcommand '%s'", tokens[1]);
-            SHOW();
+            terminalOut((char *) "Invalid subcommand, use 'show' to display EEPROM contents.");
             return(1);
         }
     }
@@ -289,135 +605,19 @@ int eepromCmd(int arg)
         return(1);
     }
 
-    // the first byte in the EEPROM should be a 1 which is the format version
-    // TODO: this may evolve over time and the code below need to be refactored
-    readEEPROM(eepromI2CAddr, 0, EEPROMBuffer, 1);
-    if ( EEPROMBuffer[0] != 1 )
+    // parsed contents are cached until the card is removed or swapped
+    fru = fru_Get(eepromI2CAddr, &cached);
+    if ( fru == NULL )
     {
         sprintf(outBfr, "Unable to locate FRU EEPROM at expected SMB address 0x%02X", eepromI2CAddr);
         SHOW();
         return(0);
     }
 
-    sprintf(outBfr, "FRU EEPROM found at SMB address 0x%02x", eepromI2CAddr);
-    SHOW();
-
-    // read common header
-    readEEPROM(eepromI2CAddr, eepromAddr, (byte *) &commonHeader, sizeof(common_hdr_t));
-
-#ifdef EEPROM_DEBUG
-    dumpMem((unsigned char *) &commonHeader, sizeof(common_hdr_t));
-#endif
-    terminalOut((char *) "--- COMMON HEADER DATA");
-    sprintf(outBfr, "Format version:  %d", commonHeader.format_vers & 0xF);
-    SHOW();
-
-    // all area offsets in common area are x8 bytes
-    EEPROMDescriptor.internal_area_offset_actual = commonHeader.internal_area_offset * 8;
-    EEPROMDescriptor.chassis_area_offset_actual = commonHeader.chassis_area_offset * 8;
-    EEPROMDescriptor.board_area_offset_actual = commonHeader.board_area_offset * 8;
-    EEPROMDescriptor.product_area_offset_actual = commonHeader.product_area_offset * 8;
-    EEPROMDescriptor.multirecord_area_offset_actual = commonHeader.multirecord_area_offset * 8;
-
-    sprintf(outBfr, "Int Use Area:    %d",  EEPROMDescriptor.internal_area_offset_actual);
-    SHOW();
-
-    sprintf(outBfr, "Chassis Area:    %d", EEPROMDescriptor.chassis_area_offset_actual);
-    SHOW();
-
-    sprintf(outBfr, "Board Area:      %d", EEPROMDescriptor.board_area_offset_actual);
-    SHOW();
-
-    sprintf(outBfr, "Product Area:    %d (not supported)", EEPROMDescriptor.product_area_offset_actual);
-    SHOW();
-
-    sprintf(outBfr, "MRecord Area:    %d (not supported)", EEPROMDescriptor.multirecord_area_offset_actual);
-    SHOW();
-
-    // read first 7 bytes of board info area "header" to determine length
-    eepromAddr = EEPROMDescriptor.board_area_offset_actual;
-    readEEPROM(eepromI2CAddr, eepromAddr, (byte *) &boardHeader, sizeof(board_hdr_t));
-#ifdef EEPROM_DEBUG
-    dumpMem(EEPROMBuffer, sizeof(board_hdr_t));
-#endif
-    EEPROMDescriptor.board_area_length = boardHeader.board_area_length * 8;
-
-    terminalOut((char *) "--- BOARD AREA DATA");
-    sprintf(outBfr, "Language Code:   %02X", boardHeader.language);
-    SHOW();
-
-    // format manufacturing date/time
-    deltaTime = boardHeader.mfg_time[2] << 16 | boardHeader.mfg_time[1] << 8 | boardHeader.mfg_time[0];
-    deltaTime *= 60;            // time in EEPROM is in minutes, convert to seconds
-    deltaTime += jan1996;       // convert to epoch since 1/1/1970
-    t = deltaTime;
-    strcpy(tempStr, asctime(gmtime(&t)));
-    tempStr[strcspn(tempStr, "\n")] = 0;
-    sprintf(outBfr, "Mfg Date/Time:   %s", tempStr);
-    SHOW();
-
-    sprintf(outBfr, "Bd Area Length:  %d", EEPROMDescriptor.board_area_length);
-    SHOW();
-
-    // read the entire board area
-    eepromAddr += sizeof(board_hdr_t);
-    readEEPROM(eepromI2CAddr, eepromAddr, (byte *) &EEPROMBuffer, EEPROMDescriptor.board_area_length);
-#ifdef EEPROM_DEBUG
-    dumpMem((unsigned char *) EEPROMBuffer, EEPROMDescriptor.board_area_length);
-#endif
-    field_offset = 0;
-
-    // extract manufacturer name; type/lenth is last item in board header
-    field_offset = extractField(tempStr, field_offset);
-    sprintf(outBfr, "Manufacturer:    %s", tempStr);
-    SHOW();
-
-    // extract the next field: product name
-    field_offset = extractField(tempStr, field_offset);
-    sprintf(outBfr, "Product Name:    %s", tempStr);
-    SHOW();
-
-    // extract the next field: serial number
-    field_offset = extractField(tempStr, field_offset);
-    sprintf(outBfr, "Serial Number:   %s", tempStr);
-    SHOW();
-
-    // extract the next field: part #
-    field_offset = extractField(tempStr, field_offset);
-    sprintf(outBfr, "Part Number:     %s", tempStr);
-    SHOW();
-
-    // FRU File ID
-    field_offset = extractField(tempStr, field_offset);
-    sprintf(outBfr, "FRU File ID:     %s", tempStr);
+    sprintf(outBfr, "FRU EEPROM found at SMB address 0x%02x%s", eepromI2CAddr, cached ? " (cached)" : "");
     SHOW();
 
-    // NOTE: Custom product info area fields are NOT processed
-    // nor is the check for the 0xC1 terminator checked
-
-#if 0
-// See GitHub Issue #4 (Need a decision on FRU EEPROM 'other areas'
-    // read the product area header
-    eepromAddr = EEPROMDescriptor.product_area_offset_actual;
-    readEEPROM(eepromI2CAddr, eepromAddr, (uint8_t *) &prodHeader, sizeof(prod_hdr_t));
-    eepromAddr += sizeof(prod_hdr_t);
-    dumpMem((uint8_t *) &prodHeader, sizeof(prod_hdr_t));
-
-    terminalOut("--- PRODUCT AREA DATA");
-    sprintf(outBfr, "Format version %d", prodHeader.format_vers & 0xF);
-    SHOW();
-
-    sprintf(outBfr, "Language Code: %02X", prodHeader.language);
-    SHOW();
-
-    uint16_t        length = prodHeader.prod_area_length * 8;
-    sprintf(outBfr, "Prod Area Size:%d", length);
-    SHOW();
-
-    readEEPROM(eepromI2CAddr, eepromAddr, EEPROMBuffer, length);
-    dumpMem(EEPROMBuffer, length);
-#endif // 0
-
+    fru_Show(fru);
     return(0);
 }
 
@@ -459,8 +659,13 @@ void EEPROM_Read(void)
 void EEPROM_Defaults(void)
 {
     EEPROMData.sig = EEPROM_signature;
-    EEPROMData.status_delay_secs = 3;
+    EEPROMData.status_delay_msec = 250;
     EEPROMData.pwr_seq_delay_msec = 250;
+    EEPROMData.scan_clk_hz = SCAN_CLK_DEFAULT_HZ;
+    EEPROMData.scan_sample_edge = SCAN_EDGE_FALLING;
+    EEPROMData.tcrit_trip = PROTECT_TCRIT_DEFAULT;
+    EEPROMData.ocp_main_ma = PROTECT_MAIN_MA_DEFAULT;
+    EEPROMData.ocp_aux_ma = PROTECT_AUX_MA_DEFAULT;
 
     // TODO add other fields
 }
@@ -477,7 +682,20 @@ bool EEPROM_InitLocal(void)
 
     EEPROM_Read();
 
-    if ( EEPROMData.sig != EEPROM_signature )
+    if ( EEPROMData.sig == EEPROM_signature_v03 )
+    {
+      // same offsets for both fields; the status delay was in seconds
+      uint32_t      statusMsec = EEPROMData.status_delay_msec * 1000ul;
+      uint16_t      pwrSeqMsec = EEPROMData.pwr_seq_delay_msec;
+
+      EEPROM_Defaults();
+      EEPROMData.status_delay_msec = (statusMsec > 0xFFFF) ? 0xFFFF : statusMsec;
+      EEPROMData.pwr_seq_delay_msec = pwrSeqMsec;
+      EEPROM_Save();
+
+      terminalOut((char *) "FLASH storage converted from DE110C03 (sdelay secs -> msec)");
+    }
+    else if ( EEPROMData.sig != EEPROM_signature )
     {
       // EEPROM failed: either never been used, or real failure
       // initialize the signature and settings
@@ -0,0 +1,212 @@
+//===================================================================
+// energy.cpp
+// Rail energy over a test window.  power.cpp hands every complete
+// sample to energy_Sample() with the micros() it was queued at; each
+// interval is integrated with the trapezoid rule using the measured
+// time between samples, so a late or skipped sample costs accuracy
+// only in that interval rather than being counted as POWER_SAMPLE_MS.
+//
+// Everything on the sampling path is integer: power is mV * mA = uW,
+// uW * usec = pJ, and the accumulator is nJ in an int64_t with the
+// sub-nJ remainder carried to the next interval.  Intervals are
+// unsigned micros() differences, which are rollover safe, and window
+// time is their 64-bit sum rather than a difference of millis()
+// values, so neither counter wrapping shows up in the report.
+//===================================================================
+#include <Arduino.h>
+#include "main.hpp"
+#include "cli.hpp"
+#include "power.hpp"
+#include "energy.hpp"
+
+extern char                 *tokens[];
+static char                 outBfr[OUTBFR_SIZE];
+
+static const char           *railNames[POWER_RAIL_CNT] = {"MAIN", "AUX"};
+
+static bool                 running = false;
+static bool                 havePrev = false;       // false = next sample only sets the start point
+static uint32_t             lastUsec;
+static uint64_t             elapsedUs;
+static uint32_t             intervals;
+static uint32_t             gaps;
+static uint32_t             gapMaxUs;
+static energy_rail_t        rails[POWER_RAIL_CNT];
+
+/**
+  * @name   energy_Sample
+  * @brief  integrate the interval ending at this sample
+  * @param  s  sample with both rails read OK
+  * @param  usec  micros() the sample was queued at
+  * @retval None
+  * @note   called from power_Service(); no float
+  */
+void energy_Sample(const power_sample_t *s, uint32_t usec)
+{
+    uint32_t        dt = usec - lastUsec;
+    int32_t         uw;
+    int64_t         pj;
+
+    if ( running == false )
+        return;
+
+    lastUsec = usec;
+
+    if ( havePrev == false )
+    {
+        for ( uint8_t rail = 0; rail < POWER_RAIL_CNT; rail++ )
+            rails[rail].lastUw = (int32_t) s->busMv[rail] * s->currentMa[rail];
+
+        havePrev = true;
+        return;
+    }
+
+    elapsedUs += dt;
+    intervals++;
+
+    if ( dt > ENERGY_GAP_SAMPLES * POWER_SAMPLE_MS * 1000ul )
+    {
+        gaps++;
+        if ( dt > gapMaxUs )
+            gapMaxUs = dt;
+    }
+
+    for ( uint8_t rail = 0; rail < POWER_RAIL_CNT; rail++ )
+    {
+        energy_rail_t   *r = &rails[rail];
+
+        uw = (int32_t) s->busMv[rail] * s->currentMa[rail];
+
+        // trapezoid: mean of the two end points times the interval
+        pj = (((int64_t) r->lastUw + uw) * dt) / 2 + r->remPj;
+        r->nJ += pj / 1000;
+        r->remPj = (int32_t) (pj % 1000);
+        r->lastUw = uw;
+    }
+}
+
+/**
+  * @name   energyReset
+  * @brief  clear accumulators, keep running/stopped state
+  * @param  None
+  * @retval None
+  */
+static void energyReset(void)
+{
+    memset(rails, 0, sizeof(rails));
+    elapsedUs = 0;
+    intervals = gaps = gapMaxUs = 0;
+    havePrev = false;
+}
+
+/**
+  * @name   formatScaled
+  * @brief  format v / 10^places with that many decimals
+  * @param  p  output
+  * @param  v  value
+  * @param  places  1..9
+  * @retval int  length
+  * @note   the integer part can pass 2^32 (4.29 MJ is ~20 hours at
+  *         60 W); nano printf has no %llu, so it goes out in two parts
+  */
+static int formatScaled(char *p, int64_t v, int places)
+{
+    uint64_t        mag = (v < 0) ? -v : v;
+    uint64_t        whole;
+    uint32_t        scale = 1;
+    int             len;
+
+    for ( int i = 0; i < places; i++ )
+        scale *= 10;
+
+    whole = mag / scale;
+    len = sprintf(p, "%s", (v < 0) ? "-" : "");
+
+    if ( whole >= 1000000000 )
+        len += sprintf(&p[len], "%lu%09lu", (uint32_t) (whole / 1000000000), (uint32_t) (whole % 1000000000));
+    else
+        len += sprintf(&p[len], "%lu", (uint32_t) whole);
+
+    return(len + sprintf(&p[len], ".%0*lu", places, (uint32_t) (mag % scale)));
+}
+
+/**
+  * @name   energyShow
+  * @brief  display energy per rail
+  * @param  None
+  * @retval None
+  */
+static void energyShow(void)
+{
+    uint64_t        secs = elapsedUs / 1000000;
+    int64_t         nJ;
+    int             len;
+
+    sprintf(outBfr, "Energy %s: %lu:%02lu:%02lu integrated, %lu intervals, %lu gaps (longest %lu ms)",
+            running ? "running" : "stopped", (uint32_t) (secs / 3600), (uint32_t) ((secs / 60) % 60),
+            (uint32_t) (secs % 60), intervals, gaps, gapMaxUs / 1000);
+    SHOW();
+
+    for ( uint8_t rail = 0; rail < POWER_RAIL_CNT; rail++ )
+    {
+        nJ = rails[rail].nJ;
+
+        if ( power_Present(rail) == false )
+        {
+            sprintf(outBfr, "  %-4s  no monitor", railNames[rail]);
+            SHOW();
+            continue;
+        }
+
+        // J = nJ / 10^9 shown as mJ, Wh = J / 3600 shown as uWh, mean W = nJ / usec shown as mW
+        len = sprintf(outBfr, "  %-4s  ", railNames[rail]);
+        len += formatScaled(&outBfr[len], nJ / 1000000, 3);
+        len += sprintf(&outBfr[len], " J  ");
+        len += formatScaled(&outBfr[len], nJ / 3600000, 6);
+        len += sprintf(&outBfr[len], " Wh  mean ");
+        len += formatScaled(&outBfr[len], elapsedUs ? nJ / (int64_t) elapsedUs : 0, 3);
+        sprintf(&outBfr[len], " W");
+        SHOW();
+    }
+}
+
+/**
+  * @name   powerEnergyCmd
+  * @brief  'power energy' subcommand
+  * @param  arg  number of arguments to 'power'
+  * @param  tokens[2]  start, stop, reset or none to show
+  * @retval 0=OK 1=error
+  */
+int powerEnergyCmd(int arg)
+{
+    if ( arg < 2 )
+    {
+        energyShow();
+        return(0);
+    }
+
+    if ( strcmp(tokens[2], "start") == 0 )
+    {
+        // time while stopped is not integrated
+        havePrev = false;
+        running = true;
+        terminalOut((char *) "Energy accumulation started");
+    }
+    else if ( strcmp(tokens[2], "stop") == 0 )
+    {
+        running = false;
+        energyShow();
+    }
+    else if ( strcmp(tokens[2], "reset") == 0 )
+    {
+        energyReset();
+        terminalOut((char *) "Energy accumulators reset");
+    }
+    else
+    {
+        terminalOut((char *) "Usage: power energy [start | stop | reset]");
+        return(1);
+    }
+
+    return(0);
+}
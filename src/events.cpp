@@ -0,0 +1,504 @@
+//===================================================================
+// events.cpp
+// Interrupt-driven edge capture for thermal alarm, fan, presence,
+// wake, power brake and power good pins.  The pins are routed to the
+// EIC with its glitch filter enabled; EIC_Handler() timestamps each
+// edge and pushes it into a lock-free queue that the main loop
+// drains (events_Service()) into a history log and per-pin stats.
+//===================================================================
+#include <Arduino.h>
+#include "main.hpp"
+#include "commands.hpp"
+#include "cli.hpp"
+#include "console.hpp"
+#include "pins.hpp"
+#include "events.hpp"
+#include "activity.hpp"
+#include "protect.hpp"
+
+extern char                 *tokens[];
+static char                 outBfr[OUTBFR_SIZE];
+
+#define EVT_QUEUE_MASK          (EVT_QUEUE_SIZE - 1)
+
+#if (EVT_QUEUE_SIZE & EVT_QUEUE_MASK) != 0
+#error EVT_QUEUE_SIZE must be a power of 2
+#endif
+
+// pins captured, in display order
+const uint8_t               eventPins[] = {
+    TEMP_WARN, TEMP_CRIT, FAN_ON_AUX,
+    OCP_PRSNTB0_N, OCP_PRSNTB1_N, OCP_PRSNTB2_N, OCP_PRSNTB3_N,
+    OCP_WAKE_N, OCP_PWRBRK_N, NIC_PWR_GOOD_JMP,
+};
+
+#define EVT_PIN_CNT             (sizeof(eventPins) / sizeof(uint8_t))
+
+// the protection trip needs the TEMP_CRIT edge interrupt, not polling
+static_assert(eicLineOf(TEMP_CRIT) != EIC_LINE_NONE && eicLineOf(TEMP_CRIT) != eicLineOf(TEMP_WARN) &&
+              (ACT_EIC_LINES & (1ul << eicLineOf(TEMP_CRIT))) == 0, "TEMP_CRIT must have its own EIC line");
+
+// per-pin capture state and statistics
+typedef struct {
+    uint8_t         eicLine;              // EIC_LINE_NONE if polled
+    uint8_t         level;                // last level seen
+    uint8_t         activeLevel;          // level that means "asserted"
+    uint32_t        edges;
+    uint32_t        asserts;
+    uint64_t        assertTime;           // usec of last assertion, 0 if not asserted
+    uint64_t        longest;              // longest assertion in usec
+    uint64_t        total;                // total asserted time in usec
+} evt_pin_t;
+
+static evt_pin_t            evtPins[EVT_PIN_CNT];
+static uint8_t              lineToPin[EIC_LINE_CNT];        // EIC line -> eventPins[] index
+static uint32_t             eicMask = 0;
+
+// ISR -> main loop queue: head written by ISR only, tail by main loop only
+static pin_event_t          evtQueue[EVT_QUEUE_SIZE];
+static volatile uint32_t    evtHead = 0;
+static volatile uint32_t    evtTail = 0;
+static volatile uint32_t    evtOverflows = 0;
+
+// drained history
+static pin_event_log_t      evtHistory[EVT_HISTORY_SIZE];
+static uint32_t             evtHistoryCount = 0;            // total ever logged
+static bool                 evtStreaming = false;
+static uint32_t             presenceChanges = 0;            // PRSNTB[3:0] edges logged
+
+// edges pushed per pin and micros() of the last one, read by events_PinEdges()
+static volatile uint32_t    evtEdgeCount[EVT_PIN_CNT];
+static volatile uint32_t    evtEdgeUsec[EVT_PIN_CNT];
+
+// 64-bit extension of micros()
+static uint32_t             lastUsec = 0;
+static uint32_t             usecWraps = 0;
+
+/**
+  * @name   pushEvent
+  * @brief  add event to ISR queue
+  * @param  usec  timestamp
+  * @param  index  eventPins[] index
+  * @param  level  pin level
+  * @param  flags  EVT_FLAG_xxx
+  * @retval None
+  * @note   EIC ISR context, or thread with EIC IRQ masked
+  */
+static void pushEvent(uint32_t usec, uint8_t index, uint8_t level, uint8_t flags)
+{
+    pin_event_t     *e;
+
+    // kept even if the queue is full so edge times can be read without draining
+    evtEdgeCount[index]++;
+    evtEdgeUsec[index] = usec;
+
+    if ( evtHead - evtTail >= EVT_QUEUE_SIZE )
+    {
+        evtOverflows++;
+        return;
+    }
+
+    e = &evtQueue[evtHead & EVT_QUEUE_MASK];
+    e->usec = usec;
+    e->pinNo = eventPins[index];
+    e->level = level;
+    e->flags = flags;
+
+    __DMB();
+    evtHead++;
+}
+
+/**
+  * @name   EIC_Handler
+  * @brief  EIC ISR: timestamp and queue edges
+  * @param  None
+  * @retval None
+  * @note   replaces the Arduino attachInterrupt() dispatcher which is
+  *         not used by this firmware
+  */
+void EIC_Handler(void)
+{
+    uint32_t        flags = EIC->INTFLAG.reg & eicMask;
+    uint32_t        now;
+    pin_snapshot_t  snap;
+
+    // clear first so an edge after the snapshot re-triggers
+    EIC->INTFLAG.reg = flags;
+    now = micros();
+
+    // power trip ahead of the event bookkeeping
+    if ( flags & (1ul << eicLineOf(TEMP_CRIT)) )
+        protect_TempCritIsr(now);
+
+    pinSnapshotRead(&snap);
+
+    for ( uint8_t line = 0; flags != 0; line++, flags >>= 1 )
+    {
+        if ( flags & 1 )
+        {
+            uint8_t     pinNo = eventPins[lineToPin[line]];
+
+            pushEvent(now, lineToPin[line], pinSnapshotGet(&snap, pinNo), 0);
+        }
+    }
+}
+
+/**
+  * @name   events_Init
+  * @brief  route event pins to EIC and enable edge interrupts
+  * @param  None
+  * @retval None
+  * @note   call after configureIOPins(); pins that share an EIC line
+  *         with an earlier pin in eventPins[] or with the activity
+  *         counters (ACT_EIC_LINES) are polled instead
+  */
+void events_Init(void)
+{
+    pin_snapshot_t  snap;
+
+    memset(lineToPin, EIC_LINE_NONE, sizeof(lineToPin));
+
+    // EIC clocked from GCLK0; filter = majority of 3 samples
+    PM->APBAMASK.reg |= PM_APBAMASK_EIC;
+    GCLK->CLKCTRL.reg = (uint16_t) (GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID(GCM_EIC));
+    while (GCLK->STATUS.bit.SYNCBUSY);
+
+    EIC->CTRL.bit.ENABLE = 0;
+    while (EIC->STATUS.bit.SYNCBUSY);
+
+    pinSnapshotRead(&snap);
+
+    for ( unsigned i = 0; i < EVT_PIN_CNT; i++ )
+    {
+        uint8_t     pinNo = eventPins[i];
+        uint8_t     line = eicLineOf(pinNo);
+        uint8_t     bit = PORTBIT_BIT(pinPortBit[pinNo]);
+        uint8_t     group = pinGroup(pinNo);
+
+        memset(&evtPins[i], 0, sizeof(evt_pin_t));
+        evtPins[i].level = pinSnapshotGet(&snap, pinNo);
+        evtPins[i].activeLevel = (getPinActiveState(pinNo) == ACT_LO) ? 0 : 1;
+        evtPins[i].eicLine = EIC_LINE_NONE;
+
+        if ( line == EIC_LINE_NONE || lineToPin[line] != EIC_LINE_NONE || (ACT_EIC_LINES & (1ul << line)) )
+            continue;
+
+        lineToPin[line] = i;
+        evtPins[i].eicLine = line;
+        eicMask |= (1ul << line);
+
+        // peripheral function A (EIC), input buffer stays on so PORT IN still works
+        if ( bit & 1 )
+            PORT->Group[group].PMUX[bit >> 1].reg &= ~PORT_PMUX_PMUXO_Msk;
+        else
+            PORT->Group[group].PMUX[bit >> 1].reg &= ~PORT_PMUX_PMUXE_Msk;
+        PORT->Group[group].PINCFG[bit].reg |= (PORT_PINCFG_PMUXEN | PORT_PINCFG_INEN);
+
+        // both edges + glitch filter
+        EIC->CONFIG[line >> 3].reg &= ~(0xFul << ((line & 7) * 4));
+        EIC->CONFIG[line >> 3].reg |= ((EIC_CONFIG_SENSE0_BOTH_Val | EIC_CONFIG_FILTEN0) << ((line & 7) * 4));
+    }
+
+    EIC->INTFLAG.reg = eicMask;
+    EIC->INTENSET.reg = eicMask;
+
+    NVIC_DisableIRQ(EIC_IRQn);
+    NVIC_ClearPendingIRQ(EIC_IRQn);
+    // highest priority, with USB: TEMP_CRIT trips from here (see protect.cpp)
+    NVIC_SetPriority(EIC_IRQn, 0);
+    NVIC_EnableIRQ(EIC_IRQn);
+
+    EIC->CTRL.bit.ENABLE = 1;
+    while (EIC->STATUS.bit.SYNCBUSY);
+
+    lastUsec = micros();
+}
+
+/**
+  * @name   extendTime
+  * @brief  extend 32-bit micros() timestamp to 64 bits
+  * @param  usec  timestamp from queue, or micros() to keep the clock current
+  * @retval uint64_t  usecs since boot
+  * @note   events_Service() calls this with micros() on every pass, so a
+  *         wrap is seen even when no event comes for hours; valid as long
+  *         as the loop runs at least every ~35 min.  A queued timestamp
+  *         a little older than the last call is placed before it, on the
+  *         near side of a wrap counted in between.
+  */
+static uint64_t extendTime(uint32_t usec)
+{
+    uint32_t        wraps = usecWraps;
+
+    if ( (int32_t) (usec - lastUsec) >= 0 )
+    {
+        // forward in time, so a smaller value means micros() wrapped
+        if ( usec < lastUsec )
+            usecWraps++;
+
+        wraps = usecWraps;
+        lastUsec = usec;
+    }
+    else if ( usec > lastUsec )
+    {
+        // older than lastUsec and from before its wrap
+        wraps--;
+    }
+
+    return(((uint64_t) wraps << 32) | usec);
+}
+
+/**
+  * @name   formatEvent
+  * @brief  format one logged event into outBfr
+  * @param  e  event
+  * @param  duration  assertion length in usec if this event ended one, else 0
+  * @retval None
+  */
+static void formatEvent(const pin_event_log_t *e, uint64_t duration)
+{
+    int             len;
+
+    len = sprintf(outBfr, "%6lu.%06lu  %-14s %d %s%s", (uint32_t) (e->usec / 1000000), (uint32_t) (e->usec % 1000000),
+                  getPinName(e->pinNo), e->level,
+                  (e->level == ((getPinActiveState(e->pinNo) == ACT_LO) ? 0 : 1)) ? "asserted" : "deasserted",
+                  (e->flags & EVT_FLAG_POLLED) ? " (polled)" : "");
+
+    if ( duration )
+        sprintf(&outBfr[len], " after %lu.%06lu s", (uint32_t) (duration / 1000000), (uint32_t) (duration % 1000000));
+}
+
+/**
+  * @name   logEvent
+  * @brief  add drained event to history and update pin stats
+  * @param  e  raw event
+  * @retval None
+  */
+static void logEvent(const pin_event_t *e)
+{
+    pin_event_log_t *log = &evtHistory[evtHistoryCount % EVT_HISTORY_SIZE];
+    evt_pin_t       *p = NULL;
+    uint64_t        duration = 0;
+
+    log->usec = extendTime(e->usec);
+    log->pinNo = e->pinNo;
+    log->level = e->level;
+    log->flags = e->flags;
+    evtHistoryCount++;
+
+    for ( unsigned i = 0; i < EVT_PIN_CNT; i++ )
+    {
+        if ( eventPins[i] == e->pinNo )
+        {
+            p = &evtPins[i];
+            break;
+        }
+    }
+
+    if ( e->pinNo == OCP_PRSNTB0_N || e->pinNo == OCP_PRSNTB1_N || e->pinNo == OCP_PRSNTB2_N || e->pinNo == OCP_PRSNTB3_N )
+        presenceChanges++;
+
+    if ( p != NULL )
+    {
+        p->edges++;
+        p->level = e->level;
+
+        if ( e->level == p->activeLevel && p->assertTime == 0 )
+        {
+            p->asserts++;
+            p->assertTime = log->usec;
+        }
+        else if ( e->level != p->activeLevel && p->assertTime != 0 )
+        {
+            duration = log->usec - p->assertTime;
+            p->total += duration;
+            if ( duration > p->longest )
+                p->longest = duration;
+            p->assertTime = 0;
+        }
+    }
+
+    if ( evtStreaming )
+    {
+        formatEvent(log, duration);
+        terminalOut(outBfr);
+    }
+}
+
+/**
+  * @name   events_Service
+  * @brief  drain ISR queue and poll pins without an EIC line
+  * @param  None
+  * @retval None
+  * @note   called from loop() and long-running commands
+  */
+void events_Service(void)
+{
+    pin_snapshot_t  snap;
+    uint8_t         level;
+
+    // polled pins: queue through the same path so ordering is kept
+    pinSnapshotRead(&snap);
+    for ( unsigned i = 0; i < EVT_PIN_CNT; i++ )
+    {
+        if ( evtPins[i].eicLine != EIC_LINE_NONE )
+            continue;
+
+        level = pinSnapshotGet(&snap, eventPins[i]);
+        if ( level != evtPins[i].level )
+        {
+            NVIC_DisableIRQ(EIC_IRQn);
+            pushEvent(micros(), i, level, EVT_FLAG_POLLED);
+            NVIC_EnableIRQ(EIC_IRQn);
+
+            // keep from re-queueing before the event is drained below
+            evtPins[i].level = level;
+        }
+    }
+
+    while ( evtTail != evtHead )
+    {
+        pin_event_t     e = evtQueue[evtTail & EVT_QUEUE_MASK];
+
+        evtTail++;
+        logEvent(&e);
+    }
+
+    // count a micros() wrap even if no event comes
+    (void) extendTime(micros());
+}
+
+/**
+  * @name   events_PresenceChanges
+  * @brief  count of PRSNTB[3:0] edges drained so far
+  * @param  None
+  * @retval uint32_t  changes whenever a card is inserted or removed
+  * @note   not cleared by 'events clear'; call events_Service() first
+  *         to include queued edges
+  */
+uint32_t events_PresenceChanges(void)
+{
+    return(presenceChanges);
+}
+
+/**
+  * @name   events_PinEdges
+  * @brief  edges timestamped for a pin, without draining the queue
+  * @param  pinNo  Arduino pin #
+  * @param  usec  if not NULL, micros() of the last edge
+  * @retval uint32_t  edge count, changes on every edge; 0 if the pin
+  *         is not captured
+  * @note   EIC pins are counted by the ISR, polled pins only when
+  *         events_Service() runs
+  */
+uint32_t events_PinEdges(uint8_t pinNo, uint32_t *usec)
+{
+    uint32_t        count = 0;
+
+    for ( unsigned i = 0; i < EVT_PIN_CNT; i++ )
+    {
+        if ( eventPins[i] == pinNo )
+        {
+            NVIC_DisableIRQ(EIC_IRQn);
+            count = evtEdgeCount[i];
+            if ( usec != NULL )
+                *usec = evtEdgeUsec[i];
+            NVIC_EnableIRQ(EIC_IRQn);
+            break;
+        }
+    }
+
+    return(count);
+}
+
+/**
+  * @name   eventsShow
+  * @brief  display per-pin stats and logged events
+  * @param  None
+  * @retval None
+  */
+static void eventsShow(void)
+{
+    uint32_t        count = (evtHistoryCount < EVT_HISTORY_SIZE) ? evtHistoryCount : EVT_HISTORY_SIZE;
+    uint32_t        first = evtHistoryCount - count;
+
+    terminalOut((char *) "Pin            EIC  Lvl   Edges  Asserts     Longest(s)        Total(s)");
+    for ( unsigned i = 0; i < EVT_PIN_CNT; i++ )
+    {
+        evt_pin_t   *p = &evtPins[i];
+        char        line[4];
+
+        if ( p->eicLine == EIC_LINE_NONE )
+            strcpy(line, "--");
+        else
+            sprintf(line, "%2d", p->eicLine);
+
+        sprintf(outBfr, "%-14s  %s  %d  %7lu  %7lu  %7lu.%06lu  %7lu.%06lu", getPinName(eventPins[i]), line,
+                p->level, p->edges, p->asserts, (uint32_t) (p->longest / 1000000), (uint32_t) (p->longest % 1000000),
+                (uint32_t) (p->total / 1000000), (uint32_t) (p->total % 1000000));
+        terminalOut(outBfr);
+    }
+
+    if ( evtOverflows )
+    {
+        sprintf(outBfr, "WARNING: %lu events lost to queue overflow", evtOverflows);
+        terminalOut(outBfr);
+    }
+
+    sprintf(outBfr, "Last %lu of %lu events (secs since boot):", count, evtHistoryCount);
+    terminalOut(outBfr);
+
+    for ( uint32_t n = first; n < evtHistoryCount; n++ )
+    {
+        formatEvent(&evtHistory[n % EVT_HISTORY_SIZE], 0);
+        terminalOut(outBfr);
+    }
+}
+
+/**
+  * @name   eventsCmd
+  * @brief  'events' command
+  * @param  arg  number of arguments
+  * @param  tokens[1]  show (default), stream or clear
+  * @retval 0=OK 1=error
+  */
+int eventsCmd(int arg)
+{
+    events_Service();
+
+    if ( arg == 0 || strcmp(tokens[1], "show") == 0 )
+    {
+        eventsShow();
+    }
+    else if ( strcmp(tokens[1], "stream") == 0 )
+    {
+        terminalOut((char *) "Streaming pin events, hit any key to stop");
+        evtStreaming = true;
+
+        while ( SerialUSB.available() == 0 )
+            events_Service();
+
+        while ( SerialUSB.available() )
+            (void) SerialUSB.read();
+
+        evtStreaming = false;
+    }
+    else if ( strcmp(tokens[1], "clear") == 0 )
+    {
+        for ( unsigned i = 0; i < EVT_PIN_CNT; i++ )
+        {
+            evtPins[i].edges = evtPins[i].asserts = 0;
+            evtPins[i].longest = evtPins[i].total = 0;
+        }
+
+        evtHistoryCount = 0;
+        evtOverflows = 0;
+        terminalOut((char *) "Pin events cleared");
+    }
+    else
+    {
+        showCommandHelp(tokens[0]);
+        return(1);
+    }
+
+    return(0);
+}
@@ -0,0 +1,613 @@
+//===================================================================
+// fru.cpp
+// FRU EEPROM parser.  The used part of the image (common header,
+// info areas and multirecord list) is read front to back in as few
+// sequential reads as possible, then every area is parsed in RAM:
+// chassis, board and product info fields, and multirecord headers
+// with DC output/load records decoded.  OEM records show their IANA #;
+// the OCP NIC 3.0 OEM record (IANA 42623, version 1) is decoded field
+// by field from ocpFields[], any bytes past the last known field are
+// dumped in hex.  The result is cached until PRSNTB[3:0] changes so
+// repeat queries cost no I2C traffic.
+//===================================================================
+#include <Arduino.h>
+#include <time.h>
+#include "main.hpp"
+#include "commands.hpp"
+#include "pins.hpp"
+#include "eeprom.hpp"
+#include "events.hpp"
+#include "fru.hpp"
+#include "txfmt.hpp"
+
+static char                 outBfr[OUTBFR_SIZE];
+const uint32_t              jan1996 = 820454400;        // epoch time (secs) of 1/1/1996 00:00
+
+static fru_info_t           fruCache;
+static bool                 fruValid = false;
+static uint32_t             fruPresenceChanges;         // events_PresenceChanges() when read
+static uint8_t              fruPresence;                // PRSNTB[3:0] when read
+
+// OCP NIC 3.0 FRU OEM record, version 1
+static const fru_ocp_field_t ocpFields[] = {
+    {3,  1, "Record version",   ""},
+    {4,  1, "Max power MAIN",   " W"},
+    {5,  1, "Max power AUX",    " W"},
+    {6,  1, "Hot aisle tier",   ""},
+    {7,  1, "Cold aisle tier",  ""},
+    {8,  1, "Active cooling",   ""},
+    {9,  2, "Hot aisle stby",   " LFM"},
+    {11, 2, "Cold aisle stby",  " LFM"},
+    {13, 1, "UART config 1",    ""},
+    {14, 1, "UART config 2",    ""},
+    {15, 1, "USB present",      ""},
+    {16, 1, "Manageability",    ""},
+    {17, 1, "FRU write prot",   ""},
+    {18, 1, "Ethernet ports",   ""},
+};
+
+static const char           *boardFieldNames[] = {"Manufacturer", "Product Name", "Serial Number", "Part Number", "FRU File ID"};
+static const char           *productFieldNames[] = {"Manufacturer", "Product Name", "Part/Model #", "Version", "Serial Number",
+                                                    "Asset Tag", "FRU File ID"};
+static const char           *chassisFieldNames[] = {"Part Number", "Serial Number"};
+
+#define BOARD_FIXED_BYTES       sizeof(board_hdr_t)
+#define PRODUCT_FIXED_BYTES     3           // version, length, language
+#define CHASSIS_FIXED_BYTES     3           // version, length, chassis type
+
+/**
+  * @name   presenceBits
+  * @brief  read PRSNTB[3:0]
+  * @param  None
+  * @retval uint8_t  PRSNTB3 in bit 3 .. PRSNTB0 in bit 0
+  */
+static uint8_t presenceBits(void)
+{
+    pin_snapshot_t  snap;
+
+    pinSnapshotRead(&snap);
+    return((pinSnapshotGet(&snap, OCP_PRSNTB3_N) << 3) | (pinSnapshotGet(&snap, OCP_PRSNTB2_N) << 2) |
+           (pinSnapshotGet(&snap, OCP_PRSNTB1_N) << 1) | pinSnapshotGet(&snap, OCP_PRSNTB0_N));
+}
+
+/**
+  * @name   checksum
+  * @brief  8-bit zero checksum
+  * @param  p  data
+  * @param  len  bytes
+  * @retval uint8_t  sum of bytes, 0 if the data's checksum byte is right
+  */
+static uint8_t checksum(const uint8_t *p, uint16_t len)
+{
+    uint8_t         sum = 0;
+
+    while ( len-- > 0 )
+        sum += *p++;
+
+    return(sum);
+}
+
+/**
+  * @name   imageLength
+  * @brief  bytes of image needed to hold everything known so far
+  * @param  image  image read so far
+  * @param  have  bytes of image read
+  * @retval uint16_t  bytes needed; > have means read more
+  * @note   area lengths and the multirecord list are only known once
+  *         their first bytes have been read, so call again after each read
+  */
+static uint16_t imageLength(const uint8_t *image, uint16_t have)
+{
+    const common_hdr_t  *hdr = (const common_hdr_t *) image;
+    const uint8_t       areas[3] = {hdr->chassis_area_offset, hdr->board_area_offset, hdr->product_area_offset};
+    uint16_t            need = sizeof(common_hdr_t);
+    uint16_t            offset;
+
+    if ( have < sizeof(common_hdr_t) )
+        return(need);
+
+    if ( hdr->internal_area_offset )
+        need = max(need, hdr->internal_area_offset * 8 + 1);
+
+    for ( int i = 0; i < 3; i++ )
+    {
+        offset = areas[i] * 8;
+        if ( offset == 0 )
+            continue;
+
+        if ( offset + 2 > have )
+            need = max(need, offset + 2);
+        else
+            need = max(need, offset + image[offset + 1] * 8);
+    }
+
+    offset = hdr->multirecord_area_offset * 8;
+    if ( offset )
+    {
+        for ( int n = 0; n < FRU_MAX_RECORDS; n++ )
+        {
+            if ( offset + FRU_MR_HDR_SIZE > have )
+            {
+                need = max(need, offset + FRU_MR_HDR_SIZE);
+                break;
+            }
+
+            need = max(need, offset + FRU_MR_HDR_SIZE + image[offset + 2]);
+            if ( image[offset + 1] & FRU_MR_END_OF_LIST )
+                break;
+
+            offset += FRU_MR_HDR_SIZE + image[offset + 2];
+        }
+    }
+
+    return(min(need, FRU_IMAGE_MAX));
+}
+
+/**
+  * @name   readImage
+  * @brief  read the used part of the FRU image into fruCache.image
+  * @param  i2cAddr  FRU EEPROM SMB address
+  * @retval bool  false if no FRU image (format version) found
+  */
+static bool readImage(uint8_t i2cAddr)
+{
+    uint16_t        have = 0;
+    uint16_t        need;
+    uint16_t        len;
+    uint32_t        xfers = eeprom_ReadTransactions();
+
+    memset(fruCache.image, 0xFF, sizeof(fruCache.image));
+    fruCache.reads = 0;
+
+    // sequential reads of whole buffers, usually one covers the used image
+    need = sizeof(common_hdr_t);
+    while ( have < need )
+    {
+        len = min(FRU_IMAGE_MAX - have, EEPROM_MAX_LEN);
+        if ( readEEPROM(i2cAddr, have, &fruCache.image[have], len) == false )
+            return(false);
+
+        fruCache.reads = eeprom_ReadTransactions() - xfers;
+        have += len;
+
+        if ( (fruCache.image[0] & 0x0F) != FRU_FORMAT_VERSION )
+            return(false);
+
+        need = imageLength(fruCache.image, have);
+    }
+
+    fruCache.imageLen = need;
+    return(true);
+}
+
+/**
+  * @name   parseArea
+  * @brief  parse a chassis, board or product info area
+  * @param  a  area to fill
+  * @param  offset  image offset of area, 0 = not present
+  * @param  fixedBytes  bytes before the first type/length byte
+  * @retval None
+  */
+static void parseArea(fru_area_t *a, uint16_t offset, uint8_t fixedBytes)
+{
+    const uint8_t   *image = fruCache.image;
+    uint16_t        end;
+    uint16_t        p;
+
+    memset(a, 0, sizeof(fru_area_t));
+    a->offset = offset;
+
+    if ( offset == 0 )
+        return;
+
+    if ( offset + fixedBytes > fruCache.imageLen )
+    {
+        a->truncated = true;
+        return;
+    }
+
+    a->version = image[offset] & 0x0F;
+    a->length = image[offset + 1] * 8;
+    a->langType = image[offset + 2];
+
+    end = offset + a->length;
+    if ( a->length == 0 || end > fruCache.imageLen )
+    {
+        a->truncated = true;
+        end = fruCache.imageLen;
+    }
+    else
+    {
+        a->cksumOk = (checksum(&image[offset], a->length) == 0);
+        end--;                                          // checksum byte
+    }
+
+    for ( p = offset + fixedBytes; p < end && image[p] != FRU_END_OF_FIELDS && a->fieldCount < FRU_MAX_FIELDS; )
+    {
+        fru_field_t     *f = &a->fields[a->fieldCount];
+
+        f->offset = p;
+        f->type = GET_TYPE(image[p]);
+        f->length = GET_LENGTH(image[p]);
+        p += 1 + f->length;
+
+        if ( p > end )
+        {
+            a->truncated = true;
+            break;
+        }
+
+        a->fieldCount++;
+    }
+}
+
+/**
+  * @name   parseRecords
+  * @brief  walk the multirecord list
+  * @param  offset  image offset of first record, 0 = none
+  * @retval None
+  */
+static void parseRecords(uint16_t offset)
+{
+    const uint8_t   *image = fruCache.image;
+    fru_record_t    *r;
+
+    fruCache.recordCount = 0;
+    fruCache.recordsTruncated = false;
+
+    if ( offset == 0 )
+        return;
+
+    while ( 1 )
+    {
+        if ( fruCache.recordCount >= FRU_MAX_RECORDS || offset + FRU_MR_HDR_SIZE > fruCache.imageLen ||
+             offset + FRU_MR_HDR_SIZE + image[offset + 2] > fruCache.imageLen )
+        {
+            fruCache.recordsTruncated = true;
+            return;
+        }
+
+        r = &fruCache.records[fruCache.recordCount++];
+        r->offset = offset;
+        r->type = image[offset];
+        r->version = image[offset + 1] & 0x0F;
+        r->length = image[offset + 2];
+        r->hdrCksumOk = (checksum(&image[offset], FRU_MR_HDR_SIZE) == 0);
+        r->dataCksumOk = ((uint8_t) (checksum(&image[offset + FRU_MR_HDR_SIZE], r->length) + image[offset + 3]) == 0);
+
+        if ( image[offset + 1] & FRU_MR_END_OF_LIST )
+            return;
+
+        offset += FRU_MR_HDR_SIZE + r->length;
+    }
+}
+
+/**
+  * @name   fru_Invalidate
+  * @brief  drop cached FRU contents so the next fru_Get() re-reads
+  * @param  None
+  * @retval None
+  */
+void fru_Invalidate(void)
+{
+    fruValid = false;
+}
+
+/**
+  * @name   fru_Get
+  * @brief  get parsed FRU EEPROM contents
+  * @param  i2cAddr  FRU EEPROM SMB address
+  * @param  cached  set true if no I2C read was needed
+  * @retval const fru_info_t *  NULL if no FRU image found
+  * @note   the cache is kept until PRSNTB[3:0] changes level or has
+  *         had an edge since the read (card swapped between queries)
+  */
+const fru_info_t *fru_Get(uint8_t i2cAddr, bool *cached)
+{
+    const common_hdr_t  *hdr = (const common_hdr_t *) fruCache.image;
+    uint32_t            startTime;
+
+    // pick up PRSNTB edges queued by the EIC
+    events_Service();
+
+    *cached = (fruValid && fruCache.i2cAddr == i2cAddr && presenceBits() == fruPresence &&
+               events_PresenceChanges() == fruPresenceChanges);
+    if ( *cached )
+        return(&fruCache);
+
+    fruValid = false;
+    fruPresence = presenceBits();
+    fruPresenceChanges = events_PresenceChanges();
+    fruCache.i2cAddr = i2cAddr;
+
+    startTime = micros();
+    if ( readImage(i2cAddr) == false )
+        return(NULL);
+
+    memcpy(&fruCache.header, hdr, sizeof(common_hdr_t));
+    fruCache.hdrCksumOk = (checksum(fruCache.image, sizeof(common_hdr_t)) == 0);
+    fruCache.internalOffset = hdr->internal_area_offset * 8;
+    fruCache.multirecordOffset = hdr->multirecord_area_offset * 8;
+
+    parseArea(&fruCache.chassis, hdr->chassis_area_offset * 8, CHASSIS_FIXED_BYTES);
+    parseArea(&fruCache.board, hdr->board_area_offset * 8, BOARD_FIXED_BYTES);
+    parseArea(&fruCache.product, hdr->product_area_offset * 8, PRODUCT_FIXED_BYTES);
+    parseRecords(fruCache.multirecordOffset);
+
+    fruCache.mfgMinutes = 0;
+    if ( fruCache.board.offset && fruCache.board.truncated == false )
+    {
+        const uint8_t   *t = &fruCache.image[fruCache.board.offset + 3];
+
+        fruCache.mfgMinutes = t[2] << 16 | t[1] << 8 | t[0];
+    }
+
+    fruCache.readUsec = micros() - startTime;
+    fruCache.busHz = eeprom_BusHz();
+    fruValid = true;
+    return(&fruCache);
+}
+
+/**
+  * @name   fru_FieldText
+  * @brief  decode a type/length field to text
+  * @param  fru  parsed FRU
+  * @param  f  field
+  * @param  s  text buffer
+  * @param  size  size of s
+  * @retval None
+  */
+void fru_FieldText(const fru_info_t *fru, const fru_field_t *f, char *s, uint16_t size)
+{
+    const uint8_t   *d = &fru->image[f->offset + 1];
+    const char      bcdPlus[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', ' ', '-', '.', '?', '?', '?'};
+    char            *end = s + size - 1;
+
+    if ( f->type == 3 )
+    {
+        // 8-bit ASCII
+        for ( int i = 0; i < f->length && s < end; i++ )
+            *s++ = isprint(d[i]) ? d[i] : '.';
+    }
+    else if ( f->type == 2 )
+    {
+        // 6-bit packed ASCII, little endian bit stream, 0x00 = ' '
+        for ( uint16_t bit = 0; bit + 6 <= f->length * 8 && s < end; bit += 6 )
+        {
+            uint16_t    v = d[bit >> 3];
+
+            if ( (bit >> 3) + 1 < f->length )
+                v |= d[(bit >> 3) + 1] << 8;
+
+            *s++ = ((v >> (bit & 7)) & 0x3F) + ' ';
+        }
+    }
+    else if ( f->type == 1 )
+    {
+        // BCD plus per 13.1 in platform mgt spec
+        for ( int i = 0; i < f->length && s + 1 < end; i++ )
+        {
+            *s++ = bcdPlus[d[i] >> 4];
+            *s++ = bcdPlus[d[i] & 0x0F];
+        }
+    }
+    else
+    {
+        // binary or unspecified
+        for ( int i = 0; i < f->length && s + 3 < end; i++ )
+            s += sprintf(s, "%02X ", d[i]);
+    }
+
+    *s = 0;
+}
+
+/**
+  * @name   showArea
+  * @brief  display info area fields
+  * @param  fru  parsed FRU
+  * @param  a  area
+  * @param  names  names of the fixed fields
+  * @param  nameCount  # of fixed fields
+  * @retval None
+  */
+static void showArea(const fru_info_t *fru, const fru_area_t *a, const char **names, int nameCount)
+{
+    char            name[20];
+    char            text[128];
+
+    sprintf(outBfr, "Area Length:     %d (checksum %s)", a->length,
+            a->truncated ? "n/a, area truncated" : (a->cksumOk ? "OK" : "BAD"));
+    SHOW();
+
+    for ( int i = 0; i < a->fieldCount; i++ )
+    {
+        if ( i < nameCount )
+            strcpy(name, names[i]);
+        else
+            sprintf(name, "Custom %d", i - nameCount + 1);
+
+        fru_FieldText(fru, &a->fields[i], text, sizeof(text));
+        sprintf(outBfr, "%-16s %s", strcat(name, ":"), text);
+        SHOW();
+    }
+}
+
+/**
+  * @name   showOcpRecord
+  * @brief  display the fields of an OCP NIC 3.0 OEM record
+  * @param  d  record data, IANA # first
+  * @param  length  data bytes
+  * @retval None
+  * @note   fields past the end of a short record are left out
+  */
+static void showOcpRecord(const uint8_t *d, uint8_t length)
+{
+    uint8_t         end = 3;
+
+    for ( unsigned i = 0; i < sizeof(ocpFields) / sizeof(fru_ocp_field_t); i++ )
+    {
+        const fru_ocp_field_t   *f = &ocpFields[i];
+
+        if ( f->offset + f->size > length )
+            break;
+
+        sprintf(outBfr, "  %-16s %u%s", f->name, (f->size == 2) ? (d[f->offset] | d[f->offset + 1] << 8) : d[f->offset],
+                f->units);
+        SHOW();
+        end = f->offset + f->size;
+    }
+
+    if ( length > end )
+    {
+        sprintf(outBfr, "  %d more bytes:", length - end);
+        SHOW();
+        dumpMem((unsigned char *) &d[end], length - end);
+    }
+}
+
+/**
+  * @name   showRecord
+  * @brief  display one multirecord
+  * @param  fru  parsed FRU
+  * @param  n  record #
+  * @retval None
+  */
+static void showRecord(const fru_info_t *fru, int n)
+{
+    const fru_record_t  *r = &fru->records[n];
+    const uint8_t       *d = &fru->image[r->offset + FRU_MR_HDR_SIZE];
+    const char          *typeName = "Reserved";
+    uint32_t            iana;
+
+    switch ( r->type )
+    {
+    case FRU_MR_POWER_SUPPLY:   typeName = "Power Supply Info";     break;
+    case FRU_MR_DC_OUTPUT:      typeName = "DC Output";             break;
+    case FRU_MR_DC_LOAD:        typeName = "DC Load";               break;
+    case FRU_MR_MGMT_ACCESS:    typeName = "Management Access";     break;
+    case FRU_MR_BASE_COMPAT:    typeName = "Base Compatibility";    break;
+    case FRU_MR_EXT_COMPAT:     typeName = "Ext Compatibility";     break;
+    default:
+        if ( r->type >= FRU_MR_OEM_FIRST )
+            typeName = "OEM";
+        break;
+    }
+
+    sprintf(outBfr, "Record %d @ %d:   type %02X %s, %d bytes (header %s, data %s)", n, r->offset, r->type, typeName,
+            r->length, r->hdrCksumOk ? "OK" : "BAD", r->dataCksumOk ? "OK" : "BAD");
+    SHOW();
+
+    // section 18.2 and 18.2a, voltages in 10 mV, ripple in mV, current in mA
+    if ( (r->type == FRU_MR_DC_OUTPUT || r->type == FRU_MR_DC_LOAD) && r->length >= 13 )
+    {
+        int16_t     v[3] = {(int16_t) (d[1] | d[2] << 8), (int16_t) (d[3] | d[4] << 8), (int16_t) (d[5] | d[6] << 8)};
+
+        TxLine      line;
+
+        line << "  Output " << txDec(d[0] & 0x0F);
+        if ( r->type == FRU_MR_DC_OUTPUT )
+            line << ((d[0] & 0x80) ? " (standby)" : "") << ": " << txFixed<2>(v[0]) << " V -" << txFixed<2>(v[1])
+                 << "/+" << txFixed<2>(v[2]) << " V";
+        else
+            line << ": " << txFixed<2>(v[0]) << " V (" << txFixed<2>(v[1]) << ".." << txFixed<2>(v[2]) << " V)";
+        line.end();
+
+        sprintf(outBfr, "  Ripple %u mV, current %u..%u mA", d[7] | d[8] << 8, d[9] | d[10] << 8, d[11] | d[12] << 8);
+        SHOW();
+    }
+    else if ( r->type >= FRU_MR_OEM_FIRST && r->length >= 3 )
+    {
+        iana = d[0] | d[1] << 8 | d[2] << 16;
+        sprintf(outBfr, "  Manufacturer:  IANA %lu%s", iana, (iana == FRU_OCP_IANA) ? " (Open Compute Project)" : "");
+        SHOW();
+
+        if ( iana == FRU_OCP_IANA && r->length > 3 && d[3] == FRU_OCP_RECORD_VERSION )
+            showOcpRecord(d, r->length);
+        else if ( r->length > 3 )
+            dumpMem((unsigned char *) &d[3], r->length - 3);
+    }
+    else if ( r->length )
+    {
+        dumpMem((unsigned char *) d, r->length);
+    }
+}
+
+/**
+  * @name   fru_Show
+  * @brief  display parsed FRU EEPROM contents
+  * @param  fru  from fru_Get()
+  * @retval None
+  */
+void fru_Show(const fru_info_t *fru)
+{
+    char            tempStr[32];
+    time_t          t;
+
+    sprintf(outBfr, "Image:           %d bytes in %d I2C read%s, %lu usec at %lu Hz", fru->imageLen, fru->reads,
+            (fru->reads == 1) ? "" : "s", fru->readUsec, fru->busHz);
+    SHOW();
+
+    terminalOut((char *) "--- COMMON HEADER DATA");
+    sprintf(outBfr, "Format version:  %d (checksum %s)", fru->header.format_vers & 0xF, fru->hdrCksumOk ? "OK" : "BAD");
+    SHOW();
+
+    sprintf(outBfr, "Int Use Area:    %d", fru->internalOffset);
+    SHOW();
+    sprintf(outBfr, "Chassis Area:    %d", fru->chassis.offset);
+    SHOW();
+    sprintf(outBfr, "Board Area:      %d", fru->board.offset);
+    SHOW();
+    sprintf(outBfr, "Product Area:    %d", fru->product.offset);
+    SHOW();
+    sprintf(outBfr, "MRecord Area:    %d", fru->multirecordOffset);
+    SHOW();
+
+    if ( fru->chassis.offset )
+    {
+        terminalOut((char *) "--- CHASSIS AREA DATA");
+        sprintf(outBfr, "Chassis Type:    %02X", fru->chassis.langType);
+        SHOW();
+        showArea(fru, &fru->chassis, chassisFieldNames, sizeof(chassisFieldNames) / sizeof(char *));
+    }
+
+    if ( fru->board.offset )
+    {
+        terminalOut((char *) "--- BOARD AREA DATA");
+        sprintf(outBfr, "Language Code:   %02X", fru->board.langType);
+        SHOW();
+
+        // time in EEPROM is in minutes since 1/1/1996, 0 = unspecified
+        if ( fru->mfgMinutes )
+        {
+            t = fru->mfgMinutes * 60 + jan1996;
+            strcpy(tempStr, asctime(gmtime(&t)));
+            tempStr[strcspn(tempStr, "\n")] = 0;
+        }
+        else
+        {
+            strcpy(tempStr, "unspecified");
+        }
+
+        sprintf(outBfr, "Mfg Date/Time:   %s", tempStr);
+        SHOW();
+        showArea(fru, &fru->board, boardFieldNames, sizeof(boardFieldNames) / sizeof(char *));
+    }
+
+    if ( fru->product.offset )
+    {
+        terminalOut((char *) "--- PRODUCT AREA DATA");
+        sprintf(outBfr, "Language Code:   %02X", fru->product.langType);
+        SHOW();
+        showArea(fru, &fru->product, productFieldNames, sizeof(productFieldNames) / sizeof(char *));
+    }
+
+    if ( fru->multirecordOffset )
+    {
+        terminalOut((char *) "--- MULTIRECORD AREA DATA");
+        for ( int n = 0; n < fru->recordCount; n++ )
+            showRecord(fru, n);
+
+        if ( fru->recordsTruncated )
+            terminalOut((char *) "WARNING: multirecord list has no end-of-list record within the image");
+    }
+}
@@ -0,0 +1,827 @@
+//===================================================================
+// i2cq.cpp
+// I2C transaction queue.  SERCOM1 runs as I2C master in smart mode
+// with automatic length (ADDR.LENEN), so once a phase is started the
+// address, the data bytes (moved by DMA_CH_I2C) and the closing
+// NACK/STOP need no CPU time.  A transaction is a write phase and/or
+// a read phase, each ended by a STOP; the devices on this bus (24C64
+// FRU EEPROM, INA219s) keep their address/register pointer across a
+// STOP, so no repeated start is needed.
+//
+// Nothing here blocks.  engineStep() checks the bus and starts the
+// next phase or transaction; it runs from the DMA completion
+// interrupt, from the 1 msec SysTick hook and from i2cq_Service(),
+// so queued transactions keep moving while a command is running.
+// One context at a time owns the engine (inStep); another that wants a
+// step while it is owned leaves stepAgain for the owner instead.  The
+// step itself runs with interrupts on, only the queue and ownership
+// updates mask them, so a bus recovery or a long callback never holds
+// off the EIC (TEMP_CRIT trip) or USB.
+// SERCOM1_Handler belongs to the Wire library, which is why SERCOM
+// interrupts are not used.
+//
+// Telemetry transactions are started before any normal ones waiting,
+// but never preempt the one on the bus.
+//===================================================================
+#include <Arduino.h>
+#include "main.hpp"
+#include "dma.hpp"
+#include "i2cq.hpp"
+#include "protect.hpp"
+
+#define I2CQ_PMUX_FUNC          2           // peripheral function C = SERCOM
+#define I2CQ_RISE_NSEC          125         // SCL rise time used in the BAUD calculation
+
+#define I2CQ_BUSSTATE_IDLE      1
+#define I2CQ_BUSSTATE_OWNER     2
+#define I2CQ_CMD_STOP           3
+
+#define I2CQ_RECOVER_CLOCKS     9           // enough for a slave stuck mid byte + ACK
+#define I2CQ_RECOVER_HALF_US    5           // 100 kHz
+
+// busPins[] index of each line, I2CQ_LINE_xxx = 1 << index
+#define I2CQ_LINE_SDA_IDX       0
+#define I2CQ_LINE_SCL_IDX       1
+
+#define I2CQ_STATUS_ERRORS      (SERCOM_I2CM_STATUS_BUSERR | SERCOM_I2CM_STATUS_ARBLOST | SERCOM_I2CM_STATUS_LOWTOUT)
+
+typedef enum {
+    PHASE_IDLE = 0,
+    PHASE_PROBE,                            // address only
+    PHASE_TX,
+    PHASE_RX,
+    PHASE_TURNAROUND,                       // write done, STOP still going out
+} I2CQ_PHASE;
+
+static const uint8_t        busPins[] = {PIN_WIRE_SDA, PIN_WIRE_SCL};
+
+static i2cq_xfer_t          *queue[I2CQ_PRIO_CNT][I2CQ_DEPTH];
+static uint8_t              queueHead[I2CQ_PRIO_CNT];
+static uint8_t              queueCount[I2CQ_PRIO_CNT];
+
+static i2cq_xfer_t          *cur = NULL;    // transaction on the bus
+static I2CQ_PHASE           phase = PHASE_IDLE;
+static uint32_t             curStart;       // micros() when it started
+static uint32_t             curTimeoutUs;
+static uint32_t             busClockHz = 0;
+static volatile bool        inStep = false;
+static volatile bool        stepAgain = false;  // asked for while inStep
+static volatile bool        dmaDone;
+static volatile bool        dmaError;
+
+static i2cq_stats_t         stats;
+
+/**
+  * @name   i2cqSync
+  * @brief  wait for SERCOM register synchronization
+  * @param  None
+  * @retval None
+  */
+static void i2cqSync(void)
+{
+    while (I2CQ_SERCOM->I2CM.SYNCBUSY.reg);
+}
+
+/**
+  * @name   busState
+  * @brief  get STATUS.BUSSTATE
+  * @param  None
+  * @retval uint8_t  0 = unknown, 1 = idle, 2 = owner, 3 = busy
+  */
+static uint8_t busState(void)
+{
+    return((I2CQ_SERCOM->I2CM.STATUS.reg & SERCOM_I2CM_STATUS_BUSSTATE_Msk) >> SERCOM_I2CM_STATUS_BUSSTATE_Pos);
+}
+
+/**
+  * @name   busForceIdle
+  * @brief  tell the SERCOM the bus is idle
+  * @param  None
+  * @retval None
+  * @note   needed after enable, when the state is unknown
+  */
+static void busForceIdle(void)
+{
+    I2CQ_SERCOM->I2CM.STATUS.reg = SERCOM_I2CM_STATUS_BUSSTATE(I2CQ_BUSSTATE_IDLE);
+    i2cqSync();
+}
+
+/**
+  * @name   busSetClock
+  * @brief  set SCL rate
+  * @param  hz  I2CQ_STD_HZ..I2CQ_MAX_HZ
+  * @retval None
+  * @note   BAUD is enable-protected, so the SERCOM is cycled
+  */
+static void busSetClock(uint32_t hz)
+{
+    uint32_t        baud;
+
+    if ( hz > I2CQ_MAX_HZ )
+        hz = I2CQ_MAX_HZ;
+
+    // fSCL = GCLK / (10 + 2 * BAUD + GCLK * Trise)
+    baud = SystemCoreClock / (2 * hz) - 5 - (((SystemCoreClock / 1000000) * I2CQ_RISE_NSEC) / 2000);
+    if ( baud > 255 )
+        baud = 255;
+
+    I2CQ_SERCOM->I2CM.CTRLA.bit.ENABLE = 0;
+    i2cqSync();
+
+    I2CQ_SERCOM->I2CM.BAUD.reg = SERCOM_I2CM_BAUD_BAUD(baud);
+    I2CQ_SERCOM->I2CM.CTRLA.bit.SPEED = (hz > I2CQ_FAST_HZ) ? 1 : 0;
+
+    I2CQ_SERCOM->I2CM.CTRLA.bit.ENABLE = 1;
+    i2cqSync();
+    busForceIdle();
+
+    busClockHz = hz;
+}
+
+/**
+  * @name   busStop
+  * @brief  NACK (if reading) and send STOP
+  * @param  None
+  * @retval None
+  */
+static void busStop(void)
+{
+    I2CQ_SERCOM->I2CM.CTRLB.reg |= SERCOM_I2CM_CTRLB_ACKACT | SERCOM_I2CM_CTRLB_CMD(I2CQ_CMD_STOP);
+    i2cqSync();
+}
+
+/**
+  * @name   pinMux
+  * @brief  hand SDA/SCL to SERCOM1 or back to PORT
+  * @param  enable  true = SERCOM, false = GPIO
+  * @retval None
+  * @note   input buffers stay on so busLines() works either way; as
+  *         GPIO OUT is 0 and DIR alone drives a line low (open drain)
+  */
+static void pinMux(bool enable)
+{
+    for ( unsigned i = 0; i < sizeof(busPins); i++ )
+    {
+        uint8_t     group = g_APinDescription[busPins[i]].ulPort;
+        uint8_t     bit = g_APinDescription[busPins[i]].ulPin;
+
+        if ( enable )
+        {
+            if ( bit & 1 )
+                PORT->Group[group].PMUX[bit >> 1].reg = (PORT->Group[group].PMUX[bit >> 1].reg & ~PORT_PMUX_PMUXO_Msk) | PORT_PMUX_PMUXO(I2CQ_PMUX_FUNC);
+            else
+                PORT->Group[group].PMUX[bit >> 1].reg = (PORT->Group[group].PMUX[bit >> 1].reg & ~PORT_PMUX_PMUXE_Msk) | PORT_PMUX_PMUXE(I2CQ_PMUX_FUNC);
+
+            PORT->Group[group].PINCFG[bit].reg |= (PORT_PINCFG_PMUXEN | PORT_PINCFG_INEN);
+        }
+        else
+        {
+            PORT->Group[group].DIRCLR.reg = (1ul << bit);
+            PORT->Group[group].OUTCLR.reg = (1ul << bit);
+            PORT->Group[group].PINCFG[bit].reg = (PORT->Group[group].PINCFG[bit].reg & ~PORT_PINCFG_PMUXEN) | PORT_PINCFG_INEN;
+        }
+    }
+}
+
+/**
+  * @name   busLines
+  * @brief  read SDA/SCL levels
+  * @param  None
+  * @retval uint8_t  I2CQ_LINE_xxx bits of the lines that are high
+  */
+static uint8_t busLines(void)
+{
+    uint8_t         lines = 0;
+
+    for ( unsigned i = 0; i < sizeof(busPins); i++ )
+    {
+        uint8_t     group = g_APinDescription[busPins[i]].ulPort;
+        uint8_t     bit = g_APinDescription[busPins[i]].ulPin;
+
+        if ( PORT->Group[group].IN.reg & (1ul << bit) )
+            lines |= (1 << i);
+    }
+
+    return(lines);
+}
+
+/**
+  * @name   lineDrive
+  * @brief  pull a line low or release it
+  * @param  line  index into busPins[]
+  * @param  low  true = drive low
+  * @retval None
+  */
+static void lineDrive(uint8_t line, bool low)
+{
+    uint8_t         group = g_APinDescription[busPins[line]].ulPort;
+    uint32_t        mask = 1ul << g_APinDescription[busPins[line]].ulPin;
+
+    if ( low )
+        PORT->Group[group].DIRSET.reg = mask;
+    else
+        PORT->Group[group].DIRCLR.reg = mask;
+
+    delayMicroseconds(I2CQ_RECOVER_HALF_US);
+}
+
+/**
+  * @name   busRecover
+  * @brief  free a bus held by a slave that lost count of the clocks
+  * @param  None
+  * @retval bool  true if both lines are high afterwards
+  * @note   up to I2CQ_RECOVER_CLOCKS SCL pulses until the slave lets
+  *         go of SDA, then a STOP; ~100 usec, caller owns the engine
+  */
+static bool busRecover(void)
+{
+    uint8_t         clocks;
+    bool            ok;
+
+    I2CQ_SERCOM->I2CM.CTRLA.bit.ENABLE = 0;
+    i2cqSync();
+    pinMux(false);
+
+    for ( clocks = 0; clocks < I2CQ_RECOVER_CLOCKS && (busLines() & I2CQ_LINE_SDA) == 0; clocks++ )
+    {
+        lineDrive(I2CQ_LINE_SCL_IDX, true);
+        lineDrive(I2CQ_LINE_SCL_IDX, false);
+    }
+
+    // STOP: SDA rises while SCL is high
+    lineDrive(I2CQ_LINE_SCL_IDX, true);
+    lineDrive(I2CQ_LINE_SDA_IDX, true);
+    lineDrive(I2CQ_LINE_SCL_IDX, false);
+    lineDrive(I2CQ_LINE_SDA_IDX, false);
+
+    ok = (busLines() == (I2CQ_LINE_SDA | I2CQ_LINE_SCL));
+
+    stats.recoveries++;
+    stats.recoverClocks += clocks;
+    if ( ok == false )
+        stats.recoverFails++;
+
+    pinMux(true);
+    busSetClock(busClockHz);
+    return(ok);
+}
+
+/**
+  * @name   finish
+  * @brief  end the current transaction and run its callback
+  * @param  status  I2CQ_OK or an error
+  * @retval None
+  */
+static void finish(I2CQ_STATUS status)
+{
+    i2cq_xfer_t     *x = cur;
+
+    stats.done++;
+    if ( status == I2CQ_NACK )
+        stats.nacks++;
+    else if ( status == I2CQ_BUSERR )
+        stats.errors++;
+    else if ( status == I2CQ_TIMEOUT )
+        stats.timeouts++;
+
+    cur = NULL;
+    phase = PHASE_IDLE;
+
+    x->usec = micros() - x->usec;
+    x->status = status;
+
+    if ( x->callback != NULL )
+        (x->callback) (x);
+}
+
+/**
+  * @name   abortXfer
+  * @brief  stop DMA, release the bus and end the current transaction
+  * @param  status  error to report
+  * @retval None
+  */
+static void abortXfer(I2CQ_STATUS status)
+{
+    dma_channelDisable(DMA_CH_I2C);
+
+    if ( busState() == I2CQ_BUSSTATE_OWNER )
+        busStop();
+
+    // STOP could not be sent (SCL held low, lost arbitration); start over
+    if ( busState() != I2CQ_BUSSTATE_IDLE )
+        busSetClock(busClockHz);
+
+    // a slave still holding a line gets clocked free before anything else runs
+    if ( status != I2CQ_NACK && busLines() != (I2CQ_LINE_SDA | I2CQ_LINE_SCL) )
+        (void) busRecover();
+
+    finish(status);
+}
+
+/**
+  * @name   startPhase
+  * @brief  set up DMA and send the address of a write or read phase
+  * @param  read  true = read phase
+  * @retval None
+  */
+static void startPhase(bool read)
+{
+    DmacDescriptor  *d = &dmaDescriptors[DMA_CH_I2C];
+    uint8_t         len = read ? cur->rxLen : cur->txLen;
+
+    // the DMAC wants the address after the last beat
+    if ( read )
+    {
+        d->BTCTRL.reg = DMAC_BTCTRL_VALID | DMAC_BTCTRL_BEATSIZE_BYTE | DMAC_BTCTRL_DSTINC | DMAC_BTCTRL_BLOCKACT_INT;
+        d->SRCADDR.reg = (uint32_t) &I2CQ_SERCOM->I2CM.DATA.reg;
+        d->DSTADDR.reg = (uint32_t) &cur->rx[len];
+    }
+    else
+    {
+        d->BTCTRL.reg = DMAC_BTCTRL_VALID | DMAC_BTCTRL_BEATSIZE_BYTE | DMAC_BTCTRL_SRCINC | DMAC_BTCTRL_BLOCKACT_INT;
+        d->SRCADDR.reg = (uint32_t) &cur->tx[len];
+        d->DSTADDR.reg = (uint32_t) &I2CQ_SERCOM->I2CM.DATA.reg;
+    }
+    d->BTCNT.reg = len;
+    d->DESCADDR.reg = 0;
+
+    dma_channelConfig(DMA_CH_I2C, DMAC_CHCTRLB_TRIGSRC(read ? SERCOM1_DMAC_ID_RX : SERCOM1_DMAC_ID_TX) |
+                      DMAC_CHCTRLB_TRIGACT_BEAT | DMAC_CHCTRLB_LVL(0), DMAC_CHINTENSET_TCMPL | DMAC_CHINTENSET_TERR);
+    dmaDone = dmaError = false;
+    dma_channelEnable(DMA_CH_I2C);
+
+    // ACK every byte read; LENEN NACKs the last one and sends STOP
+    I2CQ_SERCOM->I2CM.CTRLB.reg &= ~(SERCOM_I2CM_CTRLB_ACKACT | SERCOM_I2CM_CTRLB_CMD_Msk);
+    I2CQ_SERCOM->I2CM.STATUS.reg = I2CQ_STATUS_ERRORS | SERCOM_I2CM_STATUS_LENERR;
+    I2CQ_SERCOM->I2CM.INTFLAG.reg = SERCOM_I2CM_INTFLAG_MASK;
+
+    I2CQ_SERCOM->I2CM.ADDR.reg = SERCOM_I2CM_ADDR_ADDR((cur->addr << 1) | (read ? 1 : 0)) |
+                                 SERCOM_I2CM_ADDR_LENEN | SERCOM_I2CM_ADDR_LEN(len);
+    i2cqSync();
+
+    phase = read ? PHASE_RX : PHASE_TX;
+}
+
+/**
+  * @name   startNext
+  * @brief  take the next transaction off the queue and start it
+  * @param  None
+  * @retval None
+  */
+static void startNext(void)
+{
+    i2cq_xfer_t     *x = NULL;
+    uint32_t        wait;
+    uint32_t        primask;
+
+    // previous STOP still going out
+    if ( busState() == I2CQ_BUSSTATE_OWNER )
+        return;
+
+    // i2cq_Submit() may run from SysTick or a DMA callback
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    for ( uint8_t prio = 0; prio < I2CQ_PRIO_CNT && x == NULL; prio++ )
+    {
+        if ( queueCount[prio] )
+        {
+            x = queue[prio][queueHead[prio]];
+            queueHead[prio] = (queueHead[prio] + 1) % I2CQ_DEPTH;
+            queueCount[prio]--;
+        }
+    }
+
+    __set_PRIMASK(primask);
+
+    if ( x == NULL )
+        return;
+
+    // a line low with nothing on the bus: glitch or a card stuck mid byte
+    if ( busLines() != (I2CQ_LINE_SDA | I2CQ_LINE_SCL) )
+        (void) busRecover();
+
+    if ( busClockHz != x->hz )
+        busSetClock(x->hz);
+    else if ( busState() != I2CQ_BUSSTATE_IDLE )
+        busForceIdle();
+
+    cur = x;
+    cur->status = I2CQ_BUSY;
+    curStart = micros();
+
+    wait = curStart - cur->usec;
+    if ( wait > stats.waitMaxUsec )
+        stats.waitMaxUsec = wait;
+
+    // 9 clocks per byte incl. the address, plus time for the steps in between
+    curTimeoutUs = ((x->txLen + x->rxLen + 2) * 9 * 1000000ul) / busClockHz + I2CQ_TIMEOUT_US;
+
+    if ( x->txLen )
+        startPhase(false);
+    else if ( x->rxLen )
+        startPhase(true);
+    else
+    {
+        I2CQ_SERCOM->I2CM.STATUS.reg = I2CQ_STATUS_ERRORS;
+        I2CQ_SERCOM->I2CM.INTFLAG.reg = SERCOM_I2CM_INTFLAG_MASK;
+        I2CQ_SERCOM->I2CM.ADDR.reg = SERCOM_I2CM_ADDR_ADDR(x->addr << 1);
+        i2cqSync();
+        phase = PHASE_PROBE;
+    }
+}
+
+/**
+  * @name   runPhase
+  * @brief  check the current phase for its end or an error
+  * @param  None
+  * @retval None
+  */
+static void runPhase(void)
+{
+    uint16_t        status = I2CQ_SERCOM->I2CM.STATUS.reg;
+    uint8_t         flags = I2CQ_SERCOM->I2CM.INTFLAG.reg;
+
+    if ( dmaError || (status & I2CQ_STATUS_ERRORS) )
+    {
+        abortXfer(I2CQ_BUSERR);
+        return;
+    }
+
+    switch ( phase )
+    {
+        case PHASE_PROBE:
+            if ( flags & (SERCOM_I2CM_INTFLAG_MB | SERCOM_I2CM_INTFLAG_SB) )
+            {
+                busStop();
+                finish((status & SERCOM_I2CM_STATUS_RXNACK) ? I2CQ_NACK : I2CQ_OK);
+                return;
+            }
+            break;
+
+        case PHASE_TX:
+            if ( (status & SERCOM_I2CM_STATUS_LENERR) ||
+                 ((flags & SERCOM_I2CM_INTFLAG_MB) && (status & SERCOM_I2CM_STATUS_RXNACK)) )
+            {
+                abortXfer(I2CQ_NACK);
+                return;
+            }
+
+            // last byte handed to the SERCOM; done once it is ACKed
+            if ( dmaDone && ((flags & SERCOM_I2CM_INTFLAG_MB) || busState() == I2CQ_BUSSTATE_IDLE) )
+            {
+                // LENEN sends the STOP, but don't leave the bus held if it didn't
+                if ( status & SERCOM_I2CM_STATUS_CLKHOLD )
+                    busStop();
+
+                if ( cur->rxLen == 0 )
+                {
+                    finish(I2CQ_OK);
+                    return;
+                }
+
+                // read starts on a later step once the STOP is out
+                if ( busState() == I2CQ_BUSSTATE_OWNER )
+                    phase = PHASE_TURNAROUND;
+                else
+                    startPhase(true);
+                return;
+            }
+            break;
+
+        case PHASE_RX:
+            // MB in a read = address NACKed
+            if ( flags & SERCOM_I2CM_INTFLAG_MB )
+            {
+                abortXfer(I2CQ_NACK);
+                return;
+            }
+
+            if ( dmaDone )
+            {
+                finish(I2CQ_OK);
+                return;
+            }
+            break;
+
+        case PHASE_TURNAROUND:
+            if ( busState() != I2CQ_BUSSTATE_OWNER )
+                startPhase(true);
+            break;
+
+        default:
+            break;
+    }
+
+    if ( cur != NULL && micros() - curStart > curTimeoutUs )
+        abortXfer(I2CQ_TIMEOUT);
+}
+
+/**
+  * @name   stepClaim
+  * @brief  take ownership of the engine
+  * @param  None
+  * @retval bool  true if owned now, false if another context has it
+  *         (it will run another step for this one)
+  */
+static bool stepClaim(void)
+{
+    uint32_t        primask = __get_PRIMASK();
+    bool            claimed = false;
+
+    __disable_irq();
+
+    if ( inStep )
+        stepAgain = true;
+    else
+    {
+        inStep = true;
+        stepAgain = false;
+        claimed = true;
+    }
+
+    __set_PRIMASK(primask);
+    return(claimed);
+}
+
+/**
+  * @name   stepRun
+  * @brief  advance the current transaction, start the next when done,
+  *         then give up the engine
+  * @param  None
+  * @retval None
+  * @note   caller owns the engine; steps again for each request that
+  *         came in meanwhile, so none is lost
+  */
+static void stepRun(void)
+{
+    uint32_t        primask;
+    bool            again;
+
+    do
+    {
+        if ( cur != NULL )
+            runPhase();
+
+        if ( cur == NULL )
+            startNext();
+
+        primask = __get_PRIMASK();
+        __disable_irq();
+
+        again = stepAgain;
+        stepAgain = false;
+        if ( again == false )
+            inStep = false;
+
+        __set_PRIMASK(primask);
+    } while ( again );
+}
+
+/**
+  * @name   engineStep
+  * @brief  advance the current transaction, start the next when done
+  * @param  None
+  * @retval None
+  * @note   runs from thread, SysTick and DMAC ISR context; a callback
+  *         that submits from inside a step is picked up by that step
+  */
+static void engineStep(void)
+{
+    if ( stepClaim() )
+        stepRun();
+}
+
+/**
+  * @name   i2cqDmaDone
+  * @brief  DMA callback for DMA_CH_I2C
+  * @param  ch  channel
+  * @param  flags  CHINTFLAG bits
+  * @retval None
+  * @note   DMAC ISR context
+  */
+static void i2cqDmaDone(uint8_t ch, uint8_t flags)
+{
+    (void) ch;
+
+    if ( flags & DMAC_CHINTFLAG_TERR )
+        dmaError = true;
+
+    dmaDone = true;
+    engineStep();
+}
+
+/**
+  * @name   sysTickHook
+  * @brief  Arduino core hook called from SysTick_Handler every msec
+  * @param  None
+  * @retval int  0 = let the core count the tick
+  */
+extern "C" int sysTickHook(void)
+{
+    // queues the over-current reads, so ahead of the step below
+    protect_Tick();
+
+    if ( i2cq_Busy() )
+        engineStep();
+
+    return(0);
+}
+
+/**
+  * @name   i2cq_Init
+  * @brief  configure SERCOM1 as I2C master at I2CQ_STD_HZ
+  * @param  None
+  * @retval None
+  * @note   call after dma_Init(); replaces Wire.begin()
+  */
+void i2cq_Init(void)
+{
+    PM->APBCMASK.reg |= PM_APBCMASK_SERCOM1;
+    GCLK->CLKCTRL.reg = (uint16_t) (GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID(GCM_SERCOM1_CORE));
+    while (GCLK->STATUS.bit.SYNCBUSY);
+
+    // the SCL low timeout counts 25-35 msec on the shared SERCOM slow
+    // clock, which the core leaves off; GCLK1 is the 32 kHz generator
+    GCLK->CLKCTRL.reg = (uint16_t) (GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK1 | GCLK_CLKCTRL_ID(GCM_SERCOMx_SLOW));
+    while (GCLK->STATUS.bit.SYNCBUSY);
+
+    I2CQ_SERCOM->I2CM.CTRLA.reg = SERCOM_I2CM_CTRLA_SWRST;
+    while (I2CQ_SERCOM->I2CM.CTRLA.bit.SWRST || I2CQ_SERCOM->I2CM.SYNCBUSY.bit.SWRST);
+
+    // SCL low timeout catches a slave holding the clock
+    I2CQ_SERCOM->I2CM.CTRLA.reg = SERCOM_I2CM_CTRLA_MODE_I2C_MASTER | SERCOM_I2CM_CTRLA_LOWTOUTEN;
+    I2CQ_SERCOM->I2CM.CTRLB.reg = SERCOM_I2CM_CTRLB_SMEN;
+    i2cqSync();
+
+    memset(queueHead, 0, sizeof(queueHead));
+    memset(queueCount, 0, sizeof(queueCount));
+    i2cq_resetStats();
+
+    dma_setCallback(DMA_CH_I2C, i2cqDmaDone);
+    busSetClock(I2CQ_STD_HZ);
+    pinMux(true);
+}
+
+/**
+  * @name   i2cq_Submit
+  * @brief  queue a transaction
+  * @param  x  transaction, status is set to I2CQ_PENDING
+  * @retval bool  false if that priority's queue is full
+  * @note   may be called from a transaction callback
+  */
+bool i2cq_Submit(i2cq_xfer_t *x)
+{
+    uint32_t        primask;
+    uint8_t         prio = (x->priority < I2CQ_PRIO_CNT) ? x->priority : I2CQ_PRIO_NORMAL;
+
+    if ( (x->txLen && x->tx == NULL) || (x->rxLen && x->rx == NULL) )
+        return(false);
+
+    if ( x->hz == 0 )
+        x->hz = I2CQ_STD_HZ;
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    if ( queueCount[prio] == I2CQ_DEPTH )
+    {
+        __set_PRIMASK(primask);
+        return(false);
+    }
+
+    x->status = I2CQ_PENDING;
+    x->usec = micros();
+    queue[prio][(queueHead[prio] + queueCount[prio]) % I2CQ_DEPTH] = x;
+    queueCount[prio]++;
+
+    __set_PRIMASK(primask);
+
+    engineStep();
+    return(true);
+}
+
+/**
+  * @name   i2cq_Service
+  * @brief  advance the queue without waiting for the next SysTick
+  * @param  None
+  * @retval None
+  * @note   called from loop() and while waiting on a transaction
+  */
+void i2cq_Service(void)
+{
+    engineStep();
+}
+
+/**
+  * @name   i2cq_Busy
+  * @brief  check for a transaction on the bus or queued
+  * @param  None
+  * @retval bool
+  */
+bool i2cq_Busy(void)
+{
+    return(cur != NULL || queueCount[0] || queueCount[1]);
+}
+
+/**
+  * @name   i2cq_Transfer
+  * @brief  queue a transaction at normal priority and wait for it
+  * @param  addr  7 bit address
+  * @param  tx  bytes to write
+  * @param  txLen  0..I2CQ_MAX_LEN
+  * @param  rx  buffer for bytes read
+  * @param  rxLen  0..I2CQ_MAX_LEN
+  * @param  hz  bus speed, 0 = I2CQ_STD_HZ
+  * @retval I2CQ_STATUS  I2CQ_OK or error
+  * @note   txLen = rxLen = 0 is an address-only probe
+  */
+I2CQ_STATUS i2cq_Transfer(uint8_t addr, const uint8_t *tx, uint8_t txLen, uint8_t *rx, uint8_t rxLen, uint32_t hz)
+{
+    i2cq_xfer_t     x;
+
+    memset(&x, 0, sizeof(x));
+    x.addr = addr;
+    x.tx = tx;
+    x.txLen = txLen;
+    x.rx = rx;
+    x.rxLen = rxLen;
+    x.hz = hz;
+    x.priority = I2CQ_PRIO_NORMAL;
+
+    if ( (txLen && tx == NULL) || (rxLen && rx == NULL) )
+        return(I2CQ_BUSERR);
+
+    while ( i2cq_Submit(&x) == false )
+        i2cq_Service();
+
+    while ( x.status == I2CQ_PENDING || x.status == I2CQ_BUSY )
+        i2cq_Service();
+
+    return(x.status);
+}
+
+/**
+  * @name   i2cq_BusLines
+  * @brief  read SDA/SCL levels
+  * @param  None
+  * @retval uint8_t  I2CQ_LINE_xxx bits of the lines that are high
+  */
+uint8_t i2cq_BusLines(void)
+{
+    return(busLines());
+}
+
+/**
+  * @name   i2cq_Recover
+  * @brief  clock a stuck bus free
+  * @param  None
+  * @retval bool  true if both lines are high afterwards
+  * @note   does nothing and returns false while a transaction is
+  *         queued, on the bus or being stepped
+  */
+bool i2cq_Recover(void)
+{
+    bool            ok = false;
+
+    if ( stepClaim() == false )
+        return(false);
+
+    if ( i2cq_Busy() == false )
+        ok = busRecover();
+
+    // anything submitted meanwhile starts here
+    stepRun();
+    return(ok);
+}
+
+/**
+  * @name   i2cq_getStats
+  * @brief  get transaction counters
+  * @param  s  filled with counters
+  * @retval None
+  */
+void i2cq_getStats(i2cq_stats_t *s)
+{
+    uint32_t        primask = __get_PRIMASK();
+
+    __disable_irq();
+    *s = stats;
+    __set_PRIMASK(primask);
+}
+
+/**
+  * @name   i2cq_resetStats
+  * @brief  clear transaction counters
+  * @param  None
+  * @retval None
+  */
+void i2cq_resetStats(void)
+{
+    uint32_t        primask = __get_PRIMASK();
+
+    __disable_irq();
+    memset(&stats, 0, sizeof(stats));
+    stats.startTime = millis();
+    __set_PRIMASK(primask);
+}
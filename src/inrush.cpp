@@ -0,0 +1,417 @@
+//===================================================================
+// inrush.cpp
+// Rail current capture across the NIC power-up sequence.  inrush_
+// PowerUp() takes the INA219s from power.cpp, switches them to single
+// 9 bit shunt conversions (84 usec) and points them at the shunt
+// register, so each reading is a 2 byte read with no register write
+// in front of it.  Both rails are then read back to back at
+// I2CQ_FAST_HZ while the sequence runs from the same loop:
+// INRUSH_PRE_MS of baseline, MAIN_EN, pdelay, AUX_EN, then NIC_PWR_GOOD
+// or a timeout.  The enables are driven between reads, so the edge
+// times are known to within one read.
+//
+// Every read is stored for INRUSH_BURST_MS after each enable, up to
+// INRUSH_BURST_SAMPLES each.  The rest of samples[] is spread over the
+// longest the sequence can take (baseline, pdelay, the PWR_GOOD wait
+// and the time after it), so the AUX_EN burst and the end of a PWR_GOOD
+// timeout are stored for any pdelay that fits the 16 bit tick.  Peaks
+// are taken from every read whether it was stored or not.
+// NIC_PWR_GOOD is timed from the EIC edge timestamp in events.cpp when
+// there is one, else from the poll.
+//
+// A power protection trip ends the capture where it happened and
+// keeps AUX_EN from being driven after it.
+//
+// Energy integration sees the capture as one long gap, since sampling
+// in power.cpp is suspended for its duration.
+//===================================================================
+#include <Arduino.h>
+#include "main.hpp"
+#include "commands.hpp"
+#include "cli.hpp"
+#include "eeprom.hpp"
+#include "events.hpp"
+#include "i2cq.hpp"
+#include "power.hpp"
+#include "protect.hpp"
+#include "inrush.hpp"
+
+extern char                 *tokens[];
+extern EEPROM_data_t        EEPROMData;
+static char                 outBfr[OUTBFR_SIZE];
+
+static inrush_sample_t      samples[INRUSH_SAMPLES];
+static uint16_t             sampleCnt;
+static bool                 captured = false;
+static bool                 truncated;
+static uint8_t              railMask;                   // rails read during the capture
+static uint32_t             reads;                      // read pairs, stored or not
+static uint32_t             readErrors;
+static uint32_t             slowUs;                     // store interval outside the bursts
+
+// usec from the start of the capture
+static uint32_t             mainUs;
+static uint32_t             auxUs;
+static uint32_t             pgUs;
+static uint32_t             endUs;
+static bool                 pgSeen;
+static bool                 pgFromEdge;                 // pgUs is an EIC timestamp
+
+static int16_t              peakMa[POWER_RAIL_CNT];
+static uint32_t             peakUs[POWER_RAIL_CNT];
+
+/**
+  * @name   captureSetup
+  * @brief  put the present monitors in fast shunt-only mode
+  * @param  None
+  * @retval uint8_t  bit per rail set up
+  * @note   leaves the register pointer on the shunt register
+  */
+static uint8_t captureSetup(void)
+{
+    uint8_t         cfg[3] = {INA219_REG_CONFIG, (uint8_t) (INRUSH_INA219_CONFIG >> 8), (uint8_t) INRUSH_INA219_CONFIG};
+    uint8_t         ptr = INA219_REG_SHUNT;
+    uint8_t         mask = 0;
+
+    for ( uint8_t rail = 0; rail < POWER_RAIL_CNT; rail++ )
+    {
+        if ( power_Present(rail) == false )
+            continue;
+
+        if ( i2cq_Transfer(power_RailAddr(rail), cfg, 3, NULL, 0, I2CQ_FAST_HZ) == I2CQ_OK &&
+             i2cq_Transfer(power_RailAddr(rail), &ptr, 1, NULL, 0, I2CQ_FAST_HZ) == I2CQ_OK )
+            mask |= (1 << rail);
+    }
+
+    return(mask);
+}
+
+/**
+  * @name   readRails
+  * @brief  read the shunt register of each rail being captured
+  * @param  t  usec from the start of the capture
+  * @param  ma  in: previous reading, out: this reading
+  * @retval None
+  * @note   a failed read repeats the previous value
+  */
+static void readRails(uint32_t t, int16_t *ma)
+{
+    uint8_t         rx[2];
+
+    for ( uint8_t rail = 0; rail < POWER_RAIL_CNT; rail++ )
+    {
+        if ( (railMask & (1 << rail)) == 0 )
+            continue;
+
+        if ( i2cq_Transfer(power_RailAddr(rail), NULL, 0, rx, 2, I2CQ_FAST_HZ) != I2CQ_OK )
+        {
+            readErrors++;
+            continue;
+        }
+
+        ma[rail] = power_ShuntToMa(rail, (int16_t) ((rx[0] << 8) | rx[1]));
+
+        if ( reads == 0 || ma[rail] > peakMa[rail] )
+        {
+            peakMa[rail] = ma[rail];
+            peakUs[rail] = t;
+        }
+    }
+
+    reads++;
+}
+
+/**
+  * @name   railSettle
+  * @brief  final value and settling time of a rail
+  * @param  rail  POWER_RAIL_xxx
+  * @param  enUs  when the rail was enabled, usec from capture start
+  * @param  finalMa  out: mean over the last INRUSH_FINAL_MS
+  * @retval int32_t  usec from enUs until the rail stayed within the
+  *         settling band, -1 if it never did
+  */
+static int32_t railSettle(uint8_t rail, uint32_t enUs, int16_t *finalMa)
+{
+    uint32_t        lastTick = samples[sampleCnt - 1].tick;
+    int32_t         sum = 0;
+    int32_t         n = 0;
+    int32_t         band;
+    int32_t         lastOut = -1;
+
+    for ( int32_t i = sampleCnt - 1; i >= 0; i-- )
+    {
+        if ( (lastTick - samples[i].tick) * INRUSH_TICK_US > INRUSH_FINAL_MS * 1000ul )
+            break;
+
+        sum += samples[i].currentMa[rail];
+        n++;
+    }
+
+    *finalMa = sum / n;
+    band = abs(*finalMa) * INRUSH_SETTLE_PCT / 100;
+    if ( band < INRUSH_SETTLE_MIN_MA )
+        band = INRUSH_SETTLE_MIN_MA;
+
+    for ( int32_t i = 0; i < sampleCnt; i++ )
+    {
+        if ( (uint32_t) samples[i].tick * INRUSH_TICK_US >= enUs &&
+             abs(samples[i].currentMa[rail] - *finalMa) > band )
+            lastOut = i;
+    }
+
+    if ( lastOut < 0 )
+        return(0);
+    if ( lastOut == sampleCnt - 1 )
+        return(-1);
+
+    return((uint32_t) samples[lastOut + 1].tick * INRUSH_TICK_US - enUs);
+}
+
+/**
+  * @name   slowInterval
+  * @brief  store interval outside the bursts for the current pdelay
+  * @param  None
+  * @retval uint32_t  usec
+  */
+static uint32_t slowInterval(void)
+{
+    uint32_t        spanUs = (INRUSH_PRE_MS + EEPROMData.pwr_seq_delay_msec + INRUSH_PWRGOOD_MS + INRUSH_POST_MS) * 1000ul;
+    uint32_t        budget = INRUSH_SAMPLES - 2 * INRUSH_BURST_SAMPLES - 2;   // 2 for rounding at each end
+    uint32_t        us = (spanUs + budget - 1) / budget;
+
+    static_assert(INRUSH_SAMPLES > 2 * INRUSH_BURST_SAMPLES + 2, "INRUSH_SAMPLES too small for the bursts");
+
+    return((us < INRUSH_SLOW_US) ? INRUSH_SLOW_US : us);
+}
+
+/**
+  * @name   inrushShow
+  * @brief  display peak, PWR_GOOD and settling of the last capture
+  * @param  None
+  * @retval None
+  * @note   times are usec after MAIN_EN unless noted
+  */
+static void inrushShow(void)
+{
+    int16_t         finalMa;
+    int32_t         settle;
+    int             len;
+
+    sprintf(outBfr, "Inrush capture: %lu reads, %u stored%s, %lu read errors, %lu ms",
+            reads, sampleCnt, truncated ? " (buffer full, end not stored)" : "", readErrors, endUs / 1000);
+    SHOW();
+    sprintf(outBfr, "  every read stored for %d ms after each enable, else 1 per %lu us", INRUSH_BURST_MS, slowUs);
+    SHOW();
+    sprintf(outBfr, "  AUX_EN at %lu us after MAIN_EN", auxUs - mainUs);
+    SHOW();
+
+    if ( pgSeen )
+        sprintf(outBfr, "  NIC_PWR_GOOD at %lu us, %lu us after AUX_EN (%s)", pgUs - mainUs, pgUs - auxUs,
+                pgFromEdge ? "edge" : "polled");
+    else
+        sprintf(outBfr, "  NIC_PWR_GOOD not seen within %d ms of AUX_EN", INRUSH_PWRGOOD_MS);
+    SHOW();
+
+    for ( uint8_t rail = 0; rail < POWER_RAIL_CNT; rail++ )
+    {
+        if ( (railMask & (1 << rail)) == 0 )
+        {
+            sprintf(outBfr, "  %-10s no monitor", power_RailName(rail));
+            SHOW();
+            continue;
+        }
+
+        len = sprintf(outBfr, "  %-10s peak %d mA at %ld us, ", power_RailName(rail), peakMa[rail],
+                      (int32_t) (peakUs[rail] - mainUs));
+
+        // the end of the sequence wasn't stored, so there is no final value
+        if ( truncated )
+        {
+            strcpy(&outBfr[len], "final n/a, settling n/a");
+            SHOW();
+            continue;
+        }
+
+        settle = railSettle(rail, (rail == POWER_RAIL_MAIN) ? mainUs : auxUs, &finalMa);
+
+        sprintf(&outBfr[len], "final %d mA, ", finalMa);
+        if ( settle < 0 )
+            strcat(outBfr, "not settled");
+        else
+            sprintf(&outBfr[strlen(outBfr)], "settled %ld us after %s_EN", settle,
+                    (rail == POWER_RAIL_MAIN) ? "MAIN" : "AUX");
+        SHOW();
+    }
+}
+
+/**
+  * @name   inrushStream
+  * @brief  dump stored samples as CSV
+  * @param  None
+  * @retval None
+  */
+static void inrushStream(void)
+{
+    terminalOut((char *) "usec,main_ma,aux_ma");
+
+    for ( uint16_t i = 0; i < sampleCnt; i++ )
+    {
+        sprintf(outBfr, "%ld,%d,%d", (int32_t) ((uint32_t) samples[i].tick * INRUSH_TICK_US - mainUs),
+                samples[i].currentMa[POWER_RAIL_MAIN], samples[i].currentMa[POWER_RAIL_AUX]);
+        SHOW();
+    }
+}
+
+/**
+  * @name   inrush_PowerUp
+  * @brief  run the card power up sequence while capturing rail current
+  * @param  stream  true = also dump the samples as CSV
+  * @retval bool  true if NIC_PWR_GOOD came up
+  * @note   blocks for pdelay plus up to INRUSH_PWRGOOD_MS, same as the
+  *         delay() based sequence it replaces
+  */
+bool inrush_PowerUp(bool stream)
+{
+    uint32_t        start;
+    uint32_t        t;
+    uint32_t        burstEnd = 0;
+    uint32_t        lastStore = 0;
+    uint32_t        burstCnt = 0;
+    uint32_t        pgEdges;
+    uint32_t        edgeUsec;
+    bool            mainOn = false;
+    bool            auxOn = false;
+    bool            ending = false;
+    int16_t         ma[POWER_RAIL_CNT] = {0};
+
+    power_Suspend();
+    railMask = captureSetup();
+
+    sampleCnt = 0;
+    reads = readErrors = 0;
+    truncated = pgSeen = pgFromEdge = false;
+    slowUs = slowInterval();
+    mainUs = auxUs = pgUs = 0;
+    memset(peakMa, 0, sizeof(peakMa));
+    memset(peakUs, 0, sizeof(peakUs));
+
+    pgEdges = events_PinEdges(NIC_PWR_GOOD_JMP, NULL);
+    start = micros();
+
+    while ( true )
+    {
+        t = micros() - start;
+
+        if ( protect_Tripped() )
+        {
+            endUs = t;
+            break;
+        }
+
+        if ( mainOn == false && t >= INRUSH_PRE_MS * 1000ul )
+        {
+            writePin(OCP_MAIN_PWR_EN, 1);
+            mainUs = micros() - start;
+            burstEnd = mainUs + INRUSH_BURST_MS * 1000ul;
+            burstCnt = 0;
+            mainOn = true;
+        }
+        else if ( mainOn && auxOn == false && t - mainUs >= EEPROMData.pwr_seq_delay_msec * 1000ul )
+        {
+            writePin(OCP_AUX_PWR_EN, 1);
+            auxUs = micros() - start;
+            burstEnd = auxUs + INRUSH_BURST_MS * 1000ul;
+            burstCnt = 0;
+            auxOn = true;
+        }
+        else if ( auxOn && ending == false )
+        {
+            if ( readPin(NIC_PWR_GOOD_JMP) )
+            {
+                pgSeen = true;
+                pgUs = t;
+                if ( events_PinEdges(NIC_PWR_GOOD_JMP, &edgeUsec) != pgEdges )
+                {
+                    pgUs = edgeUsec - start;
+                    pgFromEdge = true;
+                }
+                endUs = t + INRUSH_POST_MS * 1000ul;
+                ending = true;
+            }
+            else if ( t - auxUs >= INRUSH_PWRGOOD_MS * 1000ul )
+            {
+                endUs = t;
+                ending = true;
+            }
+        }
+
+        if ( ending && t >= endUs )
+            break;
+
+        if ( railMask == 0 )
+            continue;
+
+        readRails(t, ma);
+
+        if ( (t < burstEnd && burstCnt < INRUSH_BURST_SAMPLES) || t - lastStore >= slowUs || sampleCnt == 0 )
+        {
+            if ( t < burstEnd )
+                burstCnt++;
+
+            if ( sampleCnt < INRUSH_SAMPLES && t / INRUSH_TICK_US <= 0xFFFF )
+            {
+                samples[sampleCnt].tick = t / INRUSH_TICK_US;
+                memcpy(samples[sampleCnt].currentMa, ma, sizeof(ma));
+                sampleCnt++;
+            }
+            else
+                truncated = true;
+
+            lastStore = t;
+        }
+    }
+
+    power_Resume();
+    captured = true;
+    protect_Service();
+
+    if ( railMask == 0 )
+        terminalOut((char *) "No rail monitors responding; inrush not captured");
+
+    if ( sampleCnt )
+    {
+        inrushShow();
+        if ( stream )
+            inrushStream();
+    }
+
+    return(pgSeen);
+}
+
+/**
+  * @name   powerInrushCmd
+  * @brief  'power inrush' subcommand, shows the last capture
+  * @param  arg  number of arguments to 'power'
+  * @param  tokens[2]  optional 'stream'
+  * @retval 0=OK 1=error
+  */
+int powerInrushCmd(int arg)
+{
+    if ( arg >= 2 && strcmp(tokens[2], "stream") != 0 )
+    {
+        terminalOut((char *) "Usage: power inrush [stream]");
+        return(1);
+    }
+
+    if ( captured == false || sampleCnt == 0 )
+    {
+        terminalOut((char *) "No inrush capture; run 'power up card'");
+        return(1);
+    }
+
+    inrushShow();
+    if ( arg >= 2 )
+        inrushStream();
+
+    return(0);
+}
@@ -13,11 +13,21 @@
 #include "commands.hpp"
 #include "eeprom.hpp"
 #include "cli.hpp"
-#include <Wire.h>
+#include "console.hpp"
+#include "pins.hpp"
+#include "events.hpp"
+#include "dma.hpp"
+#include "capture.hpp"
+#include "activity.hpp"
+#include "scan.hpp"
+#include "scanmon.hpp"
+#include "timers.hpp"
+#include "i2cq.hpp"
+#include "power.hpp"
+#include "protect.hpp"
 #include "main.hpp"
 
-// timers
-void timers_Init(void);
+extern EEPROM_data_t    EEPROMData;
 
 // heartbeat LED blink delays in ms (approx)
 #define FAST_BLINK_DELAY            200
@@ -42,6 +52,16 @@ void setup()
   digitalWrite(OCP_HEARTBEAT_LED, LOW);
   readAllPins();
 
+  // timestamp alarm/presence pin edges
+  events_Init();
+
+  // DMA logic capture of all pins, armed by 'capture' command
+  dma_Init();
+  capture_Init();
+
+  // link ACT LED counters, needs EIC enabled by events_Init()
+  activity_Init();
+
   // disable main & aux power to NIC 3.0 card
   writePin(OCP_MAIN_PWR_EN, 0);
   writePin(OCP_AUX_PWR_EN, 0);
@@ -56,13 +76,22 @@ void setup()
   // initialize timer used for scan chain clock
   timers_Init();
 
+  // SERCOM SPI scan chain engine, clock rate set from FLASH once it's read
+  scan_Init();
+
   // Start serial interface
   // NOTE: Baud rate isn't applicable to USB...
   // NOTE: No wait here, loop() does that
   SerialUSB.begin(115200);
 
-  // start I2C interface
-  Wire.begin();
+  // start I2C interface, queued transactions moved by DMA
+  i2cq_Init();
+
+  // INA219 rail monitors, sampled from loop()
+  monitorsInit();
+
+  // over-current / TEMP_CRIT trip, limits applied once FLASH is read
+  protect_Init();
 
 } // setup()
 
@@ -90,6 +119,11 @@ void loop()
     {
         doHello();
         EEPROM_InitLocal();
+        scan_SetClock(EEPROMData.scan_clk_hz);
+        scan_SetSampleEdge(EEPROMData.scan_sample_edge);
+        protect_Configure();
+        if ( pinMapVerify() == false )
+            terminalOut((char *) "WARNING: pin map in pins.hpp does not match variant.cpp");
         terminalOut((char *) "Press ENTER if prompt is not shown");
         doPrompt();
         isFirstTime = false;
@@ -111,6 +145,14 @@ void loop()
         }
   }
 
+  // drain pin edge events captured by EIC ISR
+  events_Service();
+  activity_Service();
+  scanmon_Service();
+  i2cq_Service();
+  power_Service();
+  protect_Service();
+
   // process incoming serial over USB characters
   if ( SerialUSB.available() )
   {
@@ -118,8 +160,8 @@ void loop()
       if ( byteIn == 0x0a )
       {
           // line feed - echo it
-          SerialUSB.write(0x0a);
-          SerialUSB.flush();
+          console_putc(0x0a);
+          console_endResponse();
       }
       else if ( byteIn == 0x0d )
       {
@@ -131,7 +173,6 @@ void loop()
           inCharCount = 0;
           strcpy(lastCmd, inBfr);
           cli(inBfr);
-          SerialUSB.flush();
       }
       else if ( byteIn == 0x1b )
       {
@@ -148,9 +189,7 @@ void loop()
                     {
                         // up arrow: echo last command entered then execute in CLI
                         terminalOut(lastCmd);
-                        SerialUSB.flush();
                         cli(lastCmd);
-                        SerialUSB.flush();
                     }
                 }
             }
@@ -163,17 +202,17 @@ void loop()
         if ( inCharCount )
         {
             inBfr[inCharCount--] = 0;
-            SerialUSB.write(bs, 4);
-            SerialUSB.write(' ');
-            SerialUSB.write(bs, 4);
-            SerialUSB.flush();
+            console_write(bs, 4);
+            console_putc(' ');
+            console_write(bs, 4);
+            console_endResponse();
         }
     }
     else
     {
         // all other keys get echoed & stored in buffer
-        SerialUSB.write((char) byteIn);
-        SerialUSB.flush();
+        console_putc((char) byteIn);
+        console_endResponse();
         inBfr[inCharCount] = byteIn;
         if ( inCharCount < (MAX_LINE_SZ-1) )
         {
@@ -0,0 +1,521 @@
+//===================================================================
+// power.cpp
+// Rail power telemetry from the INA219 current monitors, U2 on the
+// 12V MAIN rail and U3 on 3.3V AUX.  Both run continuous shunt and
+// bus conversions averaged over POWER_ADC_AVG; power_Service() queues
+// a read of each register every POWER_SAMPLE_MS as telemetry
+// transactions on the I2C queue, and files the sample once the last
+// one completes, so sampling never blocks loop() or a command.
+//
+// Current is computed from the shunt voltage and railInfo[] shunt
+// values rather than the INA219 calibration/current registers, which
+// keeps everything in integer mV/mA/mW.  Samples go into a ring for
+// window min/mean/max, plus totals since the last 'power stats reset',
+// and on to energy.cpp.
+//===================================================================
+#include <Arduino.h>
+#include "main.hpp"
+#include "commands.hpp"
+#include "cli.hpp"
+#include "i2cq.hpp"
+#include "power.hpp"
+#include "energy.hpp"
+#include "protect.hpp"
+
+extern char                 *tokens[];
+static char                 outBfr[OUTBFR_SIZE];
+
+static_assert((POWER_RING_SIZE & (POWER_RING_SIZE - 1)) == 0, "POWER_RING_SIZE must be a power of 2");
+
+typedef struct {
+    uint8_t         i2cAddr;
+    const char      *name;
+    uint16_t        shuntMohm;              // NOTE: per schematic
+    uint16_t        config;
+} power_rail_t;
+
+static const power_rail_t   railInfo[POWER_RAIL_CNT] = {
+    {0x40, "MAIN (U2)", 10, INA219_CFG_BRNG_32V | INA219_CFG_PGA_160MV | INA219_CFG_BADC(POWER_ADC_AVG) |
+                            INA219_CFG_SADC(POWER_ADC_AVG) | INA219_CFG_MODE_CONT},
+    {0x41, "AUX (U3)",  10, INA219_CFG_PGA_160MV | INA219_CFG_BADC(POWER_ADC_AVG) |
+                            INA219_CFG_SADC(POWER_ADC_AVG) | INA219_CFG_MODE_CONT},
+};
+
+static const uint8_t        regShunt = INA219_REG_SHUNT;
+static const uint8_t        regBus = INA219_REG_BUS;
+
+static uint8_t              railPresent = 0;            // bit per rail that answered monitorsInit()
+static i2cq_xfer_t          xfers[POWER_RAIL_CNT][2];   // shunt, bus
+static uint8_t              rxData[POWER_RAIL_CNT][2][2];
+static volatile uint8_t     xfersPending = 0;
+static bool                 sampleBusy = false;
+static bool                 suspended = false;          // monitors lent out by power_Suspend()
+static uint32_t             sampleTime;
+static uint32_t             sampleUsec;                 // same instant, for energy intervals
+static uint32_t             lastSample;
+
+static power_sample_t       ring[POWER_RING_SIZE];
+static uint32_t             ringCount = 0;
+static power_rail_stats_t   railStats[POWER_RAIL_CNT];
+static uint32_t             statsStart;
+
+/**
+  * @name   writeReg
+  * @brief  write an INA219 register
+  * @param  i2cAddr  device address
+  * @param  reg  register #
+  * @param  value  16 bit value, sent MSB first
+  * @retval bool  true if ACKed
+  */
+static bool writeReg(uint8_t i2cAddr, uint8_t reg, uint16_t value)
+{
+    uint8_t         tx[3] = {reg, (uint8_t) (value >> 8), (uint8_t) value};
+
+    return(i2cq_Transfer(i2cAddr, tx, 3, NULL, 0, 0) == I2CQ_OK);
+}
+
+/**
+  * @name   statAdd
+  * @brief  add a value to min/max/sum
+  * @param  st  stat
+  * @param  v  value
+  * @param  first  true = first value since reset
+  * @retval None
+  */
+static void statAdd(power_stat_t *st, int32_t v, bool first)
+{
+    if ( first || v < st->min )
+        st->min = v;
+    if ( first || v > st->max )
+        st->max = v;
+    st->sum += v;
+}
+
+/**
+  * @name   resetStats
+  * @brief  clear totals since reset
+  * @param  None
+  * @retval None
+  */
+static void resetStats(void)
+{
+    memset(railStats, 0, sizeof(railStats));
+    statsStart = millis();
+}
+
+/**
+  * @name   xferDone
+  * @brief  I2C queue callback for the sample reads
+  * @param  x  transaction
+  * @retval None
+  * @note   ISR context
+  */
+static void xferDone(i2cq_xfer_t *x)
+{
+    (void) x;
+    xfersPending--;
+}
+
+/**
+  * @name   sampleStart
+  * @brief  queue the shunt and bus reads of every present rail
+  * @param  None
+  * @retval None
+  */
+static void sampleStart(void)
+{
+    uint8_t         count = 0;
+
+    for ( uint8_t rail = 0; rail < POWER_RAIL_CNT; rail++ )
+    {
+        if ( railPresent & (1 << rail) )
+            count += 2;
+    }
+
+    // set before submitting, a callback can run inside i2cq_Submit()
+    xfersPending = count;
+    sampleTime = millis();
+    sampleUsec = micros();
+    sampleBusy = true;
+
+    for ( uint8_t rail = 0; rail < POWER_RAIL_CNT; rail++ )
+    {
+        if ( (railPresent & (1 << rail)) == 0 )
+            continue;
+
+        for ( uint8_t reg = 0; reg < 2; reg++ )
+        {
+            i2cq_xfer_t     *x = &xfers[rail][reg];
+
+            memset(x, 0, sizeof(i2cq_xfer_t));
+            x->addr = railInfo[rail].i2cAddr;
+            x->tx = (reg == 0) ? &regShunt : &regBus;
+            x->txLen = 1;
+            x->rx = rxData[rail][reg];
+            x->rxLen = 2;
+            x->priority = I2CQ_PRIO_TELEMETRY;
+            x->callback = xferDone;
+
+            if ( i2cq_Submit(x) == false )
+            {
+                x->status = I2CQ_BUSERR;
+                __disable_irq();
+                xfersPending--;
+                __enable_irq();
+            }
+        }
+    }
+}
+
+/**
+  * @name   sampleFinish
+  * @brief  convert completed reads, add to the ring and totals
+  * @param  None
+  * @retval None
+  */
+static void sampleFinish(void)
+{
+    power_sample_t  s;
+    bool            ok = true;
+
+    memset(&s, 0, sizeof(s));
+    s.msec = sampleTime;
+
+    for ( uint8_t rail = 0; rail < POWER_RAIL_CNT; rail++ )
+    {
+        power_rail_stats_t  *rs = &railStats[rail];
+        int16_t             shunt;
+        uint16_t            bus;
+        int32_t             mw;
+
+        if ( (railPresent & (1 << rail)) == 0 )
+            continue;
+
+        if ( xfers[rail][0].status != I2CQ_OK || xfers[rail][1].status != I2CQ_OK )
+        {
+            rs->errors++;
+            ok = false;
+            continue;
+        }
+
+        shunt = (int16_t) ((rxData[rail][0][0] << 8) | rxData[rail][0][1]);
+        bus = (uint16_t) ((rxData[rail][1][0] << 8) | rxData[rail][1][1]);
+
+        if ( bus & INA219_BUS_OVF )
+            rs->overflows++;
+
+        s.busMv[rail] = (bus >> INA219_BUS_SHIFT) * INA219_BUS_MV_LSB;
+        s.currentMa[rail] = power_ShuntToMa(rail, shunt);
+        mw = ((int32_t) s.busMv[rail] * s.currentMa[rail]) / 1000;
+
+        statAdd(&rs->busMv, s.busMv[rail], rs->samples == 0);
+        statAdd(&rs->currentMa, s.currentMa[rail], rs->samples == 0);
+        statAdd(&rs->powerMw, mw, rs->samples == 0);
+        rs->samples++;
+    }
+
+    // a sample with a missing rail would pull the window stats to 0
+    if ( ok )
+    {
+        ring[ringCount++ & (POWER_RING_SIZE - 1)] = s;
+        energy_Sample(&s, sampleUsec);
+    }
+}
+
+/**
+  * @name   monitorsInit
+  * @brief  configure the INA219s and start sampling
+  * @param  None
+  * @retval None
+  * @note   call after i2cq_Init(); a device that doesn't ACK is skipped
+  */
+void monitorsInit(void)
+{
+    // let a sample in flight finish before its transactions are reused
+    while ( sampleBusy && xfersPending )
+        i2cq_Service();
+
+    sampleBusy = false;
+    railPresent = 0;
+
+    for ( uint8_t rail = 0; rail < POWER_RAIL_CNT; rail++ )
+    {
+        if ( writeReg(railInfo[rail].i2cAddr, INA219_REG_CONFIG, INA219_CFG_RESET) &&
+             writeReg(railInfo[rail].i2cAddr, INA219_REG_CONFIG, railInfo[rail].config) )
+            railPresent |= (1 << rail);
+    }
+
+    ringCount = 0;
+    resetStats();
+    lastSample = millis() - POWER_SAMPLE_MS;
+}
+
+/**
+  * @name   power_Present
+  * @brief  check if a rail's monitor answered monitorsInit()
+  * @param  rail  POWER_RAIL_xxx
+  * @retval bool
+  */
+bool power_Present(uint8_t rail)
+{
+    return(rail < POWER_RAIL_CNT && (railPresent & (1 << rail)));
+}
+
+/**
+  * @name   power_RailAddr
+  * @brief  I2C address of a rail's monitor
+  * @param  rail  POWER_RAIL_xxx
+  * @retval uint8_t
+  */
+uint8_t power_RailAddr(uint8_t rail)
+{
+    return(railInfo[rail].i2cAddr);
+}
+
+/**
+  * @name   power_RailName
+  * @brief  display name of a rail
+  * @param  rail  POWER_RAIL_xxx
+  * @retval const char *
+  */
+const char *power_RailName(uint8_t rail)
+{
+    return(railInfo[rail].name);
+}
+
+/**
+  * @name   power_ShuntToMa
+  * @brief  convert a shunt voltage register value to current
+  * @param  rail  POWER_RAIL_xxx
+  * @param  raw  INA219_REG_SHUNT value
+  * @retval int16_t  mA
+  */
+int16_t power_ShuntToMa(uint8_t rail, int16_t raw)
+{
+    return(((int32_t) raw * INA219_SHUNT_UV_LSB) / (int32_t) railInfo[rail].shuntMohm);
+}
+
+/**
+  * @name   power_MaToShunt
+  * @brief  convert a current to the shunt voltage register value
+  * @param  rail  POWER_RAIL_xxx
+  * @param  ma  current
+  * @retval int16_t  INA219_REG_SHUNT value
+  */
+int16_t power_MaToShunt(uint8_t rail, int16_t ma)
+{
+    return(((int32_t) ma * railInfo[rail].shuntMohm) / INA219_SHUNT_UV_LSB);
+}
+
+/**
+  * @name   power_Suspend
+  * @brief  stop sampling so the monitors can be reconfigured
+  * @param  None
+  * @retval None
+  * @note   waits for a sample in flight; stats and energy see the
+  *         suspended time as one long interval
+  */
+void power_Suspend(void)
+{
+    while ( sampleBusy && xfersPending )
+        i2cq_Service();
+
+    if ( sampleBusy )
+    {
+        sampleFinish();
+        sampleBusy = false;
+    }
+
+    suspended = true;
+}
+
+/**
+  * @name   power_Resume
+  * @brief  restore the sampling configuration and restart sampling
+  * @param  None
+  * @retval None
+  */
+void power_Resume(void)
+{
+    for ( uint8_t rail = 0; rail < POWER_RAIL_CNT; rail++ )
+    {
+        if ( railPresent & (1 << rail) )
+            (void) writeReg(railInfo[rail].i2cAddr, INA219_REG_CONFIG, railInfo[rail].config);
+    }
+
+    suspended = false;
+    lastSample = millis() - POWER_SAMPLE_MS;
+}
+
+/**
+  * @name   power_Service
+  * @brief  file a completed sample, queue the next one when due
+  * @param  None
+  * @retval None
+  * @note   called from loop() and long-running commands
+  */
+void power_Service(void)
+{
+    if ( suspended )
+        return;
+
+    if ( sampleBusy )
+    {
+        if ( xfersPending )
+            return;
+
+        sampleFinish();
+        sampleBusy = false;
+    }
+
+    if ( railPresent == 0 || millis() - lastSample < POWER_SAMPLE_MS )
+        return;
+
+    lastSample += POWER_SAMPLE_MS;
+
+    // don't try to catch up after a long blocking command
+    if ( millis() - lastSample >= POWER_SAMPLE_MS )
+        lastSample = millis();
+
+    sampleStart();
+}
+
+/**
+  * @name   formatMilli
+  * @brief  format thousandths as a decimal with 3 places
+  * @param  p  output
+  * @param  v  value in thousandths
+  * @retval int  length
+  */
+static int formatMilli(char *p, int32_t v)
+{
+    uint32_t        mag = (v < 0) ? -v : v;
+
+    return(sprintf(p, "%s%lu.%03lu", (v < 0) ? "-" : "", mag / 1000, mag % 1000));
+}
+
+/**
+  * @name   showStat
+  * @brief  display one min/mean/max line
+  * @param  name  quantity label
+  * @param  min
+  * @param  mean
+  * @param  max
+  * @param  milli  true = values are thousandths of unit
+  * @param  unit  unit label
+  * @retval None
+  */
+static void showStat(const char *name, int32_t min, int32_t mean, int32_t max, bool milli, const char *unit)
+{
+    int             len = sprintf(outBfr, "    %-8s", name);
+    int32_t         v[3] = {min, mean, max};
+
+    for ( int i = 0; i < 3; i++ )
+    {
+        if ( milli )
+            len += formatMilli(&outBfr[len], v[i]);
+        else
+            len += sprintf(&outBfr[len], "%ld", v[i]);
+
+        len += sprintf(&outBfr[len], "%s", (i < 2) ? " / " : " ");
+    }
+
+    sprintf(&outBfr[len], "%s", unit);
+    SHOW();
+}
+
+/**
+  * @name   showWindow
+  * @brief  display min/mean/max of a rail over the samples in the ring
+  * @param  rail  POWER_RAIL_xxx
+  * @retval None
+  */
+static void showWindow(uint8_t rail)
+{
+    uint32_t        count = (ringCount < POWER_RING_SIZE) ? ringCount : POWER_RING_SIZE;
+    power_stat_t    mv;
+    power_stat_t    ma;
+    power_stat_t    mw;
+    power_sample_t  *s;
+
+    if ( count == 0 )
+        return;
+
+    memset(&mv, 0, sizeof(mv));
+    memset(&ma, 0, sizeof(ma));
+    memset(&mw, 0, sizeof(mw));
+
+    for ( uint32_t n = ringCount - count; n < ringCount; n++ )
+    {
+        s = &ring[n & (POWER_RING_SIZE - 1)];
+        statAdd(&mv, s->busMv[rail], n == ringCount - count);
+        statAdd(&ma, s->currentMa[rail], n == ringCount - count);
+        statAdd(&mw, ((int32_t) s->busMv[rail] * s->currentMa[rail]) / 1000, n == ringCount - count);
+    }
+
+    sprintf(outBfr, "  last %lu samples (%lu ms), min / mean / max:", count,
+            ring[(ringCount - 1) & (POWER_RING_SIZE - 1)].msec - ring[(ringCount - count) & (POWER_RING_SIZE - 1)].msec);
+    SHOW();
+    showStat("bus", mv.min, mv.sum / count, mv.max, true, "V");
+    showStat("current", ma.min, ma.sum / count, ma.max, false, "mA");
+    showStat("power", mw.min, mw.sum / count, mw.max, true, "W");
+}
+
+/**
+  * @name   powerStatsCmd
+  * @brief  'power stats' subcommand
+  * @param  arg  number of arguments to 'power'
+  * @param  tokens[2]  optional 'reset'
+  * @retval 0=OK 1=error
+  */
+int powerStatsCmd(int arg)
+{
+    power_rail_stats_t  *rs;
+
+    if ( arg >= 2 )
+    {
+        if ( strcmp(tokens[2], "reset") != 0 )
+        {
+            terminalOut((char *) "Usage: power stats [reset]");
+            return(1);
+        }
+
+        // also picks up a monitor that didn't answer at power up
+        monitorsInit();
+        protect_Configure();
+        terminalOut((char *) "Power stats reset");
+        return(0);
+    }
+
+    sprintf(outBfr, "Power monitors: sampled every %d ms, %lu secs since reset", POWER_SAMPLE_MS,
+            (millis() - statsStart) / 1000);
+    SHOW();
+
+    for ( uint8_t rail = 0; rail < POWER_RAIL_CNT; rail++ )
+    {
+        rs = &railStats[rail];
+
+        if ( power_Present(rail) == false )
+        {
+            sprintf(outBfr, "%s 0x%02X: not responding", railInfo[rail].name, railInfo[rail].i2cAddr);
+            SHOW();
+            continue;
+        }
+
+        sprintf(outBfr, "%s 0x%02X: %lu samples, %lu errors, %lu overflows", railInfo[rail].name,
+                railInfo[rail].i2cAddr, rs->samples, rs->errors, rs->overflows);
+        SHOW();
+
+        showWindow(rail);
+
+        if ( rs->samples == 0 )
+            continue;
+
+        terminalOut((char *) "  since reset, min / mean / max:");
+        showStat("bus", rs->busMv.min, rs->busMv.sum / rs->samples, rs->busMv.max, true, "V");
+        showStat("current", rs->currentMa.min, rs->currentMa.sum / rs->samples, rs->currentMa.max, false, "mA");
+        showStat("power", rs->powerMw.min, rs->powerMw.sum / rs->samples, rs->powerMw.max, true, "W");
+    }
+
+    return(0);
+}
@@ -0,0 +1,356 @@
+//===================================================================
+// protect.cpp
+// Power trip on rail over-current or TEMP_CRIT.  Both checks run in
+// interrupt context, so the time to drop MAIN_EN/AUX_EN doesn't depend
+// on loop() or on whatever command the CLI is in the middle of:
+//   - TEMP_CRIT: EIC_Handler() in events.cpp calls protect_TempCritIsr()
+//     ahead of its own bookkeeping.  protect_Tick() also checks the
+//     level every msec, for TEMP_CRIT already asserted at power up.
+//   - over-current: the INA219 has no ALERT output, so protect_Tick()
+//     (SysTick) queues a shunt register read of each rail every
+//     PROTECT_POLL_MS at telemetry priority, and the I2C completion
+//     callback compares the raw register against a limit converted
+//     when it was set.
+// A trip clears both enables with one PORT IOBUS OUTCLR write, then
+// records the cause and the usec from detection to that write.  The
+// enables stay off and 'power up' is refused until 'power protect
+// clear'.
+//
+// Over-current detection trails the current by up to one INA219
+// shunt conversion (shunt and bus alternate, so about 17 msec at
+// POWER_ADC_AVG, 84 usec during an inrush capture) plus any I2C
+// transaction already on the bus when the read is queued.
+//===================================================================
+#include <Arduino.h>
+#include "main.hpp"
+#include "commands.hpp"
+#include "cli.hpp"
+#include "eeprom.hpp"
+#include "pins.hpp"
+#include "i2cq.hpp"
+#include "power.hpp"
+#include "protect.hpp"
+
+extern char                 *tokens[];
+extern EEPROM_data_t        EEPROMData;
+static char                 outBfr[OUTBFR_SIZE];
+
+static_assert(pinGroup(OCP_MAIN_PWR_EN) == pinGroup(OCP_AUX_PWR_EN), "MAIN_EN and AUX_EN must share a PORT group");
+
+#define EN_GROUP                pinGroup(OCP_MAIN_PWR_EN)
+#define EN_MASK                 (pinMask(OCP_MAIN_PWR_EN) | pinMask(OCP_AUX_PWR_EN))
+
+static const char           *causeNames[] = {"none", "MAIN over-current", "AUX over-current", "TEMP_CRIT",
+                                             "TEMP_CRIT (level)"};
+static const uint8_t        regShunt = INA219_REG_SHUNT;
+
+static volatile bool        tcritArmed = false;
+static volatile uint8_t     ocpRails = 0;               // bit per rail with a limit and a monitor
+static volatile int16_t     limitRaw[POWER_RAIL_CNT];   // shunt register value above which to trip
+static i2cq_xfer_t          xfers[POWER_RAIL_CNT];
+static uint8_t              rxData[POWER_RAIL_CNT][2];
+static uint8_t              pollTicks = 0;
+
+static volatile bool        tripped = false;
+static volatile bool        tripNew = false;            // not announced by protect_Service() yet
+static protect_trip_t       lastTrip;
+static uint32_t             tripCount = 0;
+static uint32_t             latencyMaxUs = 0;
+static uint32_t             polls = 0;
+static uint32_t             readErrors = 0;
+
+/**
+  * @name   enablesOn
+  * @brief  check if MAIN_EN or AUX_EN is driven high
+  * @param  None
+  * @retval bool
+  */
+static inline bool enablesOn(void)
+{
+    return((PORT_IOBUS->Group[EN_GROUP].OUT.reg & EN_MASK) != 0);
+}
+
+/**
+  * @name   tcritAsserted
+  * @brief  read TEMP_CRIT (active high)
+  * @param  None
+  * @retval bool
+  */
+static inline bool tcritAsserted(void)
+{
+    return((PORT_IOBUS->Group[pinGroup(TEMP_CRIT)].IN.reg & pinMask(TEMP_CRIT)) != 0);
+}
+
+/**
+  * @name   trip
+  * @brief  drop MAIN_EN and AUX_EN, record why
+  * @param  cause  PROTECT_CAUSE_xxx
+  * @param  detectUsec  micros() when the condition was seen
+  * @param  ma  over-current reading, else 0
+  * @param  readUs  over-current: usec from queueing the read to detectUsec
+  * @retval None
+  * @note   ISR context; only the first trip is recorded until cleared
+  */
+static void trip(uint8_t cause, uint32_t detectUsec, int16_t ma, uint32_t readUs)
+{
+    uint32_t        offUsec;
+
+    PORT_IOBUS->Group[EN_GROUP].OUTCLR.reg = EN_MASK;
+    offUsec = micros();
+
+    if ( tripped )
+        return;
+
+    lastTrip.cause = cause;
+    lastTrip.currentMa = ma;
+    lastTrip.msec = millis();
+    lastTrip.latencyUs = offUsec - detectUsec;
+    lastTrip.readUs = lastTrip.latencyUs + readUs;
+
+    if ( lastTrip.latencyUs > latencyMaxUs )
+        latencyMaxUs = lastTrip.latencyUs;
+
+    tripCount++;
+    tripped = true;
+    tripNew = true;
+}
+
+/**
+  * @name   readDone
+  * @brief  I2C queue callback for the shunt reads, compare and trip
+  * @param  x  transaction
+  * @retval None
+  * @note   ISR context
+  */
+static void readDone(i2cq_xfer_t *x)
+{
+    uint8_t         rail = x - xfers;
+    int16_t         raw;
+
+    if ( x->status != I2CQ_OK )
+    {
+        readErrors++;
+        return;
+    }
+
+    raw = (int16_t) ((rxData[rail][0] << 8) | rxData[rail][1]);
+
+    if ( (ocpRails & (1 << rail)) && raw > limitRaw[rail] && enablesOn() )
+        trip((rail == POWER_RAIL_MAIN) ? PROTECT_CAUSE_OCP_MAIN : PROTECT_CAUSE_OCP_AUX, micros(),
+             power_ShuntToMa(rail, raw), x->usec);
+}
+
+/**
+  * @name   protect_TempCritIsr
+  * @brief  TEMP_CRIT edge seen by the EIC
+  * @param  usec  micros() at EIC ISR entry
+  * @retval None
+  * @note   EIC ISR context, called before the event is queued
+  */
+void protect_TempCritIsr(uint32_t usec)
+{
+    if ( tcritArmed && tcritAsserted() && enablesOn() )
+        trip(PROTECT_CAUSE_TCRIT, usec, 0, 0);
+}
+
+/**
+  * @name   protect_Tick
+  * @brief  TEMP_CRIT level check and over-current polling
+  * @param  None
+  * @retval None
+  * @note   SysTick context (see sysTickHook() in i2cq.cpp), every msec
+  */
+void protect_Tick(void)
+{
+    uint32_t        now;
+
+    if ( tripped || enablesOn() == false )
+        return;
+
+    if ( tcritArmed && tcritAsserted() )
+    {
+        now = micros();
+        trip(PROTECT_CAUSE_TCRIT_LEVEL, now, 0, 0);
+        return;
+    }
+
+    if ( ++pollTicks < PROTECT_POLL_MS )
+        return;
+
+    pollTicks = 0;
+
+    for ( uint8_t rail = 0; rail < POWER_RAIL_CNT; rail++ )
+    {
+        i2cq_xfer_t     *x = &xfers[rail];
+
+        // last read still queued: the bus is busy, don't stack them up
+        if ( (ocpRails & (1 << rail)) == 0 || x->status == I2CQ_PENDING || x->status == I2CQ_BUSY )
+            continue;
+
+        memset(x, 0, sizeof(i2cq_xfer_t));
+        x->addr = power_RailAddr(rail);
+        x->tx = &regShunt;
+        x->txLen = 1;
+        x->rx = rxData[rail];
+        x->rxLen = 2;
+        x->priority = I2CQ_PRIO_TELEMETRY;
+        x->hz = I2CQ_FAST_HZ;
+        x->callback = readDone;
+
+        if ( i2cq_Submit(x) )
+            polls++;
+    }
+}
+
+/**
+  * @name   protect_Init
+  * @brief  start with protection off until the FLASH settings are read
+  * @param  None
+  * @retval None
+  */
+void protect_Init(void)
+{
+    tcritArmed = false;
+    ocpRails = 0;
+    tripped = tripNew = false;
+    memset(&lastTrip, 0, sizeof(lastTrip));
+}
+
+/**
+  * @name   protect_Configure
+  * @brief  apply ocpmain, ocpaux and tcrit from EEPROMData
+  * @param  None
+  * @retval None
+  * @note   call after EEPROM_InitLocal(), 'set' and monitorsInit()
+  */
+void protect_Configure(void)
+{
+    uint16_t        limitMa[POWER_RAIL_CNT] = {EEPROMData.ocp_main_ma, EEPROMData.ocp_aux_ma};
+    uint8_t         rails = 0;
+
+    for ( uint8_t rail = 0; rail < POWER_RAIL_CNT; rail++ )
+    {
+        if ( limitMa[rail] == 0 || power_Present(rail) == false )
+            continue;
+
+        limitRaw[rail] = power_MaToShunt(rail, limitMa[rail]);
+        rails |= (1 << rail);
+    }
+
+    ocpRails = rails;
+    tcritArmed = (EEPROMData.tcrit_trip != 0);
+}
+
+/**
+  * @name   protect_Tripped
+  * @brief  check for a trip not yet cleared
+  * @param  None
+  * @retval bool
+  */
+bool protect_Tripped(void)
+{
+    return(tripped);
+}
+
+/**
+  * @name   showTrip
+  * @brief  display the last trip
+  * @param  None
+  * @retval None
+  */
+static void showTrip(void)
+{
+    protect_trip_t  t;
+    int             len;
+
+    __disable_irq();
+    t = lastTrip;
+    __enable_irq();
+
+    len = sprintf(outBfr, "  last trip: %s at %lu.%03lu s", causeNames[t.cause], t.msec / 1000, t.msec % 1000);
+    if ( t.cause == PROTECT_CAUSE_OCP_MAIN || t.cause == PROTECT_CAUSE_OCP_AUX )
+        sprintf(&outBfr[len], ", %d mA", t.currentMa);
+    SHOW();
+
+    len = sprintf(outBfr, "  detection to MAIN_EN/AUX_EN low: %lu us", t.latencyUs);
+    if ( t.cause == PROTECT_CAUSE_OCP_MAIN || t.cause == PROTECT_CAUSE_OCP_AUX )
+        sprintf(&outBfr[len], " (%lu us from queueing the read)", t.readUs);
+    SHOW();
+}
+
+/**
+  * @name   protect_Service
+  * @brief  announce a trip and bring pinStates[] in line with it
+  * @param  None
+  * @retval None
+  * @note   called from loop() and before 'power' acts on pin states
+  */
+void protect_Service(void)
+{
+    if ( tripNew == false )
+        return;
+
+    tripNew = false;
+
+    // the ISR wrote PORT directly
+    writePin(OCP_MAIN_PWR_EN, 0);
+    writePin(OCP_AUX_PWR_EN, 0);
+
+    terminalOut((char *) "*** Power protection trip: MAIN_EN and AUX_EN are off, see 'power protect'");
+    showTrip();
+}
+
+/**
+  * @name   powerProtectCmd
+  * @brief  'power protect' subcommand
+  * @param  arg  number of arguments to 'power'
+  * @param  tokens[2]  optional 'clear'
+  * @retval 0=OK 1=error
+  */
+int powerProtectCmd(int arg)
+{
+    int             len;
+
+    if ( arg >= 2 )
+    {
+        if ( strcmp(tokens[2], "clear") != 0 )
+        {
+            terminalOut((char *) "Usage: power protect [clear]");
+            return(1);
+        }
+
+        if ( tcritArmed && tcritAsserted() )
+        {
+            terminalOut((char *) "TEMP_CRIT is still asserted; trip not cleared");
+            return(1);
+        }
+
+        protect_Service();
+        tripped = false;
+        terminalOut((char *) "Protection trip cleared; power is still off");
+        return(0);
+    }
+
+    len = sprintf(outBfr, "Protection %s: ", tripped ? "TRIPPED" : (ocpRails || tcritArmed) ? "armed" : "off");
+    for ( uint8_t rail = 0; rail < POWER_RAIL_CNT; rail++ )
+    {
+        uint16_t    ma = (rail == POWER_RAIL_MAIN) ? EEPROMData.ocp_main_ma : EEPROMData.ocp_aux_ma;
+
+        if ( ocpRails & (1 << rail) )
+            len += sprintf(&outBfr[len], "%s > %u mA, ", (rail == POWER_RAIL_MAIN) ? "MAIN" : "AUX", ma);
+        else
+            len += sprintf(&outBfr[len], "%s %s, ", (rail == POWER_RAIL_MAIN) ? "MAIN" : "AUX",
+                           ma ? "no monitor" : "off");
+    }
+    sprintf(&outBfr[len], "TEMP_CRIT %s", tcritArmed ? "on" : "off");
+    SHOW();
+
+    sprintf(outBfr, "  %lu trips, worst latency %lu us, %lu shunt reads, %lu read errors", tripCount, latencyMaxUs,
+            polls, readErrors);
+    SHOW();
+
+    if ( tripCount )
+        showTrip();
+
+    return(0);
+}
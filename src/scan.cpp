@@ -0,0 +1,477 @@
+//===================================================================
+// scan.cpp
+// Scan chain engine.  SERCOM0 in SPI master mode clocks the NIC 3.0
+// scan chain: SCK on OCP_SCAN_CLK (PA11), MISO on OCP_SCAN_DATA_IN
+// (PA10) and MOSI on OCP_SCAN_DATA_OUT (PA08).  Data in and out are
+// moved by two DMA channels in the same transfer.
+//
+// SPI mode 2 (clock idles high, sample on falling edge, shift on
+// rising edge) MSB first gives the same bits as the bit-banged TC5
+// path in timers.cpp: first bit sampled after the first falling
+// edge lands in bit 31.  scan_SetSampleEdge() can move the sample
+// point to the rising edge (mode 3) for cards whose data is late at
+// high clock rates; 'scan tune' picks the rate and edge.
+//
+// scan_Start()/scan_StartChain() return as soon as the DMA is running
+// and report through a callback from the RX channel's completion
+// interrupt, so scanmon can keep the loop going while a chain shifts;
+// scan_Transfer() and the capture calls are blocking wrappers.
+//
+// The pins are only muxed to the SERCOM during a transfer so the
+// 'write' command and readPin() work on them the rest of the time.
+//
+// The chain length comes from scanChains[] by the card's SCAN_VER[1:0]
+// straps unless set explicitly with scan_SetLength().  Received byte
+// N is chain byte N with bit 7 shifted in first.
+//===================================================================
+#include <Arduino.h>
+#include "main.hpp"
+#include "commands.hpp"
+#include "pins.hpp"
+#include "dma.hpp"
+#include "scan.hpp"
+
+#define SCAN_PMUX_FUNC          2           // peripheral function C = SERCOM
+#define SCAN_TIMEOUT_MS         10          // on top of the time the bits take
+
+// NOTE: OCP NIC 3.0 defines SCAN_VER 00 only; the other versions read two
+// 32-bit chains so longer cards are captured in full, trailing bits that
+// the card does not drive read back as SCAN_DATA_IN's idle level
+const scan_chain_t          scanChains[] = {
+    {0, 4, 8, "v1 32-bit"},
+    {1, 8, 8, "extended 64-bit"},
+    {2, 8, 8, "extended 64-bit"},
+    {3, 8, 8, "extended 64-bit"},
+};
+
+static_assert(sizeof(scanChains) / sizeof(scan_chain_t) == 4, "scanChains[] needs an entry per SCAN_VER value");
+
+static uint32_t             scanClockHz = SCAN_CLK_DEFAULT_HZ;
+static uint8_t              scanSampleEdge = SCAN_EDGE_FALLING;
+static uint8_t              scanBytesOverride = 0;      // 0 = chosen by SCAN_VER
+static scan_chain_t         scanManual = {0, 0, 0, "set by 'scan len'"};
+static volatile SCAN_STATE  scanState = SCAN_IDLE;
+static scan_cb_t            scanCallback;
+static uint32_t             scanStartTime;
+static uint32_t             scanTimeout;
+static uint16_t             scanLen;
+static uint8_t              txBfr[SCAN_MAX_BYTES];
+static uint8_t              rxBfr[SCAN_MAX_BYTES];
+
+/**
+  * @name   scanSync
+  * @brief  wait for SERCOM register synchronization
+  * @param  None
+  * @retval None
+  */
+static void scanSync(void)
+{
+    while (SCAN_SERCOM->SPI.SYNCBUSY.reg);
+}
+
+/**
+  * @name   scanPinMux
+  * @brief  hand scan pins to the SERCOM or back to PORT
+  * @param  enable  true = SERCOM, false = GPIO
+  * @retval None
+  */
+static void scanPinMux(bool enable)
+{
+    const uint8_t   pins[] = {OCP_SCAN_DATA_OUT, OCP_SCAN_DATA_IN, OCP_SCAN_CLK};
+
+    for ( unsigned i = 0; i < sizeof(pins); i++ )
+    {
+        uint8_t     group = pinGroup(pins[i]);
+        uint8_t     bit = PORTBIT_BIT(pinPortBit[pins[i]]);
+
+        if ( enable )
+        {
+            if ( bit & 1 )
+                PORT->Group[group].PMUX[bit >> 1].reg = (PORT->Group[group].PMUX[bit >> 1].reg & ~PORT_PMUX_PMUXO_Msk) | PORT_PMUX_PMUXO(SCAN_PMUX_FUNC);
+            else
+                PORT->Group[group].PMUX[bit >> 1].reg = (PORT->Group[group].PMUX[bit >> 1].reg & ~PORT_PMUX_PMUXE_Msk) | PORT_PMUX_PMUXE(SCAN_PMUX_FUNC);
+
+            PORT->Group[group].PINCFG[bit].reg |= PORT_PINCFG_PMUXEN;
+        }
+        else
+        {
+            PORT->Group[group].PINCFG[bit].reg &= ~PORT_PINCFG_PMUXEN;
+        }
+    }
+}
+
+/**
+  * @name   scanFinish
+  * @brief  stop the DMA, release the pins and report the result
+  * @param  state  SCAN_DONE or SCAN_ERROR
+  * @retval None
+  * @note   DMAC ISR context, or thread with the DMAC IRQ masked
+  */
+static void scanFinish(SCAN_STATE state)
+{
+    dma_channelDisable(DMA_CH_SCAN_TX);
+    dma_channelDisable(DMA_CH_SCAN_RX);
+    scanPinMux(false);
+
+    scanState = state;
+
+    if ( scanCallback )
+        scanCallback(state, rxBfr, scanLen);
+}
+
+/**
+  * @name   scanDmaDone
+  * @brief  DMA callback for the RX channel
+  * @param  ch  channel
+  * @param  flags  CHINTFLAG bits
+  * @retval None
+  * @note   DMAC ISR context
+  */
+static void scanDmaDone(uint8_t ch, uint8_t flags)
+{
+    (void) ch;
+
+    if ( scanState != SCAN_BUSY )
+        return;
+
+    scanFinish((flags & DMAC_CHINTFLAG_TERR) ? SCAN_ERROR : SCAN_DONE);
+}
+
+/**
+  * @name   scanLoad
+  * @brief  pulse SCAN_LD_N to parallel load the chain
+  * @param  None
+  * @retval None
+  */
+static void scanLoad(void)
+{
+    writePin(OCP_SCAN_LD_N, 0);
+    delayMicroseconds(SCAN_LD_PULSE_USEC);
+    writePin(OCP_SCAN_LD_N, 1);
+}
+
+/**
+  * @name   scan_SetClock
+  * @brief  set scan clock rate
+  * @param  hz  requested SCAN_CLK frequency
+  * @retval uint32_t  actual frequency (GCLK0 / (2 * (BAUD + 1)))
+  */
+uint32_t scan_SetClock(uint32_t hz)
+{
+    uint32_t        baud;
+
+    if ( hz < SCAN_CLK_MIN_HZ )
+        hz = SCAN_CLK_MIN_HZ;
+    else if ( hz > SCAN_CLK_MAX_HZ )
+        hz = SCAN_CLK_MAX_HZ;
+
+    // round up so the clock never runs faster than requested
+    baud = (SystemCoreClock + (2 * hz) - 1) / (2 * hz) - 1;
+    if ( baud > 255 )
+        baud = 255;
+
+    // not under a transfer scanmon started
+    while ( scan_Poll(NULL) == SCAN_BUSY )
+        ;
+
+    SCAN_SERCOM->SPI.CTRLA.bit.ENABLE = 0;
+    scanSync();
+    SCAN_SERCOM->SPI.BAUD.reg = (uint8_t) baud;
+    SCAN_SERCOM->SPI.CTRLA.bit.ENABLE = 1;
+    scanSync();
+
+    scanClockHz = SystemCoreClock / (2 * (baud + 1));
+    return(scanClockHz);
+}
+
+/**
+  * @name   scan_GetClock
+  * @brief  get scan clock rate
+  * @param  None
+  * @retval uint32_t  SCAN_CLK frequency in Hz
+  */
+uint32_t scan_GetClock(void)
+{
+    return(scanClockHz);
+}
+
+/**
+  * @name   scan_SetSampleEdge
+  * @brief  set SCAN_CLK edge SCAN_DATA_IN is sampled on
+  * @param  edge  SCAN_EDGE_FALLING or SCAN_EDGE_RISING
+  * @retval None
+  */
+void scan_SetSampleEdge(uint8_t edge)
+{
+    // not under a transfer scanmon started
+    while ( scan_Poll(NULL) == SCAN_BUSY )
+        ;
+
+    SCAN_SERCOM->SPI.CTRLA.bit.ENABLE = 0;
+    scanSync();
+
+    if ( edge == SCAN_EDGE_RISING )
+        SCAN_SERCOM->SPI.CTRLA.reg |= SERCOM_SPI_CTRLA_CPHA;
+    else
+        SCAN_SERCOM->SPI.CTRLA.reg &= ~SERCOM_SPI_CTRLA_CPHA;
+
+    SCAN_SERCOM->SPI.CTRLA.bit.ENABLE = 1;
+    scanSync();
+
+    scanSampleEdge = (edge == SCAN_EDGE_RISING) ? SCAN_EDGE_RISING : SCAN_EDGE_FALLING;
+}
+
+/**
+  * @name   scan_GetSampleEdge
+  * @brief  get SCAN_CLK edge SCAN_DATA_IN is sampled on
+  * @param  None
+  * @retval uint8_t  SCAN_EDGE_FALLING or SCAN_EDGE_RISING
+  */
+uint8_t scan_GetSampleEdge(void)
+{
+    return(scanSampleEdge);
+}
+
+/**
+  * @name   scan_Init
+  * @brief  configure SERCOM0 as SPI master for the scan chain
+  * @param  None
+  * @retval None
+  * @note   call after dma_Init(); pins stay GPIO until a transfer
+  */
+void scan_Init(void)
+{
+    PM->APBCMASK.reg |= PM_APBCMASK_SERCOM0;
+    GCLK->CLKCTRL.reg = (uint16_t) (GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID(GCM_SERCOM0_CORE));
+    while (GCLK->STATUS.bit.SYNCBUSY);
+
+    SCAN_SERCOM->SPI.CTRLA.reg = SERCOM_SPI_CTRLA_SWRST;
+    while (SCAN_SERCOM->SPI.CTRLA.bit.SWRST || SCAN_SERCOM->SPI.SYNCBUSY.bit.SWRST);
+
+    // DO = PAD0, SCK = PAD3 (DOPO 3); DI = PAD2 (DIPO 2); mode 2, MSB first
+    SCAN_SERCOM->SPI.CTRLA.reg = SERCOM_SPI_CTRLA_MODE_SPI_MASTER | SERCOM_SPI_CTRLA_DOPO(3) |
+                                 SERCOM_SPI_CTRLA_DIPO(2) | SERCOM_SPI_CTRLA_CPOL;
+    SCAN_SERCOM->SPI.CTRLB.reg = SERCOM_SPI_CTRLB_RXEN;
+    scanSync();
+
+    dma_setCallback(DMA_CH_SCAN_RX, scanDmaDone);
+    (void) scan_SetClock(scanClockHz);
+}
+
+/**
+  * @name   scan_Start
+  * @brief  start shifting bytes out on SCAN_DATA_OUT and in from
+  *         SCAN_DATA_IN, return at once
+  * @param  tx  bytes to send, MSB of tx[0] first; copied
+  * @param  len  byte count, max SCAN_MAX_BYTES
+  * @param  callback  called with the result when the transfer ends, NULL
+  *                   for none; runs in DMAC ISR context on completion or
+  *                   from scan_Poll() on timeout
+  * @retval bool  false if a transfer is in flight or len is bad
+  * @note   caller handles SCAN_LD_N
+  */
+bool scan_Start(const uint8_t *tx, uint16_t len, scan_cb_t callback)
+{
+    DmacDescriptor  *d;
+
+    if ( scanState == SCAN_BUSY || len == 0 || len > SCAN_MAX_BYTES )
+        return(false);
+
+    memcpy(txBfr, tx, len);
+    scanLen = len;
+    scanCallback = callback;
+    scanTimeout = SCAN_TIMEOUT_MS + (len * 8 * 1000) / scanClockHz;
+
+    d = &dmaDescriptors[DMA_CH_SCAN_RX];
+    d->BTCTRL.reg = DMAC_BTCTRL_VALID | DMAC_BTCTRL_BEATSIZE_BYTE | DMAC_BTCTRL_DSTINC | DMAC_BTCTRL_BLOCKACT_INT;
+    d->BTCNT.reg = len;
+    d->SRCADDR.reg = (uint32_t) &SCAN_SERCOM->SPI.DATA.reg;
+    d->DSTADDR.reg = (uint32_t) &rxBfr[len];
+    d->DESCADDR.reg = 0;
+
+    d = &dmaDescriptors[DMA_CH_SCAN_TX];
+    d->BTCTRL.reg = DMAC_BTCTRL_VALID | DMAC_BTCTRL_BEATSIZE_BYTE | DMAC_BTCTRL_SRCINC | DMAC_BTCTRL_BLOCKACT_NOACT;
+    d->BTCNT.reg = len;
+    d->SRCADDR.reg = (uint32_t) &txBfr[len];
+    d->DSTADDR.reg = (uint32_t) &SCAN_SERCOM->SPI.DATA.reg;
+    d->DESCADDR.reg = 0;
+
+    dma_channelConfig(DMA_CH_SCAN_RX, DMAC_CHCTRLB_TRIGSRC(SERCOM0_DMAC_ID_RX) | DMAC_CHCTRLB_TRIGACT_BEAT | DMAC_CHCTRLB_LVL(0),
+                      DMAC_CHINTENSET_TCMPL | DMAC_CHINTENSET_TERR);
+    dma_channelConfig(DMA_CH_SCAN_TX, DMAC_CHCTRLB_TRIGSRC(SERCOM0_DMAC_ID_TX) | DMAC_CHCTRLB_TRIGACT_BEAT | DMAC_CHCTRLB_LVL(0), 0);
+
+    // SCK idles high; GPIO level matches so the mux switch doesn't glitch
+    writePin(OCP_SCAN_CLK, 1);
+    scanPinMux(true);
+
+    scanState = SCAN_BUSY;
+    scanStartTime = millis();
+
+    // RX first so no received byte is missed; TX starts on DRE at once
+    dma_channelEnable(DMA_CH_SCAN_RX);
+    dma_channelEnable(DMA_CH_SCAN_TX);
+    return(true);
+}
+
+/**
+  * @name   scan_Poll
+  * @brief  check on a transfer started by scan_Start()
+  * @param  rx  filled with the bytes received when the result is
+  *             SCAN_DONE; may be NULL
+  * @retval SCAN_STATE
+  * @note   a transfer still running after its timeout is stopped here
+  *         and reported as SCAN_ERROR
+  */
+SCAN_STATE scan_Poll(uint8_t *rx)
+{
+    if ( scanState == SCAN_BUSY && millis() - scanStartTime > scanTimeout )
+    {
+        NVIC_DisableIRQ(DMAC_IRQn);
+        if ( scanState == SCAN_BUSY )
+            scanFinish(SCAN_ERROR);
+        NVIC_EnableIRQ(DMAC_IRQn);
+    }
+
+    if ( scanState == SCAN_DONE && rx != NULL )
+        memcpy(rx, rxBfr, scanLen);
+
+    return(scanState);
+}
+
+/**
+  * @name   scan_Transfer
+  * @brief  shift bytes out on SCAN_DATA_OUT and in from SCAN_DATA_IN
+  * @param  tx  bytes to send, MSB of tx[0] first
+  * @param  rx  bytes received, MSB of rx[0] first
+  * @param  len  byte count, max SCAN_MAX_BYTES
+  * @retval bool  true if OK, false on DMA error or timeout
+  * @note   caller handles SCAN_LD_N; blocking wrapper around
+  *         scan_Start()/scan_Poll(), waits out a transfer in flight
+  */
+bool scan_Transfer(const uint8_t *tx, uint8_t *rx, uint16_t len)
+{
+    SCAN_STATE      state;
+
+    while ( scan_Poll(NULL) == SCAN_BUSY )
+        ;
+
+    if ( scan_Start(tx, len, NULL) == false )
+        return(false);
+
+    while ( (state = scan_Poll(rx)) == SCAN_BUSY )
+    {
+        // wait for the RX DMA to complete
+        ;
+    }
+
+    return(state == SCAN_DONE);
+}
+
+/**
+  * @name   scan_SetLength
+  * @brief  set chain length explicitly
+  * @param  bytes  chain length in bytes, 0 = use SCAN_VER[1:0]
+  * @retval uint8_t  length set (clamped to SCAN_MAX_BYTES)
+  */
+uint8_t scan_SetLength(uint8_t bytes)
+{
+    if ( bytes > SCAN_MAX_BYTES )
+        bytes = SCAN_MAX_BYTES;
+
+    scanBytesOverride = bytes;
+    return(bytes);
+}
+
+/**
+  * @name   scan_GetChain
+  * @brief  get the chain layout to capture
+  * @param  None
+  * @retval const scan_chain_t *  layout by SCAN_VER or explicit length
+  */
+const scan_chain_t *scan_GetChain(void)
+{
+    uint8_t         ver = (readPin(SCAN_VER_1) << 1) | readPin(SCAN_VER_0);
+    int             ports;
+
+    if ( scanBytesOverride == 0 )
+        return(&scanChains[ver]);
+
+    // ports that fit completely in the explicit length
+    ports = ((scanBytesOverride * 8) - SCAN_PORT_BASE) / SCAN_PORT_BITS;
+    scanManual.scanVer = ver;
+    scanManual.bytes = scanBytesOverride;
+    scanManual.ports = (ports < 0) ? 0 : (ports > SCAN_MAX_PORTS) ? SCAN_MAX_PORTS : ports;
+    return(&scanManual);
+}
+
+/**
+  * @name   scan_CaptureChain
+  * @brief  load and shift a scan chain of any length
+  * @param  rx  chain bytes, byte 0 first
+  * @param  len  chain length in bytes
+  * @retval bool  true if OK
+  * @note   SCAN_DATA_OUT holds its current level for the whole transfer;
+  *         blocking wrapper around scan_StartChain()/scan_Poll()
+  */
+bool scan_CaptureChain(uint8_t *rx, uint16_t len)
+{
+    SCAN_STATE      state;
+
+    while ( scan_Poll(NULL) == SCAN_BUSY )
+        ;
+
+    if ( scan_StartChain(len, NULL) == false )
+        return(false);
+
+    while ( (state = scan_Poll(rx)) == SCAN_BUSY )
+        ;
+
+    return(state == SCAN_DONE);
+}
+
+/**
+  * @name   scan_StartChain
+  * @brief  load a scan chain of any length and start shifting it in
+  * @param  len  chain length in bytes
+  * @param  callback  see scan_Start()
+  * @retval bool  false if a transfer is in flight or len is bad
+  * @note   SCAN_DATA_OUT holds its current level for the whole transfer;
+  *         only the SCAN_LD_PULSE_USEC load pulse blocks
+  */
+bool scan_StartChain(uint16_t len, scan_cb_t callback)
+{
+    uint8_t         tx[SCAN_MAX_BYTES];
+
+    // a load pulse in the middle of a transfer would corrupt it
+    if ( scanState == SCAN_BUSY || len == 0 || len > SCAN_MAX_BYTES )
+        return(false);
+
+    memset(tx, getPinState(OCP_SCAN_DATA_OUT) ? 0xFF : 0, len);
+    scanLoad();
+
+    return(scan_Start(tx, len, callback));
+}
+
+/**
+  * @name   scan_Capture
+  * @brief  load and shift the 32-bit scan chain
+  * @param  txWord  data shifted out on SCAN_DATA_OUT, MSB first
+  * @param  rxWord  data shifted in, first bit in bit 31
+  * @retval bool  true if OK
+  */
+bool scan_Capture(uint32_t txWord, uint32_t *rxWord)
+{
+    uint8_t         tx[4] = {(uint8_t) (txWord >> 24), (uint8_t) (txWord >> 16), (uint8_t) (txWord >> 8), (uint8_t) txWord};
+    uint8_t         rx[4];
+
+    while ( scan_Poll(NULL) == SCAN_BUSY )
+        ;
+
+    scanLoad();
+
+    if ( scan_Transfer(tx, rx, 4) == false )
+        return(false);
+
+    *rxWord = ((uint32_t) rx[0] << 24) | ((uint32_t) rx[1] << 16) | ((uint32_t) rx[2] << 8) | rx[3];
+    return(true);
+}
@@ -0,0 +1,373 @@
+//===================================================================
+// scanmon.cpp
+// Background scan chain monitor.  scanmon_Service() re-captures the
+// chain at a set rate from the main loop; the capture is started with
+// scan_StartChain() and shifts under DMA while the loop carries on,
+// and the result is picked up by a later scanmon_Service() call, which
+// only records a capture when it differs from the previous one (time +
+// XOR mask), so streaming stays small at high capture rates.  Per-bit
+// toggle and high-sample counts give link flap counts and ACT activity
+// per port over long thermal soaks.
+//===================================================================
+#include <Arduino.h>
+#include "main.hpp"
+#include "commands.hpp"
+#include "cli.hpp"
+#include "scan.hpp"
+#include "scanmon.hpp"
+#include "txfmt.hpp"
+
+extern char                 *tokens[];
+extern const char           *scanByte0Names[];
+extern const char           *scanPortFieldNames[];
+static char                 outBfr[OUTBFR_SIZE];
+
+#define SCANMON_BITS            (SCAN_MAX_BYTES * 8)
+
+static bool                 monRunning = false;
+static bool                 monStreaming = false;
+static uint32_t             monPeriodUs = 1000000 / SCANMON_DEFAULT_HZ;   // stats before the first start
+static uint32_t             monLastCapture;
+static uint32_t             monStartTime;
+static uint8_t              monBytes;                   // chain length for this run
+static uint8_t              monPorts;
+static uint8_t              monLast[SCAN_MAX_BYTES];
+
+static uint32_t             monCaptures;
+static uint32_t             monChanges;
+static uint32_t             monErrors;
+static uint32_t             monToggles[SCANMON_BITS];
+static uint32_t             monHigh[SCANMON_BITS];      // captures with bit = 1
+
+static scanmon_rec_t        monLog[SCANMON_LOG_SIZE];
+static uint32_t             monLogCount;
+
+static bool                 monCapturing = false;       // scan_StartChain() in flight
+static volatile SCAN_STATE  monResult = SCAN_IDLE;      // set by monScanDone(), IDLE = none yet
+static uint8_t              monData[SCAN_MAX_BYTES];
+
+/**
+  * @name   showRecord
+  * @brief  output a change record
+  * @param  r  record
+  * @retval None
+  */
+static void showRecord(const scanmon_rec_t *r)
+{
+    TxLine          line;
+
+    line << txFixed<3, 10>(r->msec) << " xor";
+    for ( int i = 0; i < monBytes; i++ )
+        line << ' ' << txHex<2>(r->xorMask[i]);
+    line.end();
+}
+
+/**
+  * @name   monStart
+  * @brief  clear stats and start monitoring
+  * @param  hz  captures/sec
+  * @retval None
+  */
+static void monStart(uint32_t hz)
+{
+    const scan_chain_t  *chain = scan_GetChain();
+
+    monBytes = chain->bytes;
+    monPorts = chain->ports;
+    monPeriodUs = 1000000 / hz;
+    monCaptures = monChanges = monErrors = 0;
+    monLogCount = 0;
+    memset(monToggles, 0, sizeof(monToggles));
+    memset(monHigh, 0, sizeof(monHigh));
+
+    // drop a capture left over from the last run
+    while ( scan_Poll(NULL) == SCAN_BUSY )
+        ;
+    monCapturing = false;
+    monResult = SCAN_IDLE;
+
+    monStartTime = millis();
+    monLastCapture = micros() - monPeriodUs;
+    monRunning = true;
+}
+
+/**
+  * @name   scanmon_Running
+  * @brief  check if monitor is running
+  * @param  None
+  * @retval bool
+  */
+bool scanmon_Running(void)
+{
+    return(monRunning);
+}
+
+/**
+  * @name   monScanDone
+  * @brief  scan_StartChain() completion, keep the result for
+  *         scanmon_Service()
+  * @param  state  SCAN_DONE or SCAN_ERROR
+  * @param  rx  chain bytes
+  * @param  len  byte count
+  * @retval None
+  * @note   DMAC ISR context, or from scan_Poll() on timeout
+  */
+static void monScanDone(SCAN_STATE state, const uint8_t *rx, uint16_t len)
+{
+    if ( state == SCAN_DONE )
+        memcpy(monData, rx, len);
+
+    monResult = state;
+}
+
+/**
+  * @name   monRecord
+  * @brief  record changes and update stats for one capture
+  * @param  data  chain bytes
+  * @retval None
+  */
+static void monRecord(const uint8_t *data)
+{
+    scanmon_rec_t       *r;
+    bool                changed = false;
+
+    r = &monLog[monLogCount % SCANMON_LOG_SIZE];
+
+    for ( uint16_t bit = 0; bit < monBytes * 8; bit++ )
+    {
+        if ( scan_GetBit(data, bit) )
+            monHigh[bit]++;
+    }
+
+    // first capture is the reference, not a change
+    if ( monCaptures++ != 0 )
+    {
+        for ( int i = 0; i < monBytes; i++ )
+        {
+            r->xorMask[i] = data[i] ^ monLast[i];
+            if ( r->xorMask[i] )
+                changed = true;
+        }
+    }
+
+    memcpy(monLast, data, monBytes);
+
+    if ( changed == false )
+        return;
+
+    for ( uint16_t bit = 0; bit < monBytes * 8; bit++ )
+    {
+        if ( scan_GetBit(r->xorMask, bit) )
+            monToggles[bit]++;
+    }
+
+    r->msec = millis();
+    monLogCount++;
+    monChanges++;
+
+    if ( monStreaming )
+        showRecord(r);
+}
+
+/**
+  * @name   scanmon_Service
+  * @brief  collect a finished capture, start the next one when due
+  * @param  None
+  * @retval None
+  * @note   called from loop() and long-running commands; never waits
+  *         for the chain to shift
+  */
+void scanmon_Service(void)
+{
+    if ( monRunning == false )
+        return;
+
+    if ( monCapturing )
+    {
+        // also times out a transfer that never completed
+        (void) scan_Poll(NULL);
+        if ( monResult == SCAN_IDLE )
+            return;
+
+        if ( monResult == SCAN_DONE )
+            monRecord(monData);
+        else
+            monErrors++;
+
+        monCapturing = false;
+        monResult = SCAN_IDLE;
+    }
+
+    if ( micros() - monLastCapture < monPeriodUs )
+        return;
+
+    monLastCapture += monPeriodUs;
+
+    // don't try to catch up after a long blocking command
+    if ( micros() - monLastCapture >= monPeriodUs )
+        monLastCapture = micros();
+
+    if ( isCardPresent() == false || scan_StartChain(monBytes, monScanDone) == false )
+    {
+        monErrors++;
+        return;
+    }
+
+    monCapturing = true;
+}
+
+/**
+  * @name   monDuty
+  * @brief  % of captures a bit was high
+  * @param  bit  chain bit #
+  * @retval uint32_t  0.01% units
+  */
+static uint32_t monDuty(uint16_t bit)
+{
+    return(monCaptures ? ((uint64_t) monHigh[bit] * 10000) / monCaptures : 0);
+}
+
+/**
+  * @name   monShowStats
+  * @brief  display per-bit and per-port statistics
+  * @param  None
+  * @retval None
+  */
+static void monShowStats(void)
+{
+    uint16_t        bit;
+    int             len;
+    TxLine          line;
+
+    sprintf(outBfr, "Scan monitor %s: %lu Hz, %d bytes, %lu captures, %lu changes, %lu errors in %lu secs",
+            monRunning ? "running" : "stopped", 1000000 / monPeriodUs, monBytes, monCaptures, monChanges,
+            monErrors, (millis() - monStartTime) / 1000);
+    terminalOut(outBfr);
+
+    if ( monCaptures == 0 )
+        return;
+
+    terminalOut((char *) "Bit  Name             Toggles   High%");
+    for ( bit = 0; bit < 8; bit++ )
+    {
+        line << "0." << txDec(bit) << "  " << txStr<14>(scanByte0Names[bit]) << ' ' << txDec<9>(monToggles[bit])
+             << "  " << txFixed<2, 6>(monDuty(bit));
+        line.end();
+    }
+
+    // link bits are active low so flaps are toggles and activity is low time
+    terminalOut((char *) "Port  SPDA flaps  SPDB flaps  ACT toggles  ACT on%");
+    for ( int port = 0; port < monPorts; port++ )
+    {
+        bit = SCAN_PORT_BASE + (port * SCAN_PORT_BITS);
+        line << " P" << txDec(port) << "   " << txDec<10>(monToggles[bit]) << "  " << txDec<10>(monToggles[bit + 1])
+             << "  " << txDec<11>(monToggles[bit + 2]) << "  " << txFixed<2, 6>(10000 - monDuty(bit + 2));
+        line.end();
+    }
+
+    bit = SCAN_PORT_BASE + (monPorts * SCAN_PORT_BITS);
+    if ( bit < monBytes * 8 )
+    {
+        len = sprintf(outBfr, "Other bits toggled:");
+        for ( ; bit < monBytes * 8; bit++ )
+        {
+            if ( monToggles[bit] && len < OUTBFR_SIZE - 20 )
+                len += sprintf(&outBfr[len], " %d.%d=%lu", bit >> 3, bit & 7, monToggles[bit]);
+        }
+        terminalOut(outBfr);
+    }
+}
+
+/**
+  * @name   monShowLog
+  * @brief  display recent change records
+  * @param  None
+  * @retval None
+  */
+static void monShowLog(void)
+{
+    uint32_t        count = (monLogCount < SCANMON_LOG_SIZE) ? monLogCount : SCANMON_LOG_SIZE;
+
+    sprintf(outBfr, "Last %lu of %lu changes (secs since boot, XOR vs previous capture):", count, monLogCount);
+    terminalOut(outBfr);
+
+    for ( uint32_t n = monLogCount - count; n < monLogCount; n++ )
+    {
+        showRecord(&monLog[n % SCANMON_LOG_SIZE]);
+    }
+}
+
+/**
+  * @name   scanmonCmd
+  * @brief  'scan mon' subcommands
+  * @param  arg  number of arguments to 'scan'
+  * @param  tokens[2]  start, stop, stream, stats or show
+  * @param  tokens[3]  start: captures/sec
+  * @retval 0=OK 1=error
+  */
+int scanmonCmd(int arg)
+{
+    uint32_t        hz = SCANMON_DEFAULT_HZ;
+
+    if ( arg < 2 || strcmp(tokens[2], "stats") == 0 )
+    {
+        monShowStats();
+    }
+    else if ( strcmp(tokens[2], "start") == 0 )
+    {
+        if ( arg >= 3 )
+            hz = strtoul(tokens[3], NULL, 0);
+
+        if ( hz == 0 || hz > SCANMON_MAX_HZ )
+        {
+            sprintf(outBfr, "Capture rate must be 1..%d Hz", SCANMON_MAX_HZ);
+            terminalOut(outBfr);
+            return(1);
+        }
+
+        if ( isCardPresent() == false )
+        {
+            terminalOut((char *) "NIC card is not present; cannot monitor scan chain");
+            return(1);
+        }
+
+        monStart(hz);
+        sprintf(outBfr, "Scan monitor started, %lu Hz, %d bytes", hz, monBytes);
+        terminalOut(outBfr);
+    }
+    else if ( strcmp(tokens[2], "stop") == 0 )
+    {
+        monRunning = false;
+        terminalOut((char *) "Scan monitor stopped");
+    }
+    else if ( strcmp(tokens[2], "stream") == 0 )
+    {
+        if ( monRunning == false )
+        {
+            terminalOut((char *) "Scan monitor is not running; use 'scan mon start'");
+            return(1);
+        }
+
+        terminalOut((char *) "Streaming scan chain changes, hit any key to stop");
+        monStreaming = true;
+
+        while ( SerialUSB.available() == 0 )
+            scanmon_Service();
+
+        while ( SerialUSB.available() )
+            (void) SerialUSB.read();
+
+        monStreaming = false;
+    }
+    else if ( strcmp(tokens[2], "show") == 0 )
+    {
+        monShowLog();
+    }
+    else
+    {
+        showCommandHelp(tokens[0]);
+        return(1);
+    }
+
+    return(0);
+}
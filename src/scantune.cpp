@@ -0,0 +1,234 @@
+//===================================================================
+// scantune.cpp
+// Scan clock self-tuning.  'scan tune' sweeps the SPI scan clock
+// over tuneRates[] with SCAN_DATA_IN sampled on either SCAN_CLK
+// edge.  Every test capture is paired with a reference capture at
+// SCAN_CLK_MIN_HZ on the falling edge taken just before it; a step
+// passes when no pass had a transfer error or a stable bit that
+// differs from its reference.  Bits that change between reference
+// captures alone (ACT LEDs, flapping links) are masked out first.
+//
+// The highest rate that passed along with every slower rate on the
+// same edge is saved to FLASH as sclk/sedge.
+//===================================================================
+#include <Arduino.h>
+#include "main.hpp"
+#include "commands.hpp"
+#include "cli.hpp"
+#include "eeprom.hpp"
+#include "scan.hpp"
+#include "scantune.hpp"
+
+extern char                 *tokens[];
+extern EEPROM_data_t        EEPROMData;
+static char                 outBfr[OUTBFR_SIZE];
+
+// SCAN_CLK rates tried, slowest first; all are GCLK0 / (2 * (BAUD + 1))
+static const uint32_t       tuneRates[] = {
+    SCAN_CLK_MIN_HZ, 250000, 500000, 1000000, 2000000,
+    3000000, 4000000, 6000000, 8000000, SCAN_CLK_MAX_HZ,
+};
+
+#define TUNE_RATE_CNT           (sizeof(tuneRates) / sizeof(uint32_t))
+
+/**
+  * @name   tuneCapture
+  * @brief  capture chain at a given rate and sample edge
+  * @param  hz  SCAN_CLK rate
+  * @param  edge  SCAN_EDGE_xxx
+  * @param  rx  chain bytes
+  * @param  len  chain length in bytes
+  * @retval bool  true if OK
+  */
+static bool tuneCapture(uint32_t hz, uint8_t edge, uint8_t *rx, uint8_t len)
+{
+    if ( scan_GetClock() != hz )
+        (void) scan_SetClock(hz);
+
+    if ( scan_GetSampleEdge() != edge )
+        scan_SetSampleEdge(edge);
+
+    return(scan_CaptureChain(rx, len));
+}
+
+/**
+  * @name   tuneStableMask
+  * @brief  find chain bits that hold still at the reference rate
+  * @param  mask  1 = stable bit, 0 = bit changed between captures
+  * @param  len  chain length in bytes
+  * @param  passes  reference captures to take
+  * @retval bool  false if a transfer failed
+  */
+static bool tuneStableMask(uint8_t *mask, uint8_t len, int passes)
+{
+    uint8_t         first[SCAN_MAX_BYTES];
+    uint8_t         data[SCAN_MAX_BYTES];
+
+    memset(mask, 0xFF, len);
+
+    if ( tuneCapture(SCAN_CLK_MIN_HZ, SCAN_EDGE_FALLING, first, len) == false )
+        return(false);
+
+    for ( int n = 1; n < passes; n++ )
+    {
+        if ( tuneCapture(SCAN_CLK_MIN_HZ, SCAN_EDGE_FALLING, data, len) == false )
+            return(false);
+
+        for ( int i = 0; i < len; i++ )
+            mask[i] &= ~(data[i] ^ first[i]);
+    }
+
+    return(true);
+}
+
+/**
+  * @name   tuneStep
+  * @brief  run one rate/edge step of the sweep
+  * @param  hz  SCAN_CLK rate
+  * @param  edge  SCAN_EDGE_xxx
+  * @param  mask  stable bits from tuneStableMask()
+  * @param  len  chain length in bytes
+  * @param  passes  captures to take
+  * @param  bitErrors  set to # of stable bits that disagreed
+  * @retval int  # of failed passes
+  */
+static int tuneStep(uint32_t hz, uint8_t edge, const uint8_t *mask, uint8_t len, int passes, uint32_t *bitErrors)
+{
+    uint8_t         ref[SCAN_MAX_BYTES];
+    uint8_t         data[SCAN_MAX_BYTES];
+    uint8_t         diff;
+    int             failed = 0;
+    int             refErrors = 0;
+    bool            bad;
+
+    *bitErrors = 0;
+
+    for ( int n = 0; n < passes; n++ )
+    {
+        // a reference failure says nothing about this rate, retry the pass
+        if ( tuneCapture(SCAN_CLK_MIN_HZ, SCAN_EDGE_FALLING, ref, len) == false )
+        {
+            if ( ++refErrors > passes )
+                return(passes);
+
+            n--;
+            continue;
+        }
+
+        if ( tuneCapture(hz, edge, data, len) == false )
+        {
+            failed++;
+            continue;
+        }
+
+        bad = false;
+        for ( int i = 0; i < len; i++ )
+        {
+            diff = (data[i] ^ ref[i]) & mask[i];
+            if ( diff )
+            {
+                *bitErrors += __builtin_popcount(diff);
+                bad = true;
+            }
+        }
+
+        if ( bad )
+            failed++;
+    }
+
+    return(failed);
+}
+
+/**
+  * @name   scantuneCmd
+  * @brief  'scan tune' sweep and save best rate/edge
+  * @param  arg  number of arguments to 'scan'
+  * @param  tokens[2]  optional captures per step
+  * @retval 0=OK 1=error
+  */
+int scantuneCmd(int arg)
+{
+    const scan_chain_t  *chain = scan_GetChain();
+    uint8_t             mask[SCAN_MAX_BYTES];
+    uint32_t            bestHz[2] = {0, 0};
+    uint32_t            bitErrors;
+    uint32_t            saveHz = scan_GetClock();
+    uint8_t             saveEdge = scan_GetSampleEdge();
+    uint8_t             edge;
+    int                 passes = SCANTUNE_DEFAULT_PASSES;
+    int                 failed;
+    int                 unstable = 0;
+
+    if ( arg >= 2 )
+        passes = atoi(tokens[2]);
+
+    if ( passes < 2 || passes > SCANTUNE_MAX_PASSES )
+    {
+        sprintf(outBfr, "Captures per step must be 2..%d", SCANTUNE_MAX_PASSES);
+        terminalOut(outBfr);
+        return(1);
+    }
+
+    if ( isCardPresent() == false )
+    {
+        terminalOut((char *) "NIC card is not present; cannot tune scan chain");
+        return(1);
+    }
+
+    if ( tuneStableMask(mask, chain->bytes, passes) == false )
+    {
+        terminalOut((char *) "Reference capture failed, scan clock not changed");
+        (void) scan_SetClock(saveHz);
+        scan_SetSampleEdge(saveEdge);
+        return(1);
+    }
+
+    for ( int i = 0; i < chain->bytes; i++ )
+        unstable += 8 - __builtin_popcount(mask[i]);
+
+    sprintf(outBfr, "Tuning %d byte chain, %d captures per step, %d changing bits ignored",
+            chain->bytes, passes, unstable);
+    terminalOut(outBfr);
+    terminalOut((char *) "    Rate(Hz)  Edge     Failed  Bit errors");
+
+    for ( edge = SCAN_EDGE_FALLING; edge <= SCAN_EDGE_RISING; edge++ )
+    {
+        bool    passing = true;
+
+        for ( unsigned r = 0; r < TUNE_RATE_CNT; r++ )
+        {
+            failed = tuneStep(tuneRates[r], edge, mask, chain->bytes, passes, &bitErrors);
+
+            sprintf(outBfr, "  %10lu  %-7s  %6d  %10lu%s", tuneRates[r], (edge == SCAN_EDGE_RISING) ? "rising" : "falling",
+                    failed, bitErrors, failed ? "  <--" : "");
+            terminalOut(outBfr);
+
+            // only rates with every slower rate passing count as reliable
+            if ( failed )
+                passing = false;
+            else if ( passing )
+                bestHz[edge] = tuneRates[r];
+        }
+    }
+
+    // prefer the falling edge (same sample point as the TC5 path) on a tie
+    edge = (bestHz[SCAN_EDGE_RISING] > bestHz[SCAN_EDGE_FALLING]) ? SCAN_EDGE_RISING : SCAN_EDGE_FALLING;
+
+    if ( bestHz[edge] == 0 )
+    {
+        terminalOut((char *) "No reliable scan clock rate found, scan clock not changed");
+        (void) scan_SetClock(saveHz);
+        scan_SetSampleEdge(saveEdge);
+        return(1);
+    }
+
+    EEPROMData.scan_clk_hz = scan_SetClock(bestHz[edge]);
+    EEPROMData.scan_sample_edge = edge;
+    scan_SetSampleEdge(edge);
+    EEPROM_Save();
+
+    sprintf(outBfr, "Saved scan clock %lu Hz, %s edge sampling to FLASH", EEPROMData.scan_clk_hz,
+            (edge == SCAN_EDGE_RISING) ? "rising" : "falling");
+    terminalOut(outBfr);
+    return(0);
+}
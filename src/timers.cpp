@@ -1,5 +1,7 @@
 #include <Arduino.h>
 #include "main.hpp"
+#include "pins.hpp"
+#include "timers.hpp"
 
 uint32_t                sampleRate = 4096;              // Mhz = this % 2
 
@@ -11,37 +13,131 @@ uint8_t                 shift;
 // this must align with staticPins active state inactive value
 static uint8_t          scanClockState = 1;
 
+static volatile TIMERS_SCAN_STATE   scanState = TIMERS_SCAN_IDLE;
+static volatile bool                scanLoading;        // SCAN_LD_N is low, raise on next tick
+static timers_scan_cb_t             scanCallback;
+static uint32_t                     scanStartTime;
+
+static volatile timers_stats_t  isrStats;
+
+bool tcIsSyncing(void);
+void tcStartCounter(void);
+
 /**
-  * @name   timers_scanChainCapture
-  * @brief  capture scan chain data & control CLK
-  * @param  None
+  * @name   scanFinish
+  * @brief  stop TC5 and report capture result
+  * @param  state  TIMERS_SCAN_DONE or TIMERS_SCAN_TIMEOUT
   * @retval None
+  * @note   TC5 ISR context, or thread with TC5 IRQ masked
+  */
+static void scanFinish(TIMERS_SCAN_STATE state)
+{
+    // CTRLA write without the sync wait; the ISR must not block
+    TC5->COUNT16.CTRLA.reg &= ~TC_CTRLA_ENABLE;
+    enableScanClk = false;
+
+    // leave the clock idle high if the capture was cut short
+    PORT->Group[pinGroup(OCP_SCAN_CLK)].OUTSET.reg = pinMask(OCP_SCAN_CLK);
+    PORT->Group[pinGroup(OCP_SCAN_LD_N)].OUTSET.reg = pinMask(OCP_SCAN_LD_N);
+
+    if ( state == TIMERS_SCAN_DONE )
+        isrStats.captures++;
+    else
+        isrStats.timeouts++;
+
+    scanState = state;
+
+    if ( scanCallback )
+        scanCallback(state, scanShiftRegister_0);
+}
+
+/**
+  * @name   timers_scanStart
+  * @brief  start a bit-bang scan chain capture and return at once
+  * @param  callback  called with the result when the capture ends, NULL
+  *                   for none; runs in TC5 ISR context on completion or
+  *                   from timers_scanPoll() on timeout
+  * @retval bool  false if a capture is already in flight
+  * @note   SCAN_LD_N is pulsed for one TC5 tick (~244 usec) before the
+  *         first clock
   */
-void timers_scanChainCapture(void)
+bool timers_scanStart(timers_scan_cb_t callback)
 {
+    if ( scanState == TIMERS_SCAN_BUSY )
+        return(false);
+
     // initialize vars used by timer handler
     scanClockPulseCounter = 0;
     scanShiftRegister_0 = 0;
     shift = 31;
+    scanClockState = 1;
+    scanCallback = callback;
 
-    // SCAN_CLK high
-    digitalWrite(OCP_SCAN_CLK, scanClockState);
+    // SCAN_CLK high, SCAN_LD_N low until the first tick
+    PORT->Group[pinGroup(OCP_SCAN_CLK)].OUTSET.reg = pinMask(OCP_SCAN_CLK);
+    PORT->Group[pinGroup(OCP_SCAN_LD_N)].OUTCLR.reg = pinMask(OCP_SCAN_LD_N);
 
-    // SCAN_LD_N low briefly
-    digitalWrite(OCP_SCAN_LD_N, 0);
-    delayMicroseconds(200);
-    digitalWrite(OCP_SCAN_LD_N, 1);
-
-    // start capture (when CLK falls)
+    scanLoading = true;
     enableScanClk = true;
+    scanState = TIMERS_SCAN_BUSY;
+    scanStartTime = millis();
+
+    // full period for the LD pulse
+    TC5->COUNT16.COUNT.reg = 0;
+    while (tcIsSyncing());
+
+    TC5->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
+    NVIC_ClearPendingIRQ(TC5_IRQn);
+    tcStartCounter();
+    return(true);
+}
 
-    while ( scanClockPulseCounter < 32 )
+/**
+  * @name   timers_scanPoll
+  * @brief  check on a capture started by timers_scanStart()
+  * @param  data  filled with the chain, first bit in bit 31, when the
+  *               result is TIMERS_SCAN_DONE; may be NULL
+  * @retval TIMERS_SCAN_STATE
+  * @note   a capture still running after TIMERS_SCAN_TIMEOUT_MS is
+  *         stopped here and reported as TIMERS_SCAN_TIMEOUT
+  */
+TIMERS_SCAN_STATE timers_scanPoll(uint32_t *data)
+{
+    if ( scanState == TIMERS_SCAN_BUSY && millis() - scanStartTime > TIMERS_SCAN_TIMEOUT_MS )
+    {
+        NVIC_DisableIRQ(TC5_IRQn);
+        if ( scanState == TIMERS_SCAN_BUSY )
+            scanFinish(TIMERS_SCAN_TIMEOUT);
+        NVIC_EnableIRQ(TC5_IRQn);
+    }
+
+    if ( scanState == TIMERS_SCAN_DONE && data != NULL )
+        *data = scanShiftRegister_0;
+
+    return(scanState);
+}
+
+/**
+  * @name   timers_scanChainCapture
+  * @brief  capture scan chain data & control CLK
+  * @param  None
+  * @retval bool  false if the capture timed out or one was in flight
+  * @note   original bit-bang path, kept as the reference for the SPI
+  *         engine in scan.cpp (see 'xdebug scancmp'); blocking wrapper
+  *         around timers_scanStart()/timers_scanPoll()
+  */
+bool timers_scanChainCapture(void)
+{
+    if ( timers_scanStart(NULL) == false )
+        return(false);
+
+    while ( timers_scanPoll(NULL) == TIMERS_SCAN_BUSY )
     {
         // wait for shifted data in
         ;
     }
 
-    enableScanClk = false;
+    return(scanState == TIMERS_SCAN_DONE);
 }
 
 /**
@@ -49,28 +145,97 @@ void timers_scanChainCapture(void)
   * @brief  TC ISR
   * @param  None
   * @retval None
+  * @note   the bit is sampled on the tick before CLK rises again, half
+  *         a clock period after the falling edge, which meets the
+  *         10 usec setup of Figure 97 without spinning in the ISR
   */
 void TC5_Handler(void) 
 {
-    if ( enableScanClk )
-    {      
-        if ( scanClockState == 1 )
-        {
-            // latch bit on falling edge of clock + 10 usec Figure 97
-            scanClockState = 0;
-            digitalWrite(OCP_SCAN_CLK, scanClockState);
-            delayMicroseconds(10);
-            scanShiftRegister_0 |= (digitalRead(OCP_SCAN_DATA_IN) << shift--);
-        }
-        else
-        {
-            scanClockState = 1;
-            scanClockPulseCounter++;
-            digitalWrite(OCP_SCAN_CLK, scanClockState);
-        }
+    uint32_t        entry = SysTick->VAL;
+    uint32_t        latency = TC5->COUNT16.COUNT.reg;       // continuously synced, ticks since match
+    uint32_t        cycles;
+
+    TC5->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
+
+    if ( enableScanClk == false )
+    {
+        isrStats.idleCalls++;
+    }
+    else if ( scanLoading )
+    {
+        // end of SCAN_LD_N pulse; clocking starts on the next tick
+        scanLoading = false;
+        PORT->Group[pinGroup(OCP_SCAN_LD_N)].OUTSET.reg = pinMask(OCP_SCAN_LD_N);
+    }
+    else if ( scanClockState == 1 )
+    {
+        // falling edge, data is shifted out by the NIC
+        scanClockState = 0;
+        PORT->Group[pinGroup(OCP_SCAN_CLK)].OUTCLR.reg = pinMask(OCP_SCAN_CLK);
+    }
+    else
+    {
+        // latch bit, then rising edge
+        if ( PORT->Group[pinGroup(OCP_SCAN_DATA_IN)].IN.reg & pinMask(OCP_SCAN_DATA_IN) )
+            scanShiftRegister_0 |= (1ul << shift);
+        shift--;
+
+        scanClockState = 1;
+        scanClockPulseCounter++;
+        PORT->Group[pinGroup(OCP_SCAN_CLK)].OUTSET.reg = pinMask(OCP_SCAN_CLK);
+
+        if ( scanClockPulseCounter >= TIMERS_SCAN_BITS )
+            scanFinish(TIMERS_SCAN_DONE);
     }
 
-    TC5->COUNT16.INTFLAG.bit.MC0 = 1; 
+    // SysTick counts down and reloads every msec
+    cycles = (entry - SysTick->VAL + SysTick->LOAD + 1) % (SysTick->LOAD + 1);
+
+    isrStats.calls++;
+    isrStats.cyclesTotal += cycles;
+    if ( cycles > isrStats.cyclesMax )
+        isrStats.cyclesMax = cycles;
+    isrStats.latencyTotal += latency;
+    if ( latency > isrStats.latencyMax )
+        isrStats.latencyMax = latency;
+}
+
+/**
+  * @name   timers_Running
+  * @brief  check if TC5 is counting
+  * @param  None
+  * @retval bool
+  */
+bool timers_Running(void)
+{
+    return(TC5->COUNT16.CTRLA.bit.ENABLE);
+}
+
+/**
+  * @name   timers_getStats
+  * @brief  get copy of TC5 ISR statistics
+  * @param  stats  filled with counters since last reset
+  * @retval None
+  */
+void timers_getStats(timers_stats_t *stats)
+{
+    NVIC_DisableIRQ(TC5_IRQn);
+    memcpy(stats, (const void *) &isrStats, sizeof(timers_stats_t));
+    NVIC_EnableIRQ(TC5_IRQn);
+}
+
+/**
+  * @name   timers_resetStats
+  * @brief  clear TC5 ISR statistics
+  * @param  None
+  * @retval None
+  */
+void timers_resetStats(void)
+{
+    NVIC_DisableIRQ(TC5_IRQn);
+    memset((void *) &isrStats, 0, sizeof(timers_stats_t));
+    isrStats.startTime = millis();
+    NVIC_EnableIRQ(TC5_IRQn);
 }
 
 /**
@@ -144,7 +309,8 @@ void tcConfigure(int sampleRate)
     //set prescaler
     //the clock normally counts at the GCLK_TC frequency, but we can set it to divide that frequency to slow it down
     //you can use different prescaler divisons here like TC_CTRLA_PRESCALER_DIV1 to get a different range
-    TC5->COUNT16.CTRLA.reg |= TC_CTRLA_PRESCALER_DIV1 | TC_CTRLA_ENABLE; //it will divide GCLK_TC frequency by 1
+    //TC5 is left disabled here, timers_scanChainCapture() starts it
+    TC5->COUNT16.CTRLA.reg |= TC_CTRLA_PRESCALER_DIV1; //it will divide GCLK_TC frequency by 1
 
     //set the compare-capture register. 
     //The counter will count up to this value (it's a 16bit counter so we use uint16_t)
@@ -153,10 +319,13 @@ void tcConfigure(int sampleRate)
     TC5->COUNT16.CC[0].reg = (uint16_t) (SystemCoreClock / sampleRate);
     while (tcIsSyncing());
 
+    // keep COUNT synced so the ISR can read its entry latency directly
+    TC5->COUNT16.READREQ.reg = TC_READREQ_RCONT | TC_READREQ_ADDR(TC_COUNT16_COUNT_OFFSET);
+
     // Configure interrupt request
     NVIC_DisableIRQ(TC5_IRQn);
     NVIC_ClearPendingIRQ(TC5_IRQn);
-    NVIC_SetPriority(TC5_IRQn, 0);
+    NVIC_SetPriority(TC5_IRQn, 1);
     NVIC_EnableIRQ(TC5_IRQn);
 
     // Enable the TC5 interrupt request
@@ -173,5 +342,5 @@ void tcConfigure(int sampleRate)
 void timers_Init(void) 
 {
     tcConfigure(sampleRate);
-    tcStartCounter();
+    timers_resetStats();
 }
@@ -0,0 +1,182 @@
+//===================================================================
+// txfmt.cpp
+// TxLine, the integer-only line formatter declared in txfmt.hpp.
+// A line claims TXFMT_LINE_MAX bytes of the console TX ring with its
+// first field, when they are contiguous, and formats straight into
+// them, so a finished line is queued by moving the ring head; only a
+// line that would straddle the end of the ring is built in bfr[] and
+// copied.
+//
+// Digits come from repeated divide by 10 on uint32_t, no float and
+// no printf, which is what lets the build drop -u_printf_float.
+//===================================================================
+#include <Arduino.h>
+#include "main.hpp"
+#include "console.hpp"
+#include "txfmt.hpp"
+
+#define TXFMT_TEXT_MAX          (TXFMT_LINE_MAX - 2)    // room kept for CR/LF
+
+static const char           hexDigits[] = "0123456789ABCDEF";
+
+/**
+  * @name   TxLine
+  * @brief  empty line, ring space is claimed by the first field
+  * @param  None
+  * @retval None
+  */
+TxLine::TxLine(void)
+{
+    p = NULL;
+    len = 0;
+    inRing = false;
+}
+
+/**
+  * @name   open
+  * @brief  claim TX ring space for the line, else use bfr[]
+  * @param  None
+  * @retval None
+  */
+void TxLine::open(void)
+{
+    p = console_txClaim(TXFMT_LINE_MAX);
+    inRing = (p != NULL);
+    if ( inRing == false )
+        p = bfr;
+}
+
+/**
+  * @name   putDec
+  * @brief  append a decimal field
+  * @param  mag  magnitude
+  * @param  neg  true = negative
+  * @param  places  digits after the decimal point
+  * @param  width  right align in this many columns, 0 = as needed
+  * @retval None
+  */
+void TxLine::putDec(uint32_t mag, bool neg, uint8_t places, uint8_t width)
+{
+    char            digits[12];
+    uint8_t         n = 0;
+    uint8_t         size;
+
+    if ( p == NULL )
+        open();
+
+    // at least one digit before the point
+    do
+    {
+        digits[n++] = '0' + (mag % 10);
+        mag /= 10;
+    } while ( mag || n <= places );
+
+    size = n + (places ? 1 : 0) + (neg ? 1 : 0);
+
+    while ( size < width && len < TXFMT_TEXT_MAX )
+    {
+        p[len++] = ' ';
+        width--;
+    }
+
+    if ( neg && len < TXFMT_TEXT_MAX )
+        p[len++] = '-';
+
+    while ( n && len < TXFMT_TEXT_MAX )
+    {
+        if ( n == places )
+        {
+            p[len++] = '.';
+            if ( len == TXFMT_TEXT_MAX )
+                break;
+        }
+
+        p[len++] = digits[--n];
+    }
+}
+
+/**
+  * @name   putHex
+  * @brief  append a zero padded upper case hex field
+  * @param  v  value
+  * @param  digits  1..8
+  * @retval None
+  */
+void TxLine::putHex(uint32_t v, uint8_t digits)
+{
+    if ( p == NULL )
+        open();
+
+    while ( digits && len < TXFMT_TEXT_MAX )
+        p[len++] = hexDigits[(v >> (--digits * 4)) & 0xF];
+}
+
+/**
+  * @name   putStr
+  * @brief  append a string, left aligned
+  * @param  s  string
+  * @param  width  pad with spaces to this many columns, 0 = none
+  * @retval None
+  */
+void TxLine::putStr(const char *s, uint8_t width)
+{
+    uint8_t         start = len;
+
+    if ( p == NULL )
+        open();
+
+    while ( *s && len < TXFMT_TEXT_MAX )
+        p[len++] = *s++;
+
+    while ( len - start < width && len < TXFMT_TEXT_MAX )
+        p[len++] = ' ';
+}
+
+/**
+  * @name   cursor
+  * @brief  append a VT100 cursor position, same as CURSOR()
+  * @param  row  1..
+  * @param  col  1..
+  * @retval None
+  */
+void TxLine::cursor(uint8_t row, uint8_t col)
+{
+    *this << "\x1b[" << txDec(row) << ';' << txDec(col) << 'f';
+}
+
+/**
+  * @name   send
+  * @brief  queue the line as is, like displayLine()
+  * @param  None
+  * @retval None
+  * @note   the TxLine is empty again afterwards and can be reused
+  */
+void TxLine::send(void)
+{
+    if ( p == NULL )
+        return;
+
+    if ( inRing )
+        console_txCommit(len);
+    else
+        console_write(bfr, len);
+
+    p = NULL;
+    len = 0;
+}
+
+/**
+  * @name   end
+  * @brief  add CR/LF and queue the line, like terminalOut()
+  * @param  None
+  * @retval None
+  */
+void TxLine::end(void)
+{
+    if ( p == NULL )
+        open();
+
+    p[len++] = '\r';
+    p[len++] = '\n';
+    send();
+}